@@ -47,6 +47,11 @@
 
 #define LOGGER_INTERNAL static
 
+/* LgFile sinks use pwrite, O_DIRECT and posix_fadvise when they're there */
+#if defined(LOGGER_IMPLEMENTATION) && !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stddef.h>
 
@@ -68,23 +73,100 @@ typedef unsigned int uint32_t;
 #define LOGGER_WAIT_PAUSE_MAGIC 1024
 
 /*
-  Defines time_str from lg_get_time_str size (WITH ZERO AT THE END!)
+  Defines time_str size (WITH ZERO AT THE END!)
+  Longest one is ISO-8601 with nanoseconds and offset:
+  2026-01-31T12:00:00.123456789+03:00
   All of time_str related functions uses this, if you
-  ever change lg_get_time_str function, update this
+  ever add a time style, update this
 */
-#define LOGGER_TIME_STR_SIZE 24
+#define LOGGER_TIME_STR_SIZE 40
 
 /* logger max message size (you can change it) */
 #define LOGGER_MAX_MSG_SIZE 256
 
+/* formatWorkers limit, reorder buffer has two batches per worker */
+#define LOGGER_MAX_FORMAT_WORKERS 16
+
+/* Writer pool limits, park timeout keeps idle ticks (sync intervals) going */
+#define LOGGER_POOL_MAX_THREADS 16
+#define LOGGER_POOL_MAX_INSTANCES 256
+#define LOGGER_POOL_PARK_MS 100
+
+/* CPUs that writerOptions.cpus can name */
+#define LOGGER_MAX_CPUS 1024
+#define LOGGER_CPU_WORDS (LOGGER_MAX_CPUS / (8 * sizeof(unsigned long)))
+
+/* Levels that drops are counted for (level values are below it) */
+#define LOGGER_MAX_LEVELS 32
+
+/*
+  Default of spillMaxQueued: LG_SPILL messages that can wait in memory
+  for the writer, ones past it are dropped (and counted as drops)
+*/
+#ifndef LOGGER_SPILL_MAX_QUEUED
+#define LOGGER_SPILL_MAX_QUEUED 16384
+#endif
+
+/* Maximum amount of categories per instance */
+#define LOGGER_MAX_CATEGORIES 64
+#define LOGGER_CATEGORY_NAME_SIZE 64
+
+/* Maximum amount of dynamic call site rules */
+#define LOGGER_MAX_SITE_RULES 64
+
 /* Maximum amount of files that can be in the sink */
 #define LOGGER_MAX_SINKS 8
 
+/*
+  Staging buffer size of LgFile sinks, must be multiple of
+  LOGGER_DIO_ALIGN (block size O_DIRECT writes are aligned to)
+*/
+#define LOGGER_DIO_ALIGN 4096
+#define LOGGER_DIO_STAGE_SIZE (64 * 1024)
+
+/*
+  Caps iovecs of one writev below the system's IOV_MAX (0 = no cap),
+  batches with more runs of a sink are written in chunks of it
+*/
+#ifndef LOGGER_IOV_MAX
+#define LOGGER_IOV_MAX 0
+#endif
+
 #define LOGGER_FILE_EXT ".log"
 #define LOGGER_FILE_EXT_SZ 4
 
+/* Logs dir's list of its .log files, retention keeps it */
+#define LOGGER_MANIFEST_NAME ".lgmanifest"
+#define LOGGER_LOG_NAME_SIZE 256
+
+/*
+  Sidecar index (indexFile): one block record per this many bytes
+  of the default file, bloom filter size of the block's words
+*/
+#define LOGGER_IDX_EXT ".idx"
+#define LOGGER_IDX_BLOCK_SIZE (64 * 1024)
+#define LOGGER_IDX_BLOOM_BITS 16384
+
+/*
+  sharedRing: writer checks the producer of a slot that's claimed but
+  not published after STALL ms, slot is skipped if the producer is dead
+*/
+#define LOGGER_SHM_STALL_MS 200
+
+/* lg_drain_signal_safe gives up after this if writer is in a batch */
+#define LOGGER_SIGNAL_WAIT_MS 50
+
+/* Pending lg_flush_async callbacks per instance */
+#define LOGGER_MAX_FLUSH_CALLBACKS 64
+
+/* In-flight producer counters per instance, threads share them round-robin beyond that */
+#define LOGGER_INFLIGHT_SLOTS 32
+
 #define LOGGER_CONTAINS_FLAG(main, flag) (main & (1u << flag))
 
+/* Level bit for sink level masks, like LOGGER_LEVEL_BIT(LG_ERROR) */
+#define LOGGER_LEVEL_BIT(level) (1u << (level))
+
 /* The ANSI bash color codes/escape characters */
 #define LOGGER_CLR_RED "\x1b[31m"
 #define LOGGER_CLR_GREEN "\x1b[32m"
@@ -100,9 +182,50 @@ typedef enum {
   /* Add more levels here */
 } LgLogLevel;
 
-/* Log with an explicit logger instance */
+#if defined(__cplusplus) || (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L)
+#define LOGGER_FUNC __func__
+#else
+#define LOGGER_FUNC __FUNCTION__
+#endif
+
+/*
+  Static descriptor of a logging call site, lg_log* macros make one
+  per call site and messages only carry a pointer to it.
+  Site registers itself on its first message (fmt and level are
+  taken from it), registry fields belong to the library.
+  off is the dynamic control flag (see lg_sites_set), macros
+  check it before doing anything else
+*/
+typedef struct LgCallSite {
+  const char* file;
+  const char* func;
+  int line;
+  LgLogLevel level;
+  const char* fmt;
+  struct LgCallSite* next; /* registry list (see lg_call_sites) */
+  volatile long state;     /* 0 = not registered yet */
+  volatile long off;       /* non-zero = disabled */
+} LgCallSite;
+
+#define LOGGER_CALL_SITE_INIT \
+  { __FILE__, LOGGER_FUNC, __LINE__, LG_INFO, NULL, NULL, 0, 0 }
+
+/*
+  Log with an explicit logger instance
+  Call sites need statement expressions (GCC/Clang). Other compilers
+  log without one, so their messages have no site and lg_sites_set
+  can't switch them (it returns -1 in such builds)
+*/
+#if defined(__GNUC__) || defined(__clang__)
+#define LOGGER_CALL_SITES
+#define lg_logi(instance, level, fmt, ...) __extension__ ({             \
+    static LgCallSite lgi_site_ = LOGGER_CALL_SITE_INIT;                \
+    __builtin_expect(lgi_site_.off, 0) ? 0 :                             \
+      lg_vlog_site_(instance, &lgi_site_, level, fmt, ##__VA_ARGS__); })
+#else
 #define lg_logi(instance, level, fmt, ...) \
   lg_vlog_(instance, level, fmt, ##__VA_ARGS__)
+#endif
 
 #define lg_infoi(instance, fmt, ...) \
   lg_logi(instance, LG_INFO, fmt, ##__VA_ARGS__)
@@ -120,12 +243,42 @@ typedef enum {
 /* you can add your custom level like this: */
 #define lg_custom(fmt, ...) lg_log(LG_CUSTOM, fmt, ##__VA_ARGS__)
 
+/* Log with a category handle (see lg_category), no call site without GCC/Clang either */
+#ifdef LOGGER_CALL_SITES
+#define lg_clog(cat, level, fmt, ...) __extension__ ({                  \
+    static LgCallSite lgi_site_ = LOGGER_CALL_SITE_INIT;                \
+    __builtin_expect(lgi_site_.off, 0) ? 0 :                             \
+      lg_vlog_cat_(cat, &lgi_site_, level, fmt, ##__VA_ARGS__); })
+#else
+#define lg_clog(cat, level, fmt, ...) \
+  lg_vlog_cat_(cat, NULL, level, fmt, ##__VA_ARGS__)
+#endif
+
+#define lg_cinfo(cat, fmt, ...) lg_clog(cat, LG_INFO, fmt, ##__VA_ARGS__)
+#define lg_cerror(cat, fmt, ...) lg_clog(cat, LG_ERROR, fmt, ##__VA_ARGS__)
+#define lg_cwarn(cat, fmt, ...) lg_clog(cat, LG_WARNING, fmt, ##__VA_ARGS__)
+
 typedef enum {
   LG_DROP = 0,
   LG_BLOCK = 1,
   LG_PRIORITY_BASED = 2,
+  LG_SPILL = 3, /* full ring overflows to a temp file, replayed in order */
 } LgLogPolicy;
 
+/* Layout of time_str, all of them are rendered in localTime or UTC */
+typedef enum {
+  LG_TIME_DEFAULT = 0, /* 2026.01.31-12.00.00.000 */
+  LG_TIME_ISO8601 = 1, /* 2026-01-31T12:00:00.000+03:00 (Z on UTC) */
+  LG_TIME_EPOCH = 2,   /* 1769850000.000 */
+} LgTimeStyle;
+
+/* Sub-second digits of time_str */
+typedef enum {
+  LG_TIME_MS = 0,
+  LG_TIME_US = 1,
+  LG_TIME_NS = 2,
+} LgTimePrecision;
+
 typedef enum {
   LG_OUT_TTY = 0,
   LG_OUT_FILE = 1,
@@ -138,14 +291,62 @@ typedef enum {
 
 typedef struct Logger Logger;
 
+/* Scheduling policy of writer threads */
+typedef enum {
+  LG_SCHED_DEFAULT = 0, /* inherited one */
+  LG_SCHED_OTHER = 1,
+  LG_SCHED_BATCH = 2,
+  LG_SCHED_IDLE = 3,
+  LG_SCHED_FIFO = 4,    /* real-time ones need privileges */
+  LG_SCHED_RR = 5,
+} LgSchedPolicy;
+
+/* Where ring's memory lives on NUMA machines */
+typedef enum {
+  LG_RING_FIRST_TOUCH = 0, /* wherever lg_init ran */
+  LG_RING_WRITER_NODE = 1, /* writer's node (after its affinity) */
+  LG_RING_NODE = 2,        /* ringNode */
+} LgRingPlacement;
+
+/*
+  Writer (and I/O) thread placement, Linux only (ignored elsewhere),
+  they are applied by the threads themselves and failures aren't fatal
+*/
+typedef struct {
+  const char* cpus;   /* CPU list like "2-3,8", NULL = any */
+  int nice;           /* 0 = inherited */
+  LgSchedPolicy sched;
+  int schedPriority;  /* LG_SCHED_FIFO/RR priority */
+  LgRingPlacement ringPlacement;
+  int ringNode;
+} LgThreadOptions;
+
+/* Writer threads shared by instances (see lg_pool_create) */
+typedef struct LgWriterPool LgWriterPool;
+
+/* Named category of an instance (see lg_category) */
+typedef struct LgCategory LgCategory;
+
+/* File handle with staging buffer and durability policy (see lg_file_open) */
+typedef struct LgFile LgFile;
+
 typedef struct LgString {
   char data[LOGGER_MAX_MSG_SIZE];
   size_t len;
 } LgString;
 
+/*
+  minLevel: sink accepts levels at or above this severity (LG_INFO = all)
+  levelMask: LOGGER_LEVEL_BIT set of accepted levels (0 = all)
+  both of them have to accept the message
+  handle: LgFile to write instead of file (file has to be NULL then)
+*/
 typedef struct {
   FILE* file;
   LgOutType type;
+  LgLogLevel minLevel;
+  uint32_t levelMask;
+  LgFile* handle;
 } LgSink;
 
 typedef struct {
@@ -155,6 +356,29 @@ typedef struct {
 
 typedef LgString LgMsgPack[LOGGER_MAX_OUT_TYPES];
 
+typedef enum {
+  LG_SYNC_NONE = 0,     /* kernel decides when it hits the disk */
+  LG_SYNC_BYTES = 1,    /* fdatasync after every syncBytes written */
+  LG_SYNC_INTERVAL = 2, /* fdatasync once written data is syncMillis old */
+} LgSyncPolicy;
+
+/*
+  Options of LgFile, all zero = staged but otherwise plain file
+  directIO: full blocks bypass the page cache with O_DIRECT
+            (F_NOCACHE on macOS), falls back to normal writes
+            if filesystem doesn't support it
+  dropCache: posix_fadvise(DONTNEED) the written parts, pages
+             are dropped for good once they're synced
+  sync: durability policy, syncBytes/syncMillis 0 = every batch
+*/
+typedef struct {
+  int directIO;
+  int dropCache;
+  LgSyncPolicy sync;
+  size_t syncBytes;
+  unsigned int syncMillis;
+} LgFileOptions;
+
 typedef int (*log_formatter_t)(
   const char* time_str,
   LgLogLevel level,
@@ -170,8 +394,91 @@ typedef struct {
   LgSinks sinks;
   LgLogPolicy logPolicy;
   log_formatter_t logFormatter;
+  /*
+    Non-zero = separate I/O thread writes batch N while
+    writer thread formats batch N+1 (costs one more thread)
+  */
+  int pipelineWrites;
+  /* Non-zero options = default file is opened as LgFile with them */
+  LgFileOptions fileOptions;
+  /* time_str layout, file names always use the default one */
+  LgTimeStyle timeStyle;
+  LgTimePrecision timePrecision;
+  /* Non-zero = default formatter writes file:line of the call site */
+  int logCallSite;
+  /*
+    Non-NULL = pool's threads serve this instance instead of
+    its own writer thread (pipelineWrites is ignored then)
+  */
+  LgWriterPool* writerPool;
+  /*
+    Non-zero = levels at or above priorityLevel go to a separate
+    ring that writer always drains first, so they don't wait
+    behind the backlog of the lower ones (costs one more ring)
+  */
+  int priorityLane;
+  LgLogLevel priorityLevel;
+  /* Writer thread placement, pooled instances ignore it */
+  LgThreadOptions writerOptions;
+  /*
+    Non-zero = default file gets a <file>.idx sidecar with time,
+    level and word summaries of its blocks (see tools/lgquery)
+  */
+  int indexFile;
+  /*
+    Retention limits next to maxFiles (0 = unlimited), oldest files
+    of logs dir are removed until all of them hold, in background
+    (lg_destroy joins that thread)
+  */
+  size_t maxTotalBytes;
+  unsigned int maxAgeSecs;
+  /*
+    Non-zero = ring lives in a memfd that forked children (through
+    the same instance) and lg_attach'ed processes log into, writer of
+    this one writes all of them (Linux, no LG_SPILL or writerPool)
+  */
+  int sharedRing;
+  /*
+    More than 1 = that many threads (writer is one of them) take batches
+    off the ring in turn and format them in parallel, I/O thread writes
+    them in ring order. For heavy formatters, custom one has to be
+    thread safe (implies pipelineWrites, ignored with writerPool)
+  */
+  int formatWorkers;
+  /*
+    LG_SPILL messages that can wait in memory until the writer moves
+    them to the spill file (0 = LOGGER_SPILL_MAX_QUEUED). A burst that
+    keeps fewer than that (on top of the ring) waiting loses nothing,
+    messages past it are dropped like LG_DROP ones
+  */
+  size_t spillMaxQueued;
 } LoggerConfig;
 
+/*
+  Handle of a claimed ring slot (see lg_reserve)
+  buf and cap point into the slot itself, write your message
+  there and publish it with lg_commit or give it back with lg_abort
+*/
+typedef struct {
+  Logger* inst;
+  void* slot;
+  size_t pos;
+  char* buf;
+  size_t cap;
+} LgReservation;
+
+/*
+  Flush point of lg_flush_ticket: positions of the rings (and spilled
+  messages) that have to be written. Fill it with lg_flush_ticket
+*/
+typedef struct {
+  size_t ring;
+  size_t lane;
+  size_t spill;
+} LgFlushTicket;
+
+typedef void (*lg_flush_cb)(void* arg);
+
 /* portable printf-format style checker (only available on gcc and clang) */
 #if defined(__clang__) || defined(__GNUC__)
   #define PRINTF_LIKE(fmt, args) __attribute__((format(printf, fmt, args)))
@@ -191,23 +498,200 @@ LOGGERDEF int lg_init_flat(Logger* inst, const char* logs_dir,
 
 /*
   IMPORTANT:
-  lg_destroy is safe to call from any single thread,
-  but the caller is responsible for ensuring no other
-  threads are actively pushing logs at the time of the call.
+  lg_destroy can be called while other threads are logging.
+  Calls that start after it get false, the ones already in
+  (and open reservations) are waited for and written, sink
+  changes and category setters too.
+  Flush waiters return and pending flush callbacks are called.
+  Instance struct must outlive every thread that can call into it
 */
 LOGGERDEF int lg_destroy(Logger* instance);
 
 LOGGERDEF int lg_is_alive(const Logger* instance);
 
+/*
+  Messages lost since lg_init (full ring, failed spill), writer also
+  logs a "dropped N messages" warning where the gap is
+*/
+LOGGERDEF size_t lg_get_dropped(const Logger* instance);
+
+/*
+  memfd of a sharedRing instance to hand to other processes (keep it
+  open through exec or send it over a unix socket), -1 = not shared
+*/
+LOGGERDEF int lg_shared_fd(const Logger* instance);
+
+/*
+  Makes instance a producer of another process' shared ring, it has
+  no files or writer of its own, lg_destroy detaches it.
+  fd is duplicated, caller can close it
+*/
+LOGGERDEF int lg_attach(Logger* instance, int fd);
+
+/*
+  Shared writer threads (1-16) that service many instances' rings
+  round-robin, a batch at a time, and park when all of them are empty.
+  Destroy its instances before the pool
+*/
+LOGGERDEF LgWriterPool* lg_pool_create(int threads);
+LOGGERDEF int lg_pool_destroy(LgWriterPool* pool);
+
 LOGGERDEF int lg_log_(Logger* inst, const LgLogLevel level,
                      const char* msg, size_t msglen);
 
+/*
+  n messages in one call, msgs are back to back (no terminators) and
+  lens[i] is the length of the i-th one with levels[i] as its level.
+  Same as n lg_log_ calls but too long ones are truncated, the instance
+  is entered once and a pool is woken every LOGGER_MIN_BATCH messages.
+  It's the entry point of FFI bindings, one foreign call per batch.
+  With cat (inst can be NULL then) its level filter and sinks apply.
+  ts[i] is its log time (epoch seconds, like time() but with fraction)
+  for callers that buffer them, ts or ts[i] 0 = now (double keeps the
+  header C89, it's about 0.25us at these magnitudes). Ones with an
+  unknown level are skipped.
+  Returns how many of them are logged
+*/
+LOGGERDEF size_t lg_log_batch(Logger* inst, LgCategory* cat, const LgLogLevel* levels,
+                             const char* msgs, const size_t* lens, const double* ts,
+                             size_t n);
+
 LOGGERDEF int lg_vlog_(Logger* inst, const LgLogLevel level,
                       const char* fmt, ...) PRINTF_LIKE(3, 4);
 
+/* lg_vlog_ with a call site, used at macros */
+LOGGERDEF int lg_vlog_site_(Logger* inst, LgCallSite* site, const LgLogLevel level,
+                           const char* fmt, ...) PRINTF_LIKE(4, 5);
+
+/*
+  Call site of the message which is being formatted, use it in
+  custom formatters (NULL if it isn't logged through lg_log* macros)
+*/
+LOGGERDEF const LgCallSite* lg_fmt_site(void);
+
+/* Registered call sites of the process, walk them with site->next */
+LOGGERDEF const LgCallSite* lg_call_sites(void);
+
+/*
+  Dynamic call site control (process-wide, like kernel's dynamic debug)
+  file_glob: glob (* and ?) on site's path or its base name, NULL = any
+  func: function name, NULL = any
+  line_from/line_to: line range, 0 = open end
+  Rules are kept and applied in order (last match wins) to the sites
+  that register later too. Returns the amount of matched registered sites,
+  -1 on bad input or when LOGGER_MAX_SITE_RULES are kept already
+  (lg_sites_reset clears them)
+*/
+LOGGERDEF int lg_sites_set(const char* file_glob, const char* func,
+                          int line_from, int line_to, int enable);
+
+/*
+  Same thing as a query: "file net_*.c func send line 10-20 -p"
+  +p enables, -p disables, returns matched sites or -1 on bad query
+*/
+LOGGERDEF int lg_sites_control(const char* query);
+
+/* Runs the queries of a control file (one per line, # comments) */
+LOGGERDEF int lg_sites_load(const char* path);
+
+/* Forgets all the rules and enables every site */
+LOGGERDEF int lg_sites_reset(void);
+
+/*
+  Reloads the control file when the signal comes (POSIX only),
+  signal handler just sets a flag, a writer thread does the reload.
+  Reload replaces all the rules with the file's ones
+*/
+LOGGERDEF int lg_sites_watch(const char* path, int signum);
+
+/*
+  Named categories ("net", "net.http", "db") share the instance's ring
+  and writer, "net.http" creates "net" as well. Level filter and sink
+  mask are inherited from the parent until they are set.
+  Lookup compares names, get the handle once and keep it,
+  it's valid until lg_destroy
+*/
+LOGGERDEF LgCategory* lg_category(Logger* inst, const char* name);
+LOGGERDEF const char* lg_category_name(const LgCategory* cat);
+
+/* Same filter as sinks, rejected messages never reach the ring */
+LOGGERDEF int lg_category_set_level(LgCategory* cat, LgLogLevel minLevel,
+                                    uint32_t levelMask);
+
+/*
+  Every sink has a mask bit: config sinks 0.., default file, then
+  runtime added ones take the lowest free bit. A sink keeps its bit
+  while it's there, removing one clears its bit from the categories'
+  masks (but all-ones) and the next added sink takes it
+*/
+LOGGERDEF int lg_category_set_sinks(LgCategory* cat, uint32_t sinkMask);
+
+/* Drops own settings, parent's ones apply again */
+LOGGERDEF int lg_category_inherit(LgCategory* cat);
+
+/* Category of the message being formatted (NULL if there's none) */
+LOGGERDEF const LgCategory* lg_fmt_category(void);
+
+/* lg_vlog_site_ of categories, used at macros (site can be NULL) */
+LOGGERDEF int lg_vlog_cat_(LgCategory* cat, LgCallSite* site, const LgLogLevel level,
+                          const char* fmt, ...) PRINTF_LIKE(4, 5);
+
+/*
+  Two-phase enqueue: lg_reserve claims a slot (log policy applies here),
+  caller writes at most res->cap - 1 bytes into res->buf,
+  then lg_commit publishes it or lg_abort discards it.
+  Every successful reserve MUST be followed by commit or abort,
+  the writer cannot pass an unpublished slot.
+*/
+LOGGERDEF int lg_reserve(Logger* inst, const LgLogLevel level,
+                        LgReservation* res);
+LOGGERDEF int lg_commit(LgReservation* res, size_t len,
+                       const LgLogLevel level);
+LOGGERDEF int lg_abort(LgReservation* res);
+
+/*
+  Async-signal-safe ones for signal (crash) handlers. Log formats with
+  a small reentrant formatter (%d %i %u %x %X %p %s %c %%, l ll z
+  lengths, width, 0 and - flags) and drops if the ring is full (whatever
+  the policy is). Drain writes at most max pending messages to FILE
+  sinks with write(2) and LgFile ones with pwrite(2) in "<time_str>
+  [LEVEL] msg" layout. time_str has instance's style unless it's local
+  time, it's epoch then and lgsearch/lgquery (.idx header's style)
+  misread those lines. False if the writer didn't let go in
+  LOGGER_SIGNAL_WAIT_MS (it may be the interrupted thread) or if a
+  message of an LgFile sink is left on the ring since the pipelined
+  I/O thread may be on it. Not for other processes of a shared ring
+*/
+LOGGERDEF int lg_log_signal_safe(Logger* inst, const LgLogLevel level,
+                                 const char* fmt, ...) PRINTF_LIKE(3, 4);
+LOGGERDEF int lg_drain_signal_safe(Logger* inst, size_t max);
+
+/*
+  Waits until everything logged before the call is written to the sinks
+  (write(2) is done, not fsync), false on timeout or dead instance.
+  Waiters sleep on a condition, writer wakes them after its batch
+*/
+LOGGERDEF int lg_flush(Logger* inst, unsigned int timeout_ms);
+
+/* Non-blocking parts of it: ticket is the flush point, done polls it */
+LOGGERDEF int lg_flush_ticket(Logger* inst, LgFlushTicket* ticket);
+LOGGERDEF int lg_flush_done(const Logger* inst, const LgFlushTicket* ticket);
+LOGGERDEF int lg_flush_wait(Logger* inst, const LgFlushTicket* ticket, unsigned int timeout_ms);
+
+/*
+  Calls cb(arg) on the writer (or I/O) thread once ticket is written,
+  keep it short. 1 = queued, 2 = it's already written (cb isn't called),
+  0 = dead instance or LOGGER_MAX_FLUSH_CALLBACKS are pending
+*/
+LOGGERDEF int lg_flush_async(Logger* inst, const LgFlushTicket* ticket,
+                             lg_flush_cb cb, void* arg);
+
 LOGGERDEF int lg_flogi(Logger* inst, const LgLogLevel level, const char* msg);
 LOGGERDEF int lg_flog(const LgLogLevel level, const char* msg);
 
+/* Category one */
+LOGGERDEF int lg_fclog(LgCategory* cat, const LgLogLevel level, const char* msg);
+
 /* Explicit instances */
 LOGGERDEF int lg_finfoi(Logger* inst, const char* msg);
 LOGGERDEF int lg_ferrori(Logger* inst, const char* msg);
@@ -224,9 +708,37 @@ LOGGERDEF Logger* lg_get_active_instance();
 
 LOGGERDEF const char* lg_lvl_to_str(const LgLogLevel level);
 
+/* Severity order of levels, used by minimum level filters */
+LOGGERDEF int lg_lvl_severity(const LgLogLevel level);
+
 LOGGERDEF LoggerConfig lg_get_defaults();
 
 LOGGERDEF int lg_append_sink(LoggerConfig* config, FILE* f, LgOutType type);
+LOGGERDEF int lg_append_sink_filtered(LoggerConfig* config, FILE* f, LgOutType type,
+                                     LgLogLevel min_level, uint32_t level_mask);
+
+/*
+  Runtime sink management, logging never pauses while these run.
+  Writer picks the new sink table up between batches.
+  A removed file is closed by the writer once no batch uses it,
+  so DO NOT close it yourself (stdout/stderr are only flushed)
+*/
+LOGGERDEF int lg_add_sink(Logger* inst, FILE* f, LgOutType type);
+LOGGERDEF int lg_add_sink_filtered(Logger* inst, FILE* f, LgOutType type,
+                                  LgLogLevel min_level, uint32_t level_mask);
+LOGGERDEF int lg_remove_sink(Logger* inst, FILE* f);
+
+/*
+  LgFile sinks, writes are staged in LOGGER_DIO_ALIGN aligned buffer
+  and go to the file once it's full, on sync and when writer is idle.
+  Logger owns the file once it's given as a sink, lg_file_close
+  is only for the files that never made it into one
+*/
+LOGGERDEF LgFile* lg_file_open(const char* path, LgFileOptions opts);
+LOGGERDEF int lg_file_close(LgFile* f);
+LOGGERDEF int lg_append_file_sink(LoggerConfig* config, LgFile* f, LgOutType type);
+LOGGERDEF int lg_add_file_sink(Logger* inst, LgFile* f, LgOutType type);
+LOGGERDEF int lg_remove_file_sink(Logger* inst, LgFile* f);
 
 LOGGERDEF void lg_str_format_into(LgString* s, const char* fmt, ...)
   PRINTF_LIKE(2, 3);
@@ -234,6 +746,7 @@ LOGGERDEF void lg_str_format_into(LgString* s, const char* fmt, ...)
 LOGGERDEF void lg_str_write_into(LgString* s,
                                 const char* already_formatted_str);
 
+/* Renders current time in instance's time style, buf has LOGGER_TIME_STR_SIZE */
 LOGGERDEF int lg_get_time_str(Logger* inst, char* buf);
 
 LOGGERDEF Logger* lg_alloc();
@@ -276,6 +789,11 @@ LOGGERDEF FILE* lg_fopen(const char* path);
 #include <stdalign.h>
 #include <stdarg.h>
 
+// MSVC has no PATH_MAX, internal structs below are sized with it (MAX_PATH * 2)
+#if defined(_WIN32) && !defined(PATH_MAX)
+#define PATH_MAX (260 * 2)
+#endif
+
 #ifdef __cplusplus
 #include <atomic>
 #define ATOMIC(T) std::atomic<T>
@@ -289,6 +807,7 @@ LOGGERDEF FILE* lg_fopen(const char* path);
 #define atomic_fetch_add_explicit std::atomic_fetch_add_explicit
 #define atomic_compare_exchange_weak_explicit std::atomic_compare_exchange_weak_explicit
 #define atomic_compare_exchange_strong_explicit std::atomic_compare_exchange_strong_explicit
+#define atomic_exchange_explicit std::atomic_exchange_explicit
 #else
 #include <stdatomic.h>
 #define ATOMIC(T) _Atomic(T)
@@ -298,19 +817,54 @@ LOGGERDEF FILE* lg_fopen(const char* path);
 #define LOGGER_CACHE_LINE 64
 #define LOGGER_ALIGN alignas(LOGGER_CACHE_LINE)
 
+// Payload flags
+#define LGI_PAYLOAD_SKIP (1u << 0) // aborted reservation, nothing to write
+
 typedef struct {
   char msg[LOGGER_MAX_MSG_SIZE];
   size_t length;
   LgLogLevel level;
+  uint32_t flags;
+  uint64_t ts; // producer's wall clock, ns since epoch
+  const LgCallSite* site; // NULL = not logged through the macros
+  const LgCategory* cat; // NULL = instance itself
+  uint32_t sink_mask; // category's sinks at log time
 } LogPayload;
 
 typedef struct {
   LOGGER_ALIGN ATOMIC(size_t) seq;
+  ATOMIC(int) owner; // producer's pid on shared rings, taken before the claim (0 = free)
   LogPayload payload;
 } LogSlot;
 
-// Maximum amount of slots can be written at once
-#define LOGGER_MAX_BATCH 32
+// LG_SPILL overflow, producers push them and writer spills them
+typedef struct LgSpillNode {
+  struct LgSpillNode* next;
+  LogPayload payload;
+} LgSpillNode;
+
+// header of a spill file record, message bytes follow it
+typedef struct {
+  uint64_t ts;
+  const LgCallSite* site;
+  const LgCategory* cat;
+  uint32_t sink_mask;
+  LgLogLevel level;
+  uint32_t length;
+} LgSpillRec;
+
+// LgReservation.pos of spill nodes
+#define LGI_SPILL_POS ((size_t)-1)
+
+/*
+  Slots a batch takes at once, writer starts with LOGGER_MIN_BATCH and
+  doubles it while the ring stays backed up, halves it once it's not
+*/
+#define LOGGER_MIN_BATCH 32
+#define LOGGER_MAX_BATCH 256
+
+// First size of a batch's output buffers, they grow on demand
+#define LOGGER_OUT_BUF_INIT 4096
 
 // Size of ring buffer you can change it
 // but make sure that it is power of 2
@@ -319,6 +873,9 @@ typedef struct {
 #if (LOGGER_RING_SIZE & LOGGER_RING_MASK) != 0
   #error "Ring buffer's size is not power of 2!"
 #endif
+#if LOGGER_MIN_BATCH > LOGGER_MAX_BATCH || LOGGER_MAX_BATCH > LOGGER_RING_SIZE
+  #error "Batch limits don't fit in the ring!"
+#endif
 #define LOGGER_RING_STRIDE ((sizeof(LogSlot) + LOGGER_CACHE_LINE - 1) \
                             & ~(size_t)(LOGGER_CACHE_LINE - 1))
 #define LOGGER_RING_TOTAL_SIZE (LOGGER_RING_SIZE * LOGGER_RING_STRIDE)
@@ -326,15 +883,205 @@ typedef struct {
 typedef struct {
   LOGGER_ALIGN ATOMIC(size_t) head;
   LOGGER_ALIGN size_t tail;
-  uint8_t slots[LOGGER_RING_TOTAL_SIZE];
+  LOGGER_ALIGN uint8_t slots[LOGGER_RING_TOTAL_SIZE];
 } LogQueue;
 
+// LgDrops.state, a run of drops is marked by its first one
+#define LGI_DROPS_NONE 0
+#define LGI_DROPS_MARKING 1
+#define LGI_DROPS_MARKED 2
+
+// lost messages, in shared memory when the ring is
+typedef struct {
+  LOGGER_ALIGN ATOMIC(int) state;
+  ATOMIC(size_t) mark[3]; // ring/lane heads and spill pushes at the first drop, record goes after them
+  ATOMIC(size_t) total;
+  ATOMIC(size_t) counts[LOGGER_MAX_LEVELS]; // not reported yet
+} LgDrops;
+
+/*
+  memfd mapping of a sharedRing instance, producers of every process
+  use the same seq protocol on it. Lane pages are never touched
+  (so never allocated) when there's no lane
+*/
+#define LGI_SHM_MAGIC "LGSHM03"
+
+typedef struct {
+  char magic[8];
+  uint32_t ring_size; // layout check of lg_attach
+  uint32_t stride;
+  uint32_t lane_levels;
+  LgLogPolicy policy;
+  LgTimePrecision precision;
+  LOGGER_ALIGN ATOMIC(bool) closed; // writer is gone, producers drop
+  LgDrops drops;
+  LogQueue ring;
+  LogQueue lane;
+} LgShm;
+
+// head slot of a shared ring that's claimed but not published (writer only)
+typedef struct {
+  size_t pos;
+  uint64_t since_ms; // 0 = not stalled
+  uint64_t check_ms; // producer was checked last
+} LgStall;
+
+typedef struct LgBatch LgBatch;
+
+/*
+  Immutable sink table, writer picks the latest one between batches.
+  Updaters never modify a published table, they publish a changed copy
+  which points to the older ones until writer retires them (RCU-style)
+*/
+typedef struct LgSinkTable {
+  struct LgSinkTable* prev; // older tables that writer hasn't retired yet
+  size_t count;
+  uint32_t out_needed; // needed file flags for formatter
+  uint32_t type_levels[LOGGER_MAX_OUT_TYPES]; // levels some sink of that type accepts
+  uint32_t levels[LOGGER_MAX_SINKS + 1]; // accepted levels per sink
+  uint32_t bits[LOGGER_MAX_SINKS + 1]; // category mask bit per sink, it keeps it until it's removed
+  LgSink items[LOGGER_MAX_SINKS + 1]; // +1 for default file
+} LgSinkTable;
+
+/*
+  Staged file, only the thread that writes batches touches it.
+  stage holds the file bytes [stage_off, stage_off + len), first
+  `shown` of them are already written, the rest is on memory only
+*/
+struct LgFile {
+  int fd;  // buffered fd, partial blocks and syncs go through it
+  int dfd; // O_DIRECT fd for full blocks, -1 = not direct
+  LgFileOptions opts;
+  char* raw; // allocation of stage
+  char* stage; // LOGGER_DIO_ALIGN aligned
+  size_t len;
+  size_t shown;
+  uint64_t stage_off;
+  size_t unsynced; // bytes since last sync
+  uint64_t dirty_ms; // when unsynced went non-zero
+  uint64_t drop_from; // page cache advice start
+  uint64_t drop_mark; // written end at the last advice
+};
+
+/*
+  Sidecar index file layout (native endianness), a header and
+  then a block record per LOGGER_IDX_BLOCK_SIZE bytes of the log.
+  Blocks start at line starts, open one is written on lg_destroy
+  so the bytes after the last block are just not indexed yet
+*/
+#define LGI_IDX_MAGIC "LGIDX01"
+#define LGI_IDX_BLOOM_WORDS (LOGGER_IDX_BLOOM_BITS / 64)
+
+typedef struct {
+  char magic[8];
+  uint32_t block_size;
+  uint32_t bloom_bits;
+  uint32_t time_style; // of the lines, lgquery parses them
+  uint32_t local_time;
+  uint32_t def_format; // lines have the default layout
+  uint32_t reserved;
+} LgIdxHeader;
+
+typedef struct {
+  uint64_t offset; // of the first line in the log file
+  uint64_t length;
+  uint64_t ts_min; // ns since epoch
+  uint64_t ts_max;
+  uint32_t levels; // LOGGER_LEVEL_BIT set of its lines
+  uint32_t count;
+  uint64_t bloom[LGI_IDX_BLOOM_WORDS]; // lowercased words
+} LgIdxBlock;
+
+// line of a batch that goes to the indexed file
+typedef struct {
+  uint64_t ts;
+  LgLogLevel level;
+  uint32_t skip; // time_str prefix, its digits would flood the bloom
+  uint32_t off; // where it is in the batch's out buffer
+  uint32_t len;
+} LgIdxLine;
+
+// writer stage only
+typedef struct {
+  FILE* out;
+  FILE* file; // indexed sink, the default file
+  LgFile* handle;
+  uint64_t offset; // bytes written to it so far
+  LgIdxBlock cur;
+} LgIndex;
+
+/*
+  Rendered time_str of one second, only the sub-second
+  digits are patched in until the second changes
+*/
+typedef struct {
+  bool valid;
+  int64_t sec;
+  size_t prefix_len;
+  size_t suffix_len;
+  char prefix[LOGGER_TIME_STR_SIZE];
+  char suffix[8]; // ISO-8601 offset
+} LgTimeCache;
+
+// one of logs dir's .log files
+typedef struct {
+  int64_t mtime; // 0 = not known yet (it was open), stat it
+  uint64_t bytes; // with its sidecar index
+  char name[LOGGER_LOG_NAME_SIZE];
+} LgLogEntry;
+
+typedef struct {
+  LgLogEntry* items; // oldest first
+  size_t count;
+  size_t cap;
+} LgLogList;
+
+/*
+  Retention job of an lg_init, it doesn't touch the instance.
+  Manifest is trusted while its mtime is the dir's one before
+  this lg_init added its file, anything else touching the dir
+  changes it so the manifest is rebuilt from a scan
+*/
+typedef struct {
+  char dir[PATH_MAX]; // with trailing separator
+  char name[LOGGER_LOG_NAME_SIZE]; // file just opened, never removed
+  bool dir_known;
+  int64_t dir_sec;
+  long dir_nsec;
+  int max_files;
+  size_t max_bytes;
+  unsigned int max_age;
+} LgRetention;
+
+// Dynamic call site rule, see lg_sites_set
+typedef struct {
+  char file[128]; // empty = any
+  char func[64];  // empty = any
+  int line_from;
+  int line_to;
+  bool enable;
+} LgSiteRule;
+
+/*
+  Writer's context of the message being formatted,
+  formatters have no instance argument so it's thread-local
+*/
+typedef struct {
+  const LgCallSite* site;
+  bool show_site;
+  const LgCategory* cat;
+} LgFmtContext;
+
 // Static function forward-declerations
 LOGGER_INTERNAL int lgi_check_dir(const char* path);
 
 LOGGER_INTERNAL bool lgi_normalize_path(const char* path, char* out, size_t size);
 
-LOGGER_INTERNAL int lgi_count_logs_and_get_oldest(const char* path, char* oldest_path, size_t oldest_path_size);
+LOGGER_INTERNAL bool lgi_logs_scan(const char* dir, LgLogList* list);
+LOGGER_INTERNAL bool lgi_manifest_load(const LgRetention* r, LgLogList* list);
+LOGGER_INTERNAL bool lgi_manifest_save(const LgRetention* r, const LgLogList* list);
+LOGGER_INTERNAL void lgi_retention_run(LgRetention* r);
+LOGGER_INTERNAL void lgi_retention_start(Logger* inst, LgRetention* r);
 
 LOGGER_INTERNAL bool lgi_mkdir_p(char* path);
 
@@ -342,18 +1089,92 @@ LOGGER_INTERNAL int lgi_def_format_msg(const char* time_str, LgLogLevel level,
                                       const char* msg, uint32_t needed, LgMsgPack pack);
 
 LOGGER_INTERNAL void lgi_queue_create(LogQueue* q);
+LOGGER_INTERNAL LogSlot* lgi_queue_claim(Logger* inst, LogQueue* q, LgLogLevel level,
+                                         LgLogPolicy policy, size_t* out_pos);
+LOGGER_INTERNAL void lgi_queue_publish(LogSlot* s, size_t pos);
 LOGGER_INTERNAL size_t lgi_queue_pop_batch(LogQueue* q, size_t* start_pos, size_t max_batch);
-LOGGER_INTERNAL bool lgi_queue_ppr_batch(Logger* inst, size_t* start_pos);
+LOGGER_INTERNAL bool lgi_queue_pop_into(Logger* inst, LogQueue* q, LgBatch* b);
+LOGGER_INTERNAL void lgi_batch_format(Logger* inst, LgBatch* b);
+LOGGER_INTERNAL void lgi_batch_write(Logger* inst, LgBatch* b);
+LOGGER_INTERNAL void lgi_flush_advance(Logger* inst, const LgBatch* b);
+LOGGER_INTERNAL void lgi_flush_wake(Logger* inst);
+LOGGER_INTERNAL void lgi_flush_finish(Logger* inst);
 LOGGER_INTERNAL void lgi_queue_release(LogQueue* q, size_t pos);
 
 LOGGER_INTERNAL void lgi_adaptive_wait(int* spins);
+LOGGER_INTERNAL void lgi_spin_lock(ATOMIC(bool)* lock);
+LOGGER_INTERNAL void lgi_spin_unlock(ATOMIC(bool)* lock);
+
+LOGGER_INTERNAL LgSinkTable* lgi_sink_table_new(const LgSinkTable* src, const LgSink* skip);
+LOGGER_INTERNAL void lgi_sink_table_add(LgSinkTable* t, LgSink sink);
+LOGGER_INTERNAL void lgi_sink_table_put(LgSinkTable* t, LgSink sink, uint32_t bit);
+LOGGER_INTERNAL uint32_t lgi_level_bits(LgLogLevel minLevel, uint32_t levelMask);
+LOGGER_INTERNAL bool lgi_sink_table_has(const LgSinkTable* t, const LgSink* s);
+LOGGER_INTERNAL bool lgi_sink_close(const LgSink* s);
+LOGGER_INTERNAL bool lgi_sinks_retire(Logger* inst, LgSinkTable* next);
+LOGGER_INTERNAL int lgi_sinks_add(Logger* inst, LgSink sink);
+LOGGER_INTERNAL int lgi_sinks_remove(Logger* inst, const LgSink* sink);
+LOGGER_INTERNAL void lgi_sinks_tick(LgSinkTable* t);
+
+LOGGER_INTERNAL size_t lgi_time_render(LgTimeCache* c, uint64_t ts, LgTimeStyle style,
+                                       LgTimePrecision prec, bool local, char* buf);
+
+LOGGER_INTERNAL int lgi_vlog(Logger* inst, LgCategory* cat, LgCallSite* site, LgLogLevel level,
+                             const char* fmt, va_list args);
+LOGGER_INTERNAL void lgi_site_register(LgCallSite* site, LgLogLevel level, const char* fmt);
+LOGGER_INTERNAL bool lgi_site_rules_off(const LgCallSite* site);
+LOGGER_INTERNAL void lgi_sites_poll(void);
+LOGGER_INTERNAL bool lgi_pool_attach(LgWriterPool* pool, Logger* inst);
+LOGGER_INTERNAL void lgi_pool_detach(LgWriterPool* pool, Logger* inst);
+LOGGER_INTERNAL void lgi_pool_notify(LgWriterPool* pool);
+LOGGER_INTERNAL void* lgi_pool_worker(void* arg);
+LOGGER_INTERNAL bool lgi_parse_cpus(const char* list, unsigned long* mask);
+LOGGER_INTERNAL void lgi_thread_setup(Logger* inst, bool place_ring);
+LOGGER_INTERNAL void* lgi_consume_loop(Logger* inst);
+LOGGER_INTERNAL LogPayload* lgi_res_payload(const LgReservation* res);
+LOGGER_INTERNAL void lgi_count_drop(Logger* inst, LgLogLevel level);
+LOGGER_INTERNAL void lgi_drops_init(LgDrops* d);
+LOGGER_INTERNAL bool lgi_shm_map(Logger* inst, int fd);
+LOGGER_INTERNAL void lgi_shm_close(Logger* inst);
+LOGGER_INTERNAL void lgi_shm_reap(Logger* inst, LogQueue* q, LgStall* st);
+LOGGER_INTERNAL bool lgi_shm_own(LogQueue* q, LogSlot* s, size_t pos, int* spins);
+LOGGER_INTERNAL void lgi_shm_check(Logger* inst, LogSlot* s);
+LOGGER_INTERNAL bool lgi_spill_reserve(Logger* inst, LgLogLevel level, LgReservation* res);
+LOGGER_INTERNAL bool lgi_enter(Logger* inst);
+LOGGER_INTERNAL void lgi_exit(Logger* inst);
+LOGGER_INTERNAL long lgi_inflight(const Logger* inst);
+LOGGER_INTERNAL void lgi_inflight_reset(Logger* inst);
+LOGGER_INTERNAL bool lgi_spilling(Logger* inst);
+LOGGER_INTERNAL void lgi_spill_push(Logger* inst, LgSpillNode* n);
+LOGGER_INTERNAL void lgi_spill_flush(Logger* inst);
+LOGGER_INTERNAL bool lgi_seek(FILE* f, size_t off);
+LOGGER_INTERNAL bool lgi_spill_batch(Logger* inst, LgBatch* b);
+LOGGER_INTERNAL bool lgi_drop_batch(Logger* inst, LgBatch* b);
+LOGGER_INTERNAL void lgi_batch_begin(Logger* inst, LgBatch* b);
+LOGGER_INTERNAL void lgi_batch_add(Logger* inst, LgBatch* b, const LogPayload* payload);
+LOGGER_INTERNAL void lgi_batch_free(LgBatch* b);
+LOGGER_INTERNAL void lgi_pipe_free(Logger* inst);
+LOGGER_INTERNAL void lgi_idx_bloom_add(uint64_t* bloom, const char* s, size_t n);
+LOGGER_INTERNAL inline bool lgi_idx_bloom_test(const uint64_t* bloom, const char* s, size_t n);
+LOGGER_INTERNAL void lgi_idx_line(LgIndex* idx, const LgIdxLine* ln, const char* line, size_t len);
+LOGGER_INTERNAL void lgi_idx_lines(LgIndex* idx, const LgBatch* b, int k);
+LOGGER_INTERNAL size_t lgi_sig_format(char* out, size_t cap, const char* fmt, va_list args);
+LOGGER_INTERNAL size_t lgi_sig_drain(Logger* inst, LogQueue* q, LgSinkTable* t, size_t max,
+                                     bool* blocked);
+LOGGER_INTERNAL bool lgi_idx_close(LgIndex* idx);
+
+LOGGER_INTERNAL bool lgi_file_put(LgFile* f, const char* p, size_t n);
+LOGGER_INTERNAL bool lgi_file_flush(LgFile* f, bool tail);
+LOGGER_INTERNAL bool lgi_file_sync(LgFile* f);
+LOGGER_INTERNAL bool lgi_file_tick(LgFile* f, bool idle);
+LOGGER_INTERNAL void lgi_handoff_wait(int* spins);
 
 LOGGER_INTERNAL inline LogSlot* lgi_slot_get(LogQueue* q, size_t idx)
 {
   return (LogSlot*)(q->slots + (idx & LOGGER_RING_MASK) * LOGGER_RING_STRIDE);
 }
 
-// Manual writes for lg_get_time_str
+// Manual writes for time_str rendering
 LOGGER_INTERNAL inline void lgi_time_write2(char* p, int v)
 {
   p[0] = (char)('0' + v / 10);
@@ -364,11 +1185,12 @@ LOGGER_INTERNAL inline void lgi_time_write4(char* p, int v)
   lgi_time_write2(p, v / 100);
   lgi_time_write2(p + 2, v % 100);
 }
-LOGGER_INTERNAL inline void lgi_time_write3(char* p, int v)
+LOGGER_INTERNAL inline void lgi_time_writen(char* p, uint32_t v, int n)
 {
-  p[0] = (char)('0' + v / 100);
-  p[1] = (char)('0' + (v / 10) % 10);
-  p[2] = (char)('0' + v % 10);
+  while (n-- > 0) {
+    p[n] = (char)('0' + v % 10);
+    v /= 10;
+  }
 }
 
 // Manual appending, used at default format_msg
@@ -376,8 +1198,20 @@ LOGGER_INTERNAL inline void lgi_str_append_n(char** p, char* end, const char* s)
 {
   while (*s && *p < end) *(*p)++ = *s++;
 }
+LOGGER_INTERNAL inline void lgi_str_append_uint(char** p, char* end, unsigned long v)
+{
+  char digits[24];
+  int n = 0;
+  do {
+    digits[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  while (n > 0 && *p < end) *(*p)++ = digits[--n];
+}
 LOGGER_INTERNAL inline void lgi_str_close(char** p, char* end) {
-  if (*p < end) *(*p)++ = '\n';
+  // truncated lines still have to end with newline
+  if (*p >= end) *p = end - 1;
+  *(*p)++ = '\n';
   **p = '\0';
 }
 
@@ -390,6 +1224,14 @@ LOGGER_INTERNAL inline void lgi_str_close(char** p, char* end) {
   #define LG_STRUCT(T, ...) ((T){__VA_ARGS__})
 #endif
 
+#if defined(__cplusplus)
+  #define LOGGER_TLS thread_local
+#elif defined(_MSC_VER)
+  #define LOGGER_TLS __declspec(thread)
+#else
+  #define LOGGER_TLS _Thread_local
+#endif
+
 #ifdef LOGGER_DEBUG
 #define LG_DEBUG_ERR(fmt, ...)                          \
   do {                                                  \
@@ -406,17 +1248,67 @@ LOGGER_INTERNAL inline void lgi_str_close(char** p, char* end) {
 #define LG_DEBUG(fmt, ...)
 #endif // LOGGER_DEBUG
 
+/*
+  USDT probes (-DLOGGER_USDT), provider "logger", all arguments are 64-bit signed.
+  Same .note.stapsdt layout as <sys/sdt.h> writes so perf, bpftrace and gdb find them,
+  without needing systemtap's header. A probe is one nop, nothing at all without the flag
+*/
+#if defined(LOGGER_USDT) && defined(__linux__) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__aarch64__))
+#define LGI_HAS_USDT
+#ifdef __x86_64__
+#define LGI_USDT_OP "nor"
+#else
+#define LGI_USDT_OP "r"
+#endif
+#define LGI_USDT_NOTE(name, args)                                          \
+  "990: nop\n"                                                             \
+  ".pushsection .note.stapsdt,\"?\",\"note\"\n"                             \
+  ".balign 4\n"                                                            \
+  ".4byte 992f-991f, 994f-993f, 3\n"                                       \
+  "991: .asciz \"stapsdt\"\n"                                              \
+  "992: .balign 4\n"                                                       \
+  "993: .8byte 990b\n"                                                     \
+  ".8byte _.stapsdt.base\n"                                                \
+  ".8byte 0\n" /* no semaphore */                                          \
+  ".asciz \"logger\"\n"                                                    \
+  ".asciz \"" #name "\"\n"                                                 \
+  ".asciz \"" args "\"\n"                                                  \
+  "994: .balign 4\n"                                                       \
+  ".popsection\n"                                                          \
+  ".ifndef _.stapsdt.base\n"                                               \
+  ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"  \
+  ".weak _.stapsdt.base\n"                                                 \
+  ".hidden _.stapsdt.base\n"                                               \
+  "_.stapsdt.base: .space 1\n"                                             \
+  ".size _.stapsdt.base, 1\n"                                              \
+  ".popsection\n"                                                          \
+  ".endif\n"
+#define LGI_USDT_V(x) LGI_USDT_OP((int64_t)(x))
+#define LGI_PROBE1(name, a) \
+  __asm__ __volatile__(LGI_USDT_NOTE(name, "-8@%0") :: LGI_USDT_V(a))
+#define LGI_PROBE2(name, a, b) \
+  __asm__ __volatile__(LGI_USDT_NOTE(name, "-8@%0 -8@%1") :: LGI_USDT_V(a), LGI_USDT_V(b))
+#define LGI_PROBE3(name, a, b, c) \
+  __asm__ __volatile__(LGI_USDT_NOTE(name, "-8@%0 -8@%1 -8@%2") \
+                       :: LGI_USDT_V(a), LGI_USDT_V(b), LGI_USDT_V(c))
+#else
+// not evaluated, only keeps probe-only variables used
+#define LGI_PROBE1(name, a) ((void)sizeof(a))
+#define LGI_PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+#define LGI_PROBE3(name, a, b, c) ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#endif
+
 #ifdef _WIN32
 #include <direct.h>
 #include <windows.h>
 #include <malloc.h>
 #include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #define LOGGER_MKDIR(path) _mkdir(path)
 #define LOGGER_PATH_SEP '\\'
-#ifndef PATH_MAX
-#define PATH_MAX (MAX_PATH * 2)
-#endif
 
 struct iovec {
   void  *iov_base;
@@ -427,6 +1319,11 @@ struct iovec {
 typedef intptr_t ssize_t;
 #endif
 
+// drain of a signal handler, no signals to be safe from here
+static bool lgi_fd_write(FILE* f, const char* p, size_t n) {
+  return fwrite(p, 1, n, f) == n;
+}
+
 static ssize_t lgi_writev(FILE* f, const struct iovec *iov, int iovcnt) {
   ssize_t total = 0;
   for (size_t i = 0; i < (size_t)iovcnt; i++) {
@@ -440,6 +1337,39 @@ static ssize_t lgi_writev(FILE* f, const struct iovec *iov, int iovcnt) {
 // Sleep() has terrible resolution (milliseconds)
 // But who uses winbloat for production-ready logger?
 #define LOGGER_SLEEP(us) do { Sleep(1); } while (0)
+#define LOGGER_YIELD() SwitchToThread()
+
+// LgFile backend, no direct I/O or page cache advice here
+#define LGI_FD_OPEN(path) \
+  _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE)
+#define LGI_FD_CLOSE(fd) _close(fd)
+#define LGI_FD_SYNC(fd) _commit(fd)
+
+static ssize_t lgi_pwrite(int fd, const void* buf, size_t n, uint64_t off) {
+  if (_lseeki64(fd, (__int64)off, SEEK_SET) < 0) return -1;
+  return _write(fd, buf, (unsigned int)n);
+}
+
+static uint64_t lgi_now_ms(void) {
+  return (uint64_t)GetTickCount64();
+}
+
+// wall clock in ns since epoch, FILETIME is 100ns since 1601
+static uint64_t lgi_clock_ns(bool precise) {
+  FILETIME ft;
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+  if (precise) GetSystemTimePreciseAsFileTime(&ft);
+  else GetSystemTimeAsFileTime(&ft);
+#else
+  LG_UNUSED(precise);
+  GetSystemTimeAsFileTime(&ft);
+#endif
+  uint64_t t = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+  return (t - 116444736000000000ULL) * 100u;
+}
+
+#define LGI_LOCALTIME(t, tm) localtime_s(tm, t)
+#define LGI_GMTIME(t, tm) gmtime_s(tm, t)
 
 typedef HANDLE pthread_t;
 static DWORD WINAPI lgi_thread_trampoline(LPVOID arg)
@@ -484,31 +1414,170 @@ static int pthread_create(pthread_t* t, void* attr,
   return 0;
 }
 
+// parking spot of idle pool threads
+typedef struct {
+  SRWLOCK lock;
+  CONDITION_VARIABLE cv;
+} LgPark;
+
+static void lgi_park_init(LgPark* p) {
+  InitializeSRWLock(&p->lock);
+  InitializeConditionVariable(&p->cv);
+}
+static void lgi_park_free(LgPark* p) { LG_UNUSED(p); }
+static void lgi_park_lock(LgPark* p) { AcquireSRWLockExclusive(&p->lock); }
+static void lgi_park_unlock(LgPark* p) { ReleaseSRWLockExclusive(&p->lock); }
+static void lgi_park_wake_all(LgPark* p) { WakeAllConditionVariable(&p->cv); }
+
+// false on timeout
+static bool lgi_park_wait(LgPark* p, unsigned int ms) {
+  return SleepConditionVariableSRW(&p->cv, &p->lock, ms, 0) != 0;
+}
+
 #else // POSIX:
 #include <time.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/uio.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <unistd.h>
 
+// writer placement needs GNU ones, they're hidden if sched.h came before us
+#if defined(__linux__) && defined(CPU_SET)
+#define LGI_HAS_AFFINITY
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#define LGI_MPOL_PREFERRED 1     // linux/mempolicy.h
+#define LGI_MPOL_MF_MOVE (1 << 1)
+#endif
+
+// shared ring, memfd_create is GNU one too
+#ifdef __linux__
+#include <sys/mman.h>
+#if defined(MFD_CLOEXEC)
+#define LGI_HAS_SHM
+#endif
+#endif
+
 static ssize_t lgi_writev(FILE* f, const struct iovec *iov, int iovcnt) {
   return writev(fileno(f), iov, iovcnt);
 }
 
-// sleep for us microseconds
-#define LOGGER_SLEEP(us)                                                \
-  do {                                                                  \
-    struct timespec ts = {(us) / 1000000L, ((us) % 1000000L) * 1000L};  \
-    nanosleep(&ts, NULL);                                               \
-  } while (0)
-#define LOGGER_MKDIR(path) mkdir(path, 0755)
-#define LOGGER_PATH_SEP '/'
+// plain write(2), drain of a signal handler uses it
+static bool lgi_fd_write(FILE* f, const char* p, size_t n) {
+  int fd = fileno(f);
+  while (n > 0) {
+    ssize_t w = write(fd, p, n);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return false;
+    p += w;
+    n -= (size_t)w;
+  }
+  return true;
+}
+
+/*
+  Retention manifest, freshness check needs ns mtimes and utimensat
+  (POSIX 2008), without them the dir is scanned every time
+*/
+#if defined(UTIME_OMIT) && defined(AT_FDCWD)
+#define LGI_HAS_MANIFEST
+#ifdef __APPLE__
+#define LGI_ST_MTIM(st) ((st).st_mtimespec)
+#else
+#define LGI_ST_MTIM(st) ((st).st_mtim)
+#endif
 #endif
 
-#ifdef _MSC_VER
-  #include <intrin.h>
+#define LGI_FD_OPEN(path) open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)
+#define LGI_FD_CLOSE(fd) close(fd)
+#ifdef __APPLE__
+#define LGI_FD_SYNC(fd) fsync(fd) // fdatasync is not public on macOS
+#else
+#define LGI_FD_SYNC(fd) fdatasync(fd)
+#endif
+
+#if defined(__APPLE__) || (defined(_POSIX_VERSION) && _POSIX_VERSION >= 200809L)
+#define lgi_pwrite(fd, buf, n, off) pwrite(fd, buf, n, (off_t)(off))
+#else
+// pwrite isn't declared on this feature level (strict -std=c11 for example)
+static ssize_t lgi_pwrite(int fd, const void* buf, size_t n, uint64_t off) {
+  if (lseek(fd, (off_t)off, SEEK_SET) < 0) return -1;
+  return write(fd, buf, n);
+}
+#endif
+
+static uint64_t lgi_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000u + (uint64_t)(ts.tv_nsec / 1000000L);
+}
+
+// wall clock in ns since epoch
+static uint64_t lgi_clock_ns(bool precise) {
+  struct timespec ts;
+  clockid_t id = CLOCK_REALTIME;
+#if defined(CLOCK_REALTIME_COARSE) && !defined(LOGGER_GET_REAL_TIME)
+  // coarse one is much cheaper and enough for milliseconds (Linux only)
+  if (!precise) id = CLOCK_REALTIME_COARSE;
+#else
+  LG_UNUSED(precise);
+#endif
+  clock_gettime(id, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+#define LGI_LOCALTIME(t, tm) localtime_r(t, tm)
+#define LGI_GMTIME(t, tm) gmtime_r(t, tm)
+
+// sleep for us microseconds
+#define LOGGER_SLEEP(us)                                                \
+  do {                                                                  \
+    struct timespec ts = {(us) / 1000000L, ((us) % 1000000L) * 1000L};  \
+    nanosleep(&ts, NULL);                                               \
+  } while (0)
+#define LOGGER_YIELD() sched_yield()
+#define LOGGER_MKDIR(path) mkdir(path, 0755)
+
+// parking spot of idle pool threads
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cv;
+} LgPark;
+
+static void lgi_park_init(LgPark* p) {
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->cv, NULL);
+}
+static void lgi_park_free(LgPark* p) {
+  pthread_cond_destroy(&p->cv);
+  pthread_mutex_destroy(&p->lock);
+}
+static void lgi_park_lock(LgPark* p) { pthread_mutex_lock(&p->lock); }
+static void lgi_park_unlock(LgPark* p) { pthread_mutex_unlock(&p->lock); }
+static void lgi_park_wake_all(LgPark* p) { pthread_cond_broadcast(&p->cv); }
+
+// false on timeout
+static bool lgi_park_wait(LgPark* p, unsigned int ms) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += ms / 1000;
+  ts.tv_nsec += (long)(ms % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+  return pthread_cond_timedwait(&p->cv, &p->lock, &ts) == 0;
+}
+#define LOGGER_PATH_SEP '/'
+#endif
+
+#ifdef _MSC_VER
+  #include <intrin.h>
   #if defined(_M_X64) || defined(_M_IX86)
     #define LOGGER_PAUSE_INS() _mm_pause() // MSVC X86/X64 intrinsic
   #elif defined(_M_ARM64)
@@ -526,6 +1595,122 @@ static ssize_t lgi_writev(FILE* f, const struct iovec *iov, int iovcnt) {
   #endif
 #endif
 
+/*
+  Call site states, LgCallSite is in the public header (C89 too)
+  so it can't be _Atomic, these work on its plain long
+*/
+#define LGI_SITE_NEW 0
+#define LGI_SITE_BUSY 1
+#define LGI_SITE_READY 2
+
+#ifdef _MSC_VER
+LOGGER_INTERNAL inline long lgi_long_load(volatile long* p) {
+  return _InterlockedOr(p, 0);
+}
+LOGGER_INTERNAL inline void lgi_long_store(volatile long* p, long v) {
+  _InterlockedExchange(p, v);
+}
+LOGGER_INTERNAL inline bool lgi_long_cas(volatile long* p, long expected, long desired) {
+  return _InterlockedCompareExchange(p, desired, expected) == expected;
+}
+#else
+LOGGER_INTERNAL inline long lgi_long_load(volatile long* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+LOGGER_INTERNAL inline void lgi_long_store(volatile long* p, long v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+LOGGER_INTERNAL inline bool lgi_long_cas(volatile long* p, long expected, long desired) {
+  return __atomic_compare_exchange_n(p, &expected, desired, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#endif
+
+// iovecs of one writev, POSIX guarantees 16 of them
+#if LOGGER_IOV_MAX > 0
+  #define LGI_IOV_LIMIT LOGGER_IOV_MAX
+#elif defined(IOV_MAX)
+  #define LGI_IOV_LIMIT IOV_MAX
+#elif defined(UIO_MAXIOV)
+  #define LGI_IOV_LIMIT UIO_MAXIOV
+#else
+  #define LGI_IOV_LIMIT 16
+#endif
+#define LGI_IOV_CHUNK (LGI_IOV_LIMIT < LOGGER_MAX_BATCH ? LGI_IOV_LIMIT : LOGGER_MAX_BATCH)
+
+LOGGER_INTERNAL ssize_t lgi_file_writev(LgFile* f, const struct iovec* iov, int iovcnt);
+
+// Batch states for the format -> write hand-off
+#define LGI_BATCH_FREE 0
+#define LGI_BATCH_READY 1
+#define LGI_BATCH_BUSY 2 // popped, a format worker is formatting it
+
+// Amount of batch buffers (double buffering)
+#define LOGGER_PIPE_DEPTH 2
+
+/*
+  Category of an instance, own_* ones are set explicitly and
+  levels/sinks are the resolved ones that log path reads
+*/
+struct LgCategory {
+  Logger* inst;
+  struct LgCategory* parent;
+  char name[LOGGER_CATEGORY_NAME_SIZE];
+  bool own_levels;
+  bool own_sinks;
+  uint32_t levels_set;
+  uint32_t sinks_set;
+  ATOMIC(uint32_t) levels; // accepted LOGGER_LEVEL_BIT set
+  ATOMIC(uint32_t) sinks;  // of LgSinkTable.bits
+};
+
+// piece of an out buffer that goes to a sink as one iovec
+typedef struct {
+  uint32_t off;
+  uint32_t len;
+} LgRun;
+
+// formatted lines of one out type back to back
+typedef struct {
+  char* data;
+  size_t len;
+  size_t cap; // kept for the next batches
+} LgOutBuf;
+
+/*
+  Formatted batch, formatter stage fills it and writer stage
+  flushes it to the sinks. Lives in the instance, not on the stack
+*/
+struct LgBatch {
+  LOGGER_ALIGN ATOMIC(int) state;
+  size_t count;
+  LgSinkTable* sinks; // sink table which was active at format time
+  int run_counts[LOGGER_MAX_SINKS + 1];
+  LgRun runs[LOGGER_MAX_SINKS + 1][LOGGER_MAX_BATCH]; // per sink, adjacent lines are merged
+  int idx_sink; // sink of the indexed file, -1 = none
+  int idx_count;
+  LgIdxLine idx_lines[LOGGER_MAX_BATCH]; // lines of idx_sink
+  int src; // ring (0) or lane (1) it's popped from, -1 = neither
+  size_t end; // position after its last slot
+  size_t spills; // spilled messages it finishes (written or lost)
+  LogQueue* q; // popped slots from start, released once formatted (NULL = none)
+  size_t start;
+  LgTimeCache tc; // of whoever formats it, one thread at a time
+  LgOutBuf out[LOGGER_MAX_OUT_TYPES];
+  LgMsgPack pack; // formatter writes here, it's copied to out
+};
+
+typedef struct {
+  LgFlushTicket ticket;
+  lg_flush_cb cb;
+  void* arg;
+} LgFlushCb;
+
+// producers of the threads using it that are between claim and publish
+typedef struct {
+  LOGGER_ALIGN ATOMIC(long) n;
+} LgInflight;
+
 /*
   Instance struct, tracks the context of the instance
   DO NOT touch anything by yourself, these can be changed
@@ -537,44 +1722,262 @@ struct Logger {
   bool generateDefaultFile;
   LgLogPolicy logPolicy;
   int maxLogFiles; // non-positive = unlimited
-  LgSink  sinks[LOGGER_MAX_SINKS + 1];
-  size_t  sinks_count;
+  LOGGER_ALIGN ATOMIC(LgSinkTable*) sinks; // latest published table
+  LgSinkTable* sinks_cur; // table of the last written batch (writer only)
+  ATOMIC(bool) sinks_lock; // serializes updaters, writer never takes it
   log_formatter_t customLogFunc;
-  uint32_t out_needed; // needed file flags for formatter
   pthread_t writer_th;
+  bool pipelined;
+  pthread_t io_th; // only when pipelined
+  pthread_t retention_th; // lg_destroy joins it, it may be rewriting the manifest
+  bool retention_on;
+  LOGGER_ALIGN ATOMIC(bool) pipe_done;
+  size_t fmt_seq; // batches taken so far, pipe[fmt_seq % pipe_depth] is the next
+  size_t batch_cap[2]; // slots the next pop of ring/lane takes at most
   LOGGER_ALIGN LogQueue queue;
-#ifdef _POSIX_VERSION
-  time_t cached_sec;
-  struct tm cached_tm;
-#endif
+  LogQueue* ring; // queue or the shared one
+  LogQueue* lane; // priority lane, NULL = no lane
+  uint32_t lane_levels; // levels that go to the lane
+  LgThreadOptions thread_opts; // cpus is parsed into cpu_mask
+  bool has_cpus;
+  unsigned long cpu_mask[LOGGER_CPU_WORDS];
+  LgBatch batches[LOGGER_PIPE_DEPTH];
+  LgBatch* pipe; // batches or reorder buffer of the format workers
+  size_t pipe_depth;
+  int fmt_workers; // consumer threads, writer_th and fmt_th[1..]
+  pthread_t fmt_th[LOGGER_MAX_FORMAT_WORKERS];
+  ATOMIC(int) fmt_running; // last one out lets I/O thread go
+  LgTimeStyle timeStyle;
+  LgTimePrecision timePrecision;
+  bool logCallSite;
+  ATOMIC(bool) cat_lock; // creation and setting changes, log path never takes it
+  size_t cat_count;
+  LgCategory categories[LOGGER_MAX_CATEGORIES];
+  LgWriterPool* pool; // NULL = own writer thread
+  ATOMIC(bool) pool_busy; // a pool thread is consuming it
+  ATOMIC(bool) spilling; // LG_SPILL: messages go to spill until it's replayed
+  LOGGER_ALIGN ATOMIC(LgSpillNode*) spill_head; // pushed, not spilled yet
+  ATOMIC(size_t) spill_queued; // reserved nodes that aren't in the file yet
+  size_t spill_max; // spill_queued limit
+  FILE* spill_file; // writer only
+  size_t spill_rd;
+  size_t spill_wr;
+  LgDrops own_drops;
+  LgDrops* drops; // own_drops or the shared ones
+  LgIndex* idx; // NULL = no sidecar index
+  LgShm* shm; // NULL = own ring
+  int shm_fd;
+  long shm_pid; // writer's process, the others only produce
+  LgStall stalls[2]; // ring and lane
+  LOGGER_ALIGN ATOMIC(bool) consuming; // writer or a signal drain has the rings
+  size_t spill_recs; // in spill file, not replayed (writer only)
+  size_t spill_lost; // lost since the last batch (writer only)
+  size_t spill_taken; // replayed or lost ones, in push order (writer only)
+  LOGGER_ALIGN ATOMIC(size_t) written[2]; // ring and lane positions written
+  ATOMIC(size_t) spill_written;
+  LOGGER_ALIGN ATOMIC(size_t) spill_pushed;
+  LOGGER_ALIGN ATOMIC(int) flush_waiters; // writer checks it after batches
+  LgPark flush_park; // waiters and callbacks are under its lock
+  size_t flush_cb_count;
+  LgFlushCb flush_cbs[LOGGER_MAX_FLUSH_CALLBACKS];
+  LgInflight inflight[LOGGER_INFLIGHT_SLOTS]; // lg_destroy waits them out
+};
+
+typedef struct {
+  LgWriterPool* pool;
+  pthread_t th;
+  size_t cursor; // round-robin position
+} LgWorker;
+
+struct LgWriterPool {
+  LOGGER_ALIGN ATOMIC(bool) alive;
+  ATOMIC(bool) lock; // instance slots
+  size_t count;
+  size_t hi; // used slots are below it
+  Logger* insts[LOGGER_POOL_MAX_INSTANCES];
+  LOGGER_ALIGN ATOMIC(int) parked; // producers check it
+  LgPark park;
+  unsigned long wake_gen; // under park lock
+  int thread_count;
+  LgWorker workers[LOGGER_POOL_MAX_THREADS];
 };
 
+// producer of a shared ring that isn't the writer's process
+#define LGI_SHM_FOREIGN(inst) \
+  ((inst)->shm && (inst)->shm_pid != atomic_load_explicit(&lgi_pid, memory_order_relaxed))
+
+// priority lane gets its levels (no lane = no levels), main ring the rest
+LOGGER_INTERNAL inline LogQueue* lgi_queue_of(Logger* inst, LgLogLevel level)
+{
+  return (inst->lane_levels & LOGGER_LEVEL_BIT(level)) ? inst->lane : inst->ring;
+}
+
+/*
+  One step of the consumer: pops and formats a batch then
+  writes it directly or hands it to I/O thread if pipelined.
+  A ring batch of parallel format workers is only popped, it's
+  returned in popped to be formatted once the rings are let go
+*/
+LOGGER_INTERNAL bool lgi_consume_batch(Logger* inst, LgBatch** popped)
+{
+  LgBatch* b = &inst->pipe[inst->fmt_seq % inst->pipe_depth];
+  if (inst->pipelined) {
+    // wait until I/O thread gives this buffer back
+    int spins = 0;
+    while (atomic_load_explicit(&b->state, memory_order_acquire) != LGI_BATCH_FREE)
+      lgi_handoff_wait(&spins);
+  }
+
+  // pushed spill nodes go to the file as they come, not only once the ring is empty
+  if (atomic_load_explicit(&inst->spill_head, memory_order_relaxed)) lgi_spill_flush(inst);
+
+  // gap record once its position is passed, then the lane, the ring and spilled ones once the ring is empty
+  if (!lgi_drop_batch(inst, b) &&
+      !(inst->lane && lgi_queue_pop_into(inst, inst->lane, b)) &&
+      !lgi_queue_pop_into(inst, inst->ring, b) &&
+      !lgi_spill_batch(inst, b)) {
+    if (inst->shm) {
+      lgi_shm_reap(inst, inst->ring, &inst->stalls[0]);
+      if (inst->lane) lgi_shm_reap(inst, inst->lane, &inst->stalls[1]);
+    }
+    // idle, good time to pick up the sink changes
+    // (pipelined one does it on I/O thread when next batch comes)
+    if (!inst->pipelined) {
+      LgSinkTable* t = atomic_load_explicit(&inst->sinks, memory_order_acquire);
+      if (t != inst->sinks_cur) lgi_sinks_retire(inst, t);
+      lgi_sinks_tick(inst->sinks_cur);
+    }
+    return false;
+  }
+
+  if (b->q && inst->fmt_workers > 1) {
+    atomic_store_explicit(&b->state, LGI_BATCH_BUSY, memory_order_relaxed);
+    *popped = b;
+  } else if (b->q) {
+    lgi_batch_format(inst, b);
+  }
+
+  if (inst->pipelined) {
+    // its turn in the write order is taken even if it's not formatted yet
+    if (!*popped) atomic_store_explicit(&b->state, LGI_BATCH_READY, memory_order_release);
+    inst->fmt_seq++;
+  } else {
+    lgi_batch_write(inst, b);
+  }
+  return true;
+}
+
+// signal handler's drain may have the rings, it's writer's work too
+LOGGER_INTERNAL bool lgi_consume(Logger* inst)
+{
+  if (atomic_exchange_explicit(&inst->consuming, true, memory_order_acquire)) return false;
+  LgBatch* popped = NULL;
+  bool busy = lgi_consume_batch(inst, &popped);
+  atomic_store_explicit(&inst->consuming, false, memory_order_release);
+
+  // the other workers take the next batches meanwhile
+  if (popped) {
+    lgi_batch_format(inst, popped);
+    atomic_store_explicit(&popped->state, LGI_BATCH_READY, memory_order_release);
+  }
+  return busy;
+}
+
 // consumer func, writes entries on the ring to stdout or file
 LOGGER_INTERNAL void* lgi_consumer(void* arg) {
   Logger* inst = (Logger*)arg;
-  int spins = 0;
-  size_t start_pos = 0;
+  lgi_thread_setup(inst, true);
+  return lgi_consume_loop(inst);
+}
+
+// other parallel format workers, the writer placed the rings already
+LOGGER_INTERNAL void* lgi_fmt_worker(void* arg) {
+  Logger* inst = (Logger*)arg;
+  lgi_thread_setup(inst, false);
+  return lgi_consume_loop(inst);
+}
 
-  while (atomic_load_explicit(&inst->isAlive, memory_order_acquire)) {
-    if (lgi_queue_ppr_batch(inst, &start_pos)) spins = 0;
-    else lgi_adaptive_wait(&spins);
+LOGGER_INTERNAL void* lgi_consume_loop(Logger* inst) {
+  int spins = 0;
+  bool parked = false; // sleeping between polls (park/wake probes)
+
+  // blocked producers that got in before lg_destroy need us to make room
+  while (atomic_load_explicit(&inst->isAlive, memory_order_seq_cst) || lgi_inflight(inst) > 0) {
+    if (lgi_consume(inst)) {
+      if (parked) LGI_PROBE1(wake, inst);
+      parked = false;
+      spins = 0;
+      continue;
+    }
+    lgi_sites_poll();
+    lgi_adaptive_wait(&spins);
+    if (!parked && spins >= LOGGER_WAIT_PAUSE_MAGIC) LGI_PROBE1(park, inst);
+    parked = spins >= LOGGER_WAIT_PAUSE_MAGIC;
   }
 
-  while (lgi_queue_ppr_batch(inst, &start_pos))
+  while (lgi_consume(inst))
     ;; // drain loop
 
+  // last worker lets I/O thread know that there won't be any batch anymore
+  if (atomic_fetch_sub_explicit(&inst->fmt_running, 1, memory_order_seq_cst) == 1) {
+    while (lgi_consume(inst))
+      ;; // the others may have left while one of them had the rings
+    atomic_store_explicit(&inst->pipe_done, true, memory_order_release);
+  }
   LG_DEBUG("Writer thread is exiting");
   return NULL;
 }
 
+// second stage of pipelined writer, writes formatted batches in order
+LOGGER_INTERNAL void* lgi_io_worker(void* arg) {
+  Logger* inst = (Logger*)arg;
+  int spins = 0;
+  size_t idx = 0;
+  lgi_thread_setup(inst, false);
+
+  for (;;) {
+    LgBatch* b = &inst->pipe[idx % inst->pipe_depth];
+    if (atomic_load_explicit(&b->state, memory_order_acquire) == LGI_BATCH_READY) {
+      lgi_batch_write(inst, b);
+      atomic_store_explicit(&b->state, LGI_BATCH_FREE, memory_order_release);
+      idx++;
+      spins = 0;
+      continue;
+    }
+    // batches are handed in order, nothing ready here means nothing left
+    if (atomic_load_explicit(&inst->pipe_done, memory_order_acquire) &&
+        atomic_load_explicit(&b->state, memory_order_acquire) != LGI_BATCH_READY)
+      break;
+    lgi_sinks_tick(inst->sinks_cur);
+    lgi_adaptive_wait(&spins);
+  }
+
+  LG_DEBUG("I/O thread is exiting");
+  return NULL;
+}
+
 LOGGER_INTERNAL ATOMIC(Logger*) active_instance = NULL;
+LOGGER_INTERNAL ATOMIC(LgCallSite*) lgi_call_sites = NULL; // registry, push only
+// site rules, registration and rule changes are serialized by the lock
+LOGGER_INTERNAL ATOMIC(bool) lgi_site_rules_lock = false;
+LOGGER_INTERNAL LgSiteRule lgi_site_rules[LOGGER_MAX_SITE_RULES];
+LOGGER_INTERNAL size_t lgi_site_rules_count = 0;
+// control file reload request of lg_sites_watch
+LOGGER_INTERNAL ATOMIC(bool) lgi_sites_reload = false;
+LOGGER_INTERNAL ATOMIC(bool) lgi_retention_lock = false; // jobs of one dir would race
+// this process (for shared rings), renewed in fork's child
+LOGGER_INTERNAL ATOMIC(long) lgi_pid = 0;
+LOGGER_INTERNAL char lgi_sites_path[PATH_MAX];
+LOGGER_INTERNAL LOGGER_TLS LgFmtContext lgi_fmt_ctx;
+LOGGER_INTERNAL LOGGER_TLS int lgi_inflight_slot = -1; // this thread's LgInflight
+LOGGER_INTERNAL ATOMIC(unsigned int) lgi_inflight_next = 0;
 
 int lg_init_flat(Logger* inst, const char* logs_dir,
                 int local_time, int max_log_files, int generateDefaultFile,
                 LgSinks sinks, LgLogPolicy log_policy,
                 log_formatter_t log_formatter)
 {
-  LoggerConfig cfg;
+  LoggerConfig cfg = lg_get_defaults();
   cfg.localTime = local_time;
   cfg.maxFiles = max_log_files;
   cfg.generateDefaultFile = generateDefaultFile;
@@ -594,15 +1997,43 @@ int lg_init(Logger* inst, const char* logs_dir, LoggerConfig config)
   // freaking c++
   size_t is_gen_def_file = 0;
   size_t scnt = 0;
-  uint32_t needed = 0;
   Logger* expected = NULL;
-  FILE* logFile;
-
-  if (!inst || !logs_dir) goto fail;
+  LgSinkTable* table;
+  FILE* logFile = NULL;
+  LgFile* logHandle = NULL;
+  FILE* idxFile = NULL;
+  LgRetention* ret = NULL;
+  LgFileOptions fopts = config.fileOptions;
+  int workers = 1; // started format workers, writer thread is the first
+
+  if (!inst || !logs_dir) return false;
+  lgi_park_init(&inst->flush_park); // lives until lg_destroy
   if (config.sinks.count > LOGGER_MAX_SINKS) {
     LG_DEBUG_ERR("Max amount of file sinks can be " LG_STRINGIFY(LOGGER_MAX_SINKS));
     goto fail;
   }
+  if ((unsigned)config.timeStyle > LG_TIME_EPOCH ||
+      (unsigned)config.timePrecision > LG_TIME_NS) {
+    LG_DEBUG_ERR("Invalid time style or precision!");
+    goto fail;
+  }
+  if ((unsigned)config.writerOptions.sched > LG_SCHED_RR ||
+      (unsigned)config.writerOptions.ringPlacement > LG_RING_NODE ||
+      config.writerOptions.ringNode < 0) {
+    LG_DEBUG_ERR("Invalid writer options!");
+    goto fail;
+  }
+  if (config.sharedRing && (config.logPolicy == LG_SPILL || config.writerPool)) {
+    LG_DEBUG_ERR("Shared ring can't spill or use a writer pool!");
+    goto fail;
+  }
+  inst->has_cpus = config.writerOptions.cpus != NULL;
+  if (inst->has_cpus && !lgi_parse_cpus(config.writerOptions.cpus, inst->cpu_mask)) {
+    LG_DEBUG_ERR("Invalid writer CPU list: %s", config.writerOptions.cpus);
+    goto fail;
+  }
+  inst->thread_opts = config.writerOptions;
+  inst->thread_opts.cpus = NULL; // caller's string, we have the mask
 
   is_gen_def_file = config.generateDefaultFile != 0;
   inst->isLocalTime = config.localTime != 0;
@@ -610,9 +2041,35 @@ int lg_init(Logger* inst, const char* logs_dir, LoggerConfig config)
   inst->generateDefaultFile = is_gen_def_file;
   inst->logPolicy = config.logPolicy;
   inst->customLogFunc = config.logFormatter;
-#ifdef _POSIX_VERSION
-  inst->cached_sec = 0;
-#endif
+  inst->timeStyle = config.timeStyle;
+  inst->timePrecision = config.timePrecision;
+  inst->logCallSite = config.logCallSite != 0;
+  inst->cat_count = 0; // old handles die with lg_destroy
+  inst->lane = NULL;
+  inst->lane_levels = 0;
+  atomic_store_explicit(&inst->spilling, false, memory_order_relaxed);
+  atomic_store_explicit(&inst->spill_head, (LgSpillNode*)NULL, memory_order_relaxed);
+  inst->spill_file = NULL;
+  inst->spill_rd = inst->spill_wr = 0;
+  lgi_drops_init(&inst->own_drops);
+  inst->drops = &inst->own_drops;
+  atomic_store_explicit(&inst->cat_lock, false, memory_order_relaxed);
+  inst->idx = NULL;
+  inst->ring = &inst->queue;
+  inst->shm = NULL;
+  inst->shm_fd = -1;
+  memset(inst->stalls, 0, sizeof(inst->stalls));
+  atomic_store_explicit(&inst->consuming, false, memory_order_relaxed);
+  inst->spill_recs = inst->spill_lost = inst->spill_taken = 0;
+  atomic_store_explicit(&inst->written[0], 0, memory_order_relaxed);
+  atomic_store_explicit(&inst->written[1], 0, memory_order_relaxed);
+  atomic_store_explicit(&inst->spill_written, 0, memory_order_relaxed);
+  atomic_store_explicit(&inst->spill_pushed, 0, memory_order_relaxed);
+  atomic_store_explicit(&inst->spill_queued, 0, memory_order_relaxed);
+  atomic_store_explicit(&inst->flush_waiters, 0, memory_order_relaxed);
+  inst->flush_cb_count = 0;
+  inst->retention_on = false;
+  lgi_inflight_reset(inst);
 
   if (is_gen_def_file) {
     char dir[PATH_MAX];
@@ -634,506 +2091,2368 @@ int lg_init(Logger* inst, const char* logs_dir, LoggerConfig config)
         LG_DEBUG_ERR("Cannot create provided path: %s", dir);
         goto fail;
       }
-    } else {
-      if (config.maxFiles > 0) {
-        // get .log files in that logs folder
-        char oldestFile[PATH_MAX];
-        int files = lgi_count_logs_and_get_oldest(dir, oldestFile, sizeof(oldestFile));
-        if (files < 0) goto fail;
-
-        // Remove the oldest file when max files are exceeded
-        if (config.maxFiles > 0 && files >= config.maxFiles) {
-          remove(oldestFile);
-        }
+    }
+
+    // retention runs in background, dir's mtime tells if its manifest is fresh
+    if (config.maxFiles > 0 || config.maxTotalBytes > 0 || config.maxAgeSecs > 0) {
+      ret = (LgRetention*)calloc(1, sizeof(LgRetention));
+      if (!ret) {
+        LG_DEBUG_ERR("Cannot allocate retention job!");
+        goto fail;
       }
+      strcpy(ret->dir, dir);
+      ret->max_files = config.maxFiles;
+      ret->max_bytes = config.maxTotalBytes;
+      ret->max_age = config.maxAgeSecs;
+#ifdef LGI_HAS_MANIFEST
+      struct stat dst;
+      if (stat(dir, &dst) == 0) {
+        ret->dir_known = true;
+        ret->dir_sec = (int64_t)LGI_ST_MTIM(dst).tv_sec;
+        ret->dir_nsec = (long)LGI_ST_MTIM(dst).tv_nsec;
+      }
+#endif
     }
 
-    // get time str and length
+    // file names keep the default style, ISO one has ':' in it
     char time_str[LOGGER_TIME_STR_SIZE];
-    if (!lg_get_time_str(inst, time_str)) goto fail;
+    LgTimeCache tc;
+    tc.valid = false;
+    lgi_time_render(&tc, lgi_clock_ns(false), LG_TIME_DEFAULT, LG_TIME_MS,
+                    inst->isLocalTime, time_str);
 
     // produce file path with a fixed size
     char file_path[PATH_MAX];
     int n = snprintf(file_path, sizeof(file_path),
                      "%s%s" LOGGER_FILE_EXT, dir, time_str);
     if (n <= 0 || (size_t)n >= sizeof(file_path)) goto fail;
+    if (ret) snprintf(ret->name, sizeof(ret->name), "%s" LOGGER_FILE_EXT, time_str);
 
-    // open file in write binary mode
-    logFile = fopen(file_path, "wb");
-    if (!logFile) {
+    // open file in write binary mode, staged one if there's any option
+    if (fopts.directIO || fopts.dropCache || fopts.sync != LG_SYNC_NONE)
+      logHandle = lg_file_open(file_path, fopts);
+    else
+      logFile = fopen(file_path, "wb");
+    if (!logFile && !logHandle) {
       LG_DEBUG_ERR("Cannot open the log file: %s", file_path);
       goto fail;
     }
-  } else logFile = NULL;
 
-  lgi_queue_create(&inst->queue);
+    if (config.indexFile) {
+      char idx_path[PATH_MAX];
+      n = snprintf(idx_path, sizeof(idx_path), "%s" LOGGER_IDX_EXT, file_path);
+      if (n <= 0 || (size_t)n >= sizeof(idx_path)) goto fail_table;
+      LgIdxHeader hdr;
+      memset(&hdr, 0, sizeof(hdr));
+      memcpy(hdr.magic, LGI_IDX_MAGIC, sizeof(hdr.magic));
+      hdr.block_size = LOGGER_IDX_BLOCK_SIZE;
+      hdr.bloom_bits = LOGGER_IDX_BLOOM_BITS;
+      hdr.time_style = (uint32_t)inst->timeStyle;
+      hdr.local_time = inst->isLocalTime;
+      hdr.def_format = config.logFormatter == NULL;
+      idxFile = fopen(idx_path, "wb");
+      inst->idx = (LgIndex*)calloc(1, sizeof(LgIndex));
+      if (!idxFile || !inst->idx || fwrite(&hdr, sizeof(hdr), 1, idxFile) != 1 ||
+          fflush(idxFile) != 0) {
+        LG_DEBUG_ERR("Cannot create the index file: %s", idx_path);
+        goto fail_table;
+      }
+      inst->idx->out = idxFile;
+      inst->idx->file = logFile;
+      inst->idx->handle = logHandle;
+    }
+  }
+
+  if (config.priorityLane) inst->lane_levels = lgi_level_bits(config.priorityLevel, 0);
+  if (config.sharedRing) {
+    // lane lives in the mapping too
+    if (!lgi_shm_map(inst, -1)) goto fail_table;
+  } else {
+    lgi_queue_create(&inst->queue);
+    if (config.priorityLane) {
+      inst->lane = (LogQueue*)calloc(1, sizeof(LogQueue));
+      if (!inst->lane) {
+        LG_DEBUG_ERR("Cannot allocate priority lane!");
+        goto fail_table;
+      }
+      lgi_queue_create(inst->lane);
+    }
+  }
 
   scnt = config.sinks.count;
-  memcpy(inst->sinks, config.sinks.items, scnt * sizeof(LgSink));
-  inst->sinks_count = is_gen_def_file + scnt;
+  table = lgi_sink_table_new(NULL, NULL);
+  if (!table) {
+    LG_DEBUG_ERR("Cannot allocate sink table!");
+    goto fail_table;
+  }
+  for (size_t i = 0; i < scnt; i++) lgi_sink_table_add(table, config.sinks.items[i]);
   if (is_gen_def_file) {
-    inst->sinks[scnt] = LG_STRUCT(LgSink, logFile, LG_OUT_FILE);
+    lgi_sink_table_add(table, LG_STRUCT(LgSink, logFile, LG_OUT_FILE, LG_INFO, 0, logHandle));
   }
+  inst->sinks_cur = table;
+  atomic_store_explicit(&inst->sinks, table, memory_order_relaxed);
+  atomic_store_explicit(&inst->sinks_lock, false, memory_order_relaxed);
+
+  inst->pool = config.writerPool;
+  inst->spill_max = config.spillMaxQueued ? config.spillMaxQueued : LOGGER_SPILL_MAX_QUEUED;
+  inst->fmt_workers = 1;
+  if (config.formatWorkers > 1 && !inst->pool)
+    inst->fmt_workers = config.formatWorkers < LOGGER_MAX_FORMAT_WORKERS
+                        ? config.formatWorkers : LOGGER_MAX_FORMAT_WORKERS;
+  inst->pipelined = (config.pipelineWrites != 0 || inst->fmt_workers > 1) && !inst->pool;
+  inst->pipe = inst->batches;
+  inst->pipe_depth = LOGGER_PIPE_DEPTH;
+  if (inst->fmt_workers > 1) {
+    // a batch per worker and as many formatted ones waiting for I/O thread
+    inst->pipe = (LgBatch*)calloc(2 * (size_t)inst->fmt_workers, sizeof(LgBatch));
+    if (!inst->pipe) {
+      LG_DEBUG_ERR("Cannot allocate the reorder buffer!");
+      inst->pipe = inst->batches;
+      goto fail_io_thread;
+    }
+    inst->pipe_depth = 2 * (size_t)inst->fmt_workers;
+  }
+  inst->fmt_seq = 0;
+  inst->batch_cap[0] = inst->batch_cap[1] = LOGGER_MIN_BATCH;
+  for (size_t i = 0; i < inst->pipe_depth; i++) {
+    atomic_store_explicit(&inst->pipe[i].state, LGI_BATCH_FREE, memory_order_relaxed);
+    inst->pipe[i].q = NULL;
+    inst->pipe[i].tc.valid = false;
+  }
+  atomic_store_explicit(&inst->pipe_done, false, memory_order_relaxed);
+  atomic_store_explicit(&inst->fmt_running, inst->fmt_workers, memory_order_relaxed);
 
-  for (size_t i = 0; i < inst->sinks_count; i++) {
-    needed |= (1u << inst->sinks[i].type);
+  if (inst->pipelined &&
+      pthread_create(&inst->io_th, NULL, lgi_io_worker, (void*)inst) != 0) {
+    LG_DEBUG_ERR("Cannot create I/O thread!");
+    goto fail_io_thread;
   }
-  inst->out_needed = needed;
 
   atomic_store_explicit(&inst->isAlive, true, memory_order_release);
-  if (pthread_create(&inst->writer_th, NULL, lgi_consumer, (void*)inst) != 0) {
+  if (inst->pool) {
+    if (!lgi_pool_attach(inst->pool, inst)) goto fail_thread;
+  } else if (pthread_create(&inst->writer_th, NULL, lgi_consumer, (void*)inst) != 0) {
     LG_DEBUG_ERR("Cannot create writer thread!");
     goto fail_thread;
   }
+  for (; workers < inst->fmt_workers; workers++) {
+    if (pthread_create(&inst->fmt_th[workers], NULL, lgi_fmt_worker, (void*)inst) != 0) {
+      LG_DEBUG_ERR("Cannot create format worker thread!");
+      goto fail_workers;
+    }
+  }
 
   atomic_compare_exchange_strong_explicit(
     &active_instance, &expected, inst,
     memory_order_release, memory_order_relaxed
   );
+  if (ret) lgi_retention_start(inst, ret);
   return true;
 
+fail_workers:
+  // started ones leave, last of them lets I/O thread go
+  atomic_fetch_sub_explicit(&inst->fmt_running, inst->fmt_workers - workers, memory_order_seq_cst);
+  atomic_store_explicit(&inst->isAlive, false, memory_order_seq_cst);
+  pthread_join(inst->writer_th, NULL);
+  for (int i = 1; i < workers; i++) pthread_join(inst->fmt_th[i], NULL);
+  pthread_join(inst->io_th, NULL);
+  goto fail_io_thread;
 fail_thread:
   atomic_store_explicit(&inst->isAlive, false, memory_order_release);
+  if (inst->pipelined) {
+    atomic_store_explicit(&inst->pipe_done, true, memory_order_release);
+    pthread_join(inst->io_th, NULL);
+  }
+fail_io_thread:
+  lgi_pipe_free(inst);
+  free(table);
+fail_table:
+  if (inst->shm) lgi_shm_close(inst);
+  else free(inst->lane);
+  inst->lane = NULL;
+  inst->lane_levels = 0;
+  free(inst->idx);
+  inst->idx = NULL;
+  if (idxFile) fclose(idxFile);
   if (logFile) fclose(logFile);
+  if (logHandle) lg_file_close(logHandle);
 fail:
+  lgi_park_free(&inst->flush_park);
+  free(ret);
   return false;
 }
 
 int lg_vlog_(Logger* inst, const LgLogLevel level, const char* fmt, ...)
 {
-  if (!fmt) return false;
+  va_list args;
+  va_start(args, fmt);
+  int ok = lgi_vlog(inst, NULL, NULL, level, fmt, args);
+  va_end(args);
+  return ok;
+}
 
-  // variadic resolving
+int lg_vlog_site_(Logger* inst, LgCallSite* site, const LgLogLevel level,
+                  const char* fmt, ...)
+{
   va_list args;
   va_start(args, fmt);
-  char msg[LOGGER_MAX_MSG_SIZE];
-  int mn = vsnprintf(msg, sizeof(msg), fmt, args);
+  int ok = lgi_vlog(inst, NULL, site, level, fmt, args);
   va_end(args);
-  if (mn < 0) {
-    LG_DEBUG_ERR("Cannot resolve print format");
-    return false;
-  }
+  return ok;
+}
 
-  return lg_log_(inst, level, msg, mn);
+int lg_vlog_cat_(LgCategory* cat, LgCallSite* site, const LgLogLevel level,
+                 const char* fmt, ...)
+{
+  if (!cat) return false;
+  va_list args;
+  va_start(args, fmt);
+  int ok = lgi_vlog(cat->inst, cat, site, level, fmt, args);
+  va_end(args);
+  return ok;
 }
 
-int lg_log_(Logger* inst, const LgLogLevel level, const char* msg, size_t msglen)
+LOGGER_INTERNAL int lgi_vlog(Logger* inst, LgCategory* cat, LgCallSite* site, LgLogLevel level,
+                             const char* fmt, va_list args)
 {
-  if (!msg || msglen >= LOGGER_MAX_MSG_SIZE) return false;
+  if (!fmt) return false;
+  if (site && lgi_long_load(&site->state) != LGI_SITE_READY) {
+    lgi_site_register(site, level, fmt);
+    // rules are resolved at registration, macro couldn't see them yet
+    if (site->off) return false;
+  }
+  // category's level filter, before it costs a slot
+  if (cat && !(atomic_load_explicit(&cat->levels, memory_order_relaxed)
+               & LOGGER_LEVEL_BIT(level)))
+    return false;
 
-  if (!inst || !lg_is_alive(inst)) {
-    LG_DEBUG_ERR("Cannot log because the instance is dead!");
+  // format straight into the claimed slot, no intermediate copy
+  LgReservation res;
+  if (!lg_reserve(inst, level, &res)) return false;
+  LogPayload* pyld = lgi_res_payload(&res);
+  pyld->site = site;
+  pyld->cat = cat;
+  if (cat) pyld->sink_mask = atomic_load_explicit(&cat->sinks, memory_order_relaxed);
+  // pointers of other processes mean nothing to the writer
+  if (LGI_SHM_FOREIGN(inst)) {
+    pyld->site = NULL;
+    pyld->cat = NULL;
+  }
+
+  // variadic resolving
+  int mn = vsnprintf(res.buf, res.cap, fmt, args);
+  if (mn < 0) {
+    LG_DEBUG_ERR("Cannot resolve print format");
+    lg_abort(&res);
     return false;
   }
 
-  LogQueue *q = &inst->queue;
-  size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
-  size_t seq;
-  LogSlot* s;
-  int spins = 0;
-  for (;;) {
-    s = lgi_slot_get(q, pos);
-    seq = atomic_load_explicit(&s->seq, memory_order_acquire);
-    intptr_t diff = (intptr_t)(seq - pos);
+  // vsnprintf already truncated it, just clamp the length
+  return lg_commit(&res, (size_t)mn, level);
+}
 
-    if (diff == 0) {
-      if (atomic_compare_exchange_weak_explicit(
-            &q->head, &pos, pos + 1,
-            memory_order_relaxed, memory_order_relaxed)) {
-        break; // claim success
-      }
-      // another producer claimed, retry
-    } else if (diff < 0) {
-      // ring is full
-      switch(inst->logPolicy) {
-      case LG_BLOCK:
-        lgi_adaptive_wait(&spins);
-        pos = atomic_load_explicit(&q->head, memory_order_relaxed);
-        break;
-      case LG_PRIORITY_BASED:
-        if (level == LG_ERROR) {
-          lgi_adaptive_wait(&spins);
-          pos = atomic_load_explicit(&q->head, memory_order_relaxed);
-          break;
-        } else return false;
-      default:
-        return false;
-      }
-    } else {
-      pos = atomic_load_explicit(&q->head, memory_order_relaxed);
-    }
+/*
+  First message of a site pushes it to the registry, racing
+  producers of the same site wait for the winner (it's short)
+*/
+LOGGER_INTERNAL void lgi_site_register(LgCallSite* site, LgLogLevel level, const char* fmt)
+{
+  if (!lgi_long_cas(&site->state, LGI_SITE_NEW, LGI_SITE_BUSY)) {
+    while (lgi_long_load(&site->state) != LGI_SITE_READY) LOGGER_PAUSE_INS();
+    return;
   }
+  site->level = level;
+  site->fmt = fmt;
 
-  LogPayload *pyld = &s->payload;
-  memcpy(pyld->msg, msg, msglen + 1);
-  pyld->length = msglen;
-  pyld->level = level;
+  // under the rules lock, a rule can't miss a site in between
+  lgi_spin_lock(&lgi_site_rules_lock);
+  lgi_long_store(&site->off, lgi_site_rules_off(site));
+  LgCallSite* head = atomic_load_explicit(&lgi_call_sites, memory_order_relaxed);
+  do {
+    site->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(
+             &lgi_call_sites, &head, site,
+             memory_order_release, memory_order_relaxed));
+  lgi_spin_unlock(&lgi_site_rules_lock);
+  lgi_long_store(&site->state, LGI_SITE_READY);
+}
 
-  // Slot is ready signal to consumer
-  atomic_store_explicit(&s->seq, pos + 1, memory_order_release);
-  return true;
+const LgCallSite* lg_fmt_site(void)
+{
+  return lgi_fmt_ctx.site;
 }
 
-int lg_set_active_instance(Logger* inst)
+// level filter (sink style) as a LOGGER_LEVEL_BIT set
+LOGGER_INTERNAL uint32_t lgi_level_bits(LgLogLevel minLevel, uint32_t levelMask)
 {
-  if (!inst) return false;
-  atomic_store_explicit(&active_instance, inst, memory_order_release);
-  return 1;
+  uint32_t levels = 0;
+  int min_sev = lg_lvl_severity(minLevel);
+  for (uint32_t l = 0; l < 32; l++) {
+    if (lg_lvl_severity((LgLogLevel)l) < min_sev) continue;
+    if (levelMask != 0 && !(levelMask & LOGGER_LEVEL_BIT(l))) continue;
+    levels |= LOGGER_LEVEL_BIT(l);
+  }
+  return levels;
 }
 
-Logger* lg_get_active_instance()
+LOGGER_INTERNAL LgCategory* lgi_category_find(Logger* inst, const char* name, size_t len)
 {
-  return atomic_load_explicit(&active_instance, memory_order_acquire);
+  for (size_t i = 0; i < inst->cat_count; i++) {
+    LgCategory* c = &inst->categories[i];
+    if (strncmp(c->name, name, len) == 0 && c->name[len] == '\0') return c;
+  }
+  return NULL;
 }
 
-int lg_destroy(Logger* inst)
+/*
+  Resolves the inherited settings (cat_lock is held), parents
+  are always created before their children so one pass is enough
+*/
+LOGGER_INTERNAL void lgi_categories_update(Logger* inst)
 {
-  if (!inst) return false;
-  if (!lg_is_alive(inst)) {
-    LG_DEBUG_ERR("Logger is already dead!");
-    return false;
+  for (size_t i = 0; i < inst->cat_count; i++) {
+    LgCategory* c = &inst->categories[i];
+    uint32_t levels = ~0u;
+    uint32_t sinks = ~0u;
+    if (c->parent) {
+      levels = atomic_load_explicit(&c->parent->levels, memory_order_relaxed);
+      sinks = atomic_load_explicit(&c->parent->sinks, memory_order_relaxed);
+    }
+    if (c->own_levels) levels = c->levels_set;
+    if (c->own_sinks) sinks = c->sinks_set;
+    atomic_store_explicit(&c->levels, levels, memory_order_relaxed);
+    atomic_store_explicit(&c->sinks, sinks, memory_order_relaxed);
   }
-  atomic_store_explicit(&inst->isAlive, false, memory_order_release);
-  pthread_join(inst->writer_th, NULL);
+}
 
-  // close the files if they're not closed
-  for (size_t i = 0; i < inst->sinks_count; i++) {
-    LgSink* s = &inst->sinks[i];
-    FILE* f = s->file;
-    if (!f) continue;
-    if (f != stderr && f != stdout && f != stdin) {
-      if (fclose(f) != 0) {
-        LG_DEBUG_ERR("Log file cannot be closed!");
-        return false;
-      }
-    } else fflush(f);
-    inst->sinks[i].file = NULL;
+LgCategory* lg_category(Logger* inst, const char* name)
+{
+  if (!inst || !name || !name[0]) return NULL;
+  size_t len = strlen(name);
+  if (len >= LOGGER_CATEGORY_NAME_SIZE || name[0] == '.' || name[len - 1] == '.' ||
+      strstr(name, "..")) {
+    LG_DEBUG_ERR("Invalid category name: %s", name);
+    return NULL;
   }
 
-  Logger* expected = inst;
-  atomic_compare_exchange_strong_explicit(
-    &active_instance, &expected, NULL,
-    memory_order_release, memory_order_relaxed
-  );
-  return true;
+  lgi_spin_lock(&inst->cat_lock);
+  LgCategory* parent = NULL;
+  LgCategory* c = NULL;
+  // find or create every level of the path, "net" then "net.http"
+  for (size_t end = 1; end <= len; end++) {
+    if (end < len && name[end] != '.') continue;
+    c = lgi_category_find(inst, name, end);
+    if (!c) {
+      if (inst->cat_count >= LOGGER_MAX_CATEGORIES) {
+        lgi_spin_unlock(&inst->cat_lock);
+        LG_DEBUG_ERR("Max amount of categories is " LG_STRINGIFY(LOGGER_MAX_CATEGORIES));
+        return NULL;
+      }
+      c = &inst->categories[inst->cat_count++];
+      c->inst = inst;
+      c->parent = parent;
+      c->own_levels = false;
+      c->own_sinks = false;
+      c->levels_set = 0;
+      c->sinks_set = 0;
+      memcpy(c->name, name, end);
+      c->name[end] = '\0';
+      atomic_store_explicit(&c->levels,
+        parent ? atomic_load_explicit(&parent->levels, memory_order_relaxed) : ~0u,
+        memory_order_relaxed);
+      atomic_store_explicit(&c->sinks,
+        parent ? atomic_load_explicit(&parent->sinks, memory_order_relaxed) : ~0u,
+        memory_order_relaxed);
+    }
+    parent = c;
+  }
+  lgi_spin_unlock(&inst->cat_lock);
+  return c;
 }
 
-int lg_is_alive(const Logger* inst)
+const char* lg_category_name(const LgCategory* cat)
 {
-  const Logger* ins = inst ? inst : lg_get_active_instance();
-  if (!ins) return false;
-  return atomic_load_explicit(&ins->isAlive, memory_order_acquire);
+  return cat ? cat->name : NULL;
 }
 
-Logger* lg_alloc()
+// setters are entered like log calls, lg_destroy waits for them
+int lg_category_set_level(LgCategory* cat, LgLogLevel minLevel, uint32_t levelMask)
 {
-  Logger* tmp = (Logger*)calloc(1, sizeof(Logger));
-  if (!tmp) {
-    LG_DEBUG_ERR("Cannot allocate Logger instance!");
-    return NULL;
-  }
-  return tmp;
+  if (!cat || !lgi_enter(cat->inst)) return false;
+  lgi_spin_lock(&cat->inst->cat_lock);
+  cat->own_levels = true;
+  cat->levels_set = lgi_level_bits(minLevel, levelMask);
+  lgi_categories_update(cat->inst);
+  lgi_spin_unlock(&cat->inst->cat_lock);
+  lgi_exit(cat->inst);
+  return true;
 }
 
-void lg_free(Logger* inst)
+int lg_category_set_sinks(LgCategory* cat, uint32_t sinkMask)
 {
-  free(inst);
+  if (!cat || !lgi_enter(cat->inst)) return false;
+  lgi_spin_lock(&cat->inst->cat_lock);
+  cat->own_sinks = true;
+  cat->sinks_set = sinkMask;
+  lgi_categories_update(cat->inst);
+  lgi_spin_unlock(&cat->inst->cat_lock);
+  lgi_exit(cat->inst);
+  return true;
 }
 
-// Explicit instances
-int lg_flogi(Logger* inst, const LgLogLevel level, const char* msg)
+int lg_category_inherit(LgCategory* cat)
 {
-  if (!msg) return false;
-  if (!inst) return lg_log_(lg_get_active_instance(), level, msg, strlen(msg));
-  return lg_log_(inst, level, msg, strlen(msg));
+  if (!cat || !lgi_enter(cat->inst)) return false;
+  lgi_spin_lock(&cat->inst->cat_lock);
+  cat->own_levels = false;
+  cat->own_sinks = false;
+  lgi_categories_update(cat->inst);
+  lgi_spin_unlock(&cat->inst->cat_lock);
+  lgi_exit(cat->inst);
+  return true;
 }
-int lg_finfoi(Logger* inst, const char* msg)
+
+const LgCategory* lg_fmt_category(void)
 {
-  return lg_flogi(inst, LG_INFO, msg);
+  return lgi_fmt_ctx.cat;
 }
-int lg_ferrori(Logger* inst, const char* msg)
+
+const LgCallSite* lg_call_sites(void)
 {
-  return lg_flogi(inst, LG_ERROR, msg);
+  return atomic_load_explicit(&lgi_call_sites, memory_order_acquire);
 }
-int lg_fwarni(Logger* inst, const char* msg)
+
+// glob with * and ?, no character classes
+LOGGER_INTERNAL bool lgi_glob_match(const char* pat, const char* str)
 {
-  return lg_flogi(inst, LG_WARNING, msg);
+  const char* star = NULL;
+  const char* back = NULL;
+  while (*str) {
+    if (*pat == '*') {
+      star = pat++;
+      back = str;
+    } else if (*pat == '?' || *pat == *str) {
+      pat++;
+      str++;
+    } else if (star) {
+      pat = star + 1;
+      str = ++back;
+    } else {
+      return false;
+    }
+  }
+  while (*pat == '*') pat++;
+  return *pat == '\0';
 }
 
-// Implicit instances
-int lg_flog(const LgLogLevel level, const char* msg)
+LOGGER_INTERNAL bool lgi_site_rule_match(const LgSiteRule* r, const LgCallSite* site)
 {
-  return lg_flogi(NULL, level, msg);
+  if (r->file[0]) {
+    const char* base = site->file;
+    for (const char* p = site->file; *p; p++) {
+      if (*p == '/' || *p == '\\') base = p + 1;
+    }
+    if (!lgi_glob_match(r->file, site->file) && !lgi_glob_match(r->file, base))
+      return false;
+  }
+  if (r->func[0] && strcmp(r->func, site->func) != 0) return false;
+  if (r->line_from > 0 && site->line < r->line_from) return false;
+  if (r->line_to > 0 && site->line > r->line_to) return false;
+  return true;
 }
-int lg_finfo(const char* msg)
+
+// last matching rule wins, sites are on by default (rules lock is held)
+LOGGER_INTERNAL bool lgi_site_rules_off(const LgCallSite* site)
 {
-  return lg_flogi(NULL, LG_INFO, msg);
+  bool off = false;
+  for (size_t i = 0; i < lgi_site_rules_count; i++) {
+    if (lgi_site_rule_match(&lgi_site_rules[i], site))
+      off = !lgi_site_rules[i].enable;
+  }
+  return off;
 }
-int lg_ferror(const char* msg)
+
+int lg_sites_set(const char* file_glob, const char* func,
+                 int line_from, int line_to, int enable)
 {
-  return lg_flogi(NULL, LG_ERROR, msg);
+#ifndef LOGGER_CALL_SITES
+  // macros of this build make no sites, a rule would never match one
+  LG_UNUSED(file_glob);
+  LG_UNUSED(func);
+  LG_UNUSED(line_from);
+  LG_UNUSED(line_to);
+  LG_UNUSED(enable);
+  LG_DEBUG_ERR("Call sites need GCC or Clang!");
+  return -1;
+#else
+  LgSiteRule r;
+  memset(&r, 0, sizeof(r));
+  if (file_glob) {
+    if (strlen(file_glob) >= sizeof(r.file)) return -1;
+    strcpy(r.file, file_glob);
+  }
+  if (func) {
+    if (strlen(func) >= sizeof(r.func)) return -1;
+    strcpy(r.func, func);
+  }
+  r.line_from = line_from;
+  r.line_to = line_to;
+  r.enable = enable != 0;
+
+  lgi_spin_lock(&lgi_site_rules_lock);
+  if (lgi_site_rules_count >= LOGGER_MAX_SITE_RULES) {
+    lgi_spin_unlock(&lgi_site_rules_lock);
+    LG_DEBUG_ERR("Call site rules are full!");
+    return -1;
+  }
+  lgi_site_rules[lgi_site_rules_count++] = r;
+
+  int matched = 0;
+  LgCallSite* site = atomic_load_explicit(&lgi_call_sites, memory_order_acquire);
+  for (; site; site = site->next) {
+    if (!lgi_site_rule_match(&r, site)) continue;
+    lgi_long_store(&site->off, !r.enable);
+    matched++;
+  }
+  lgi_spin_unlock(&lgi_site_rules_lock);
+  return matched;
+#endif
 }
-int lg_fwarn(const char* msg)
+
+int lg_sites_reset(void)
 {
-  return lg_flogi(NULL, LG_WARNING, msg);
+  lgi_spin_lock(&lgi_site_rules_lock);
+  lgi_site_rules_count = 0;
+  LgCallSite* site = atomic_load_explicit(&lgi_call_sites, memory_order_acquire);
+  for (; site; site = site->next) lgi_long_store(&site->off, 0);
+  lgi_spin_unlock(&lgi_site_rules_lock);
+  return true;
 }
 
-const char* lg_lvl_to_str(const LgLogLevel level)
+int lg_sites_control(const char* query)
 {
-  switch (level) {
-  case LG_INFO:
-    return "INFO";
-  case LG_ERROR:
-    return "ERROR";
-  case LG_WARNING:
-    return "WARNING";
-  case LG_CUSTOM:
-    return "CUSTOM";
-  default:
-    return "NULL";
+  if (!query) return -1;
+  char file[128] = "";
+  char func[64] = "";
+  int from = 0, to = 0, enable = -1;
+  char key[16];
+  char val[128];
+  const char* p = query;
+  int n;
+
+  while (sscanf(p, " %15s%n", key, &n) == 1) {
+    p += n;
+    if (key[0] == '#') break; // rest is comment
+    if (strcmp(key, "+p") == 0) { enable = 1; continue; }
+    if (strcmp(key, "-p") == 0) { enable = 0; continue; }
+    if (sscanf(p, " %127s%n", val, &n) != 1) return -1;
+    p += n;
+    if (strcmp(key, "file") == 0) {
+      if (strlen(val) >= sizeof(file)) return -1;
+      strcpy(file, val);
+    } else if (strcmp(key, "func") == 0) {
+      if (strlen(val) >= sizeof(func)) return -1;
+      strcpy(func, val);
+    } else if (strcmp(key, "line") == 0) {
+      // "10", "10-20", "10-" or "-20"
+      char* dash = strchr(val, '-');
+      from = atoi(val);
+      to = dash ? atoi(dash + 1) : from;
+    } else {
+      LG_DEBUG_ERR("Unknown call site query keyword: %s", key);
+      return -1;
+    }
   }
+  if (enable < 0) return -1; // nothing to do without a flag
+  return lg_sites_set(file[0] ? file : NULL, func[0] ? func : NULL,
+                      from, to, enable);
 }
 
-LoggerConfig lg_get_defaults() {
-  LgSinks sinks = { {LG_STRUCT(LgSink, stdout, LG_OUT_TTY) }, 1};
-  LoggerConfig cfg;
-  cfg.localTime = true;
-  cfg.maxFiles = 0;
-  cfg.generateDefaultFile = true;
-  cfg.sinks = sinks;
-  cfg.logPolicy = LG_DROP;
-  cfg.logFormatter = NULL;
-  return cfg;
+int lg_sites_load(const char* path)
+{
+  if (!path) return -1;
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    LG_DEBUG_ERR("Cannot open call site control file: %s", path);
+    return -1;
+  }
+  char line[512];
+  int applied = 0;
+  while (fgets(line, sizeof(line), f)) {
+    char* p = line;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+    if (lg_sites_control(p) >= 0) {
+      applied++;
+    } else {
+      LG_DEBUG_ERR("Bad call site query: %s", p);
+    }
+  }
+  fclose(f);
+  return applied;
 }
 
-int lg_append_sink(LoggerConfig* config, FILE* f, LgOutType type) {
-  if (!config) return false;
-  if (config->sinks.count >= LOGGER_MAX_SINKS) return false;
-  config->sinks.items[config->sinks.count++] = LG_STRUCT(LgSink, f, type);
-  return true;
+#ifndef _WIN32
+// only async-signal-safe thing here is a lock-free store
+LOGGER_INTERNAL void lgi_sites_signal(int signum)
+{
+  LG_UNUSED(signum);
+  atomic_store_explicit(&lgi_sites_reload, true, memory_order_relaxed);
 }
+#endif
 
-int lg_get_time_str(Logger* inst, char* buf)
+int lg_sites_watch(const char* path, int signum)
 {
 #ifdef _WIN32
-  SYSTEMTIME st;
-  if (inst->isLocalTime) GetLocalTime(&st);
-  else GetSystemTime(&st);
-  int year = st.wYear;
-  int month = st.wMonth;
-  int day = st.wDay;
-  int hours = st.wHour;
-  int minutes = st.wMinute;
-  int seconds = st.wSecond;
-  long millis = st.wMilliseconds;
-#else
-
-  struct timespec ts;
-#if defined(CLOCK_REALTIME_COARSE) && !defined(LOGGER_GET_REAL_TIME)
-  // get coarse time - much more efficient (Linux only)
-  clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+  LG_UNUSED(path);
+  LG_UNUSED(signum);
+  return false;
 #else
-  // get exact time (macOS and other platforms)
-  clock_gettime(CLOCK_REALTIME, &ts);
+  if (!path || strlen(path) >= sizeof(lgi_sites_path)) return false;
+  lgi_spin_lock(&lgi_site_rules_lock);
+  strcpy(lgi_sites_path, path);
+  lgi_spin_unlock(&lgi_site_rules_lock);
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = lgi_sites_signal;
+  sigemptyset(&sa.sa_mask);
+#ifdef SA_RESTART // XSI, hidden on strict POSIX builds
+  sa.sa_flags = SA_RESTART;
+#endif
+  return sigaction(signum, &sa, NULL) == 0;
 #endif
-
-  if (ts.tv_sec != inst->cached_sec) {
-    if (inst->isLocalTime)
-      localtime_r(&ts.tv_sec, &inst->cached_tm);
-    else
-      gmtime_r(&ts.tv_sec, &inst->cached_tm);
-    inst->cached_sec = ts.tv_sec;
-  }
-  int year = inst->cached_tm.tm_year + 1900;
-  int month = inst->cached_tm.tm_mon + 1;
-  int day = inst->cached_tm.tm_mday;
-  int hours = inst->cached_tm.tm_hour;
-  int minutes = inst->cached_tm.tm_min;
-  int seconds = inst->cached_tm.tm_sec;
-  long millis = ts.tv_nsec / 1000000;
-#endif // _WIN32
-
-  lgi_time_write4(buf, year);
-  buf[4]  = '.';
-  lgi_time_write2(buf+5, month);
-  buf[7]  = '.';
-  lgi_time_write2(buf+8, day);
-  buf[10] = '-';
-  lgi_time_write2(buf+11, hours);
-  buf[13] = '.';
-  lgi_time_write2(buf+14, minutes);
-  buf[16] = '.';
-  lgi_time_write2(buf+17, seconds);
-  buf[19] = '.';
-  lgi_time_write3(buf+20, millis);
-  buf[23] = '\0';
-  return true;
 }
 
-LOGGER_INTERNAL int lgi_check_dir(const char* path)
+// writer is idle, reload the control file if the signal came
+LOGGER_INTERNAL void lgi_sites_poll(void)
 {
-#ifdef _WIN32
-  DWORD attr = GetFileAttributesA(path);
-  if (attr == INVALID_FILE_ATTRIBUTES) return 0;
-  if (attr & FILE_ATTRIBUTE_DIRECTORY)
-    return 1;
-  return -1; 
-#else
-  struct stat st;
-  if (stat(path, &st) != 0) return 0;  // not exists
-  if (S_ISDIR(st.st_mode)) return 1;   // exists AND directory (valid)
-  return -1;                           // exists but not a directory
-#endif
+  if (!atomic_load_explicit(&lgi_sites_reload, memory_order_relaxed)) return;
+  if (!atomic_exchange_explicit(&lgi_sites_reload, false, memory_order_acquire))
+    return; // another writer took it
+
+  char path[PATH_MAX];
+  lgi_spin_lock(&lgi_site_rules_lock);
+  memcpy(path, lgi_sites_path, sizeof(path));
+  lgi_spin_unlock(&lgi_site_rules_lock);
+  // file has the whole set, rules of the last load don't pile up
+  if (path[0]) {
+    lg_sites_reset();
+    lg_sites_load(path);
+  }
 }
 
-LOGGER_INTERNAL bool lgi_mkdir_p(char* path)
+/*
+  producer is in from enter to exit (claim to publish), lg_destroy marks it dead
+  and waits for the ones that are in. Counter is this thread's one, increment and
+  the isAlive check are both seq_cst so one of us sees the other
+*/
+LOGGER_INTERNAL bool lgi_enter(Logger* inst)
 {
-  if (!path || !*path) return false;
+  if (lgi_inflight_slot < 0) {
+    unsigned int n = atomic_fetch_add_explicit(&lgi_inflight_next, 1, memory_order_relaxed);
+    lgi_inflight_slot = (int)(n % LOGGER_INFLIGHT_SLOTS);
+  }
+  ATOMIC(long)* c = &inst->inflight[lgi_inflight_slot].n;
+  atomic_fetch_add_explicit(c, 1, memory_order_seq_cst);
+  if (atomic_load_explicit(&inst->isAlive, memory_order_seq_cst)) return true;
+  atomic_fetch_sub_explicit(c, 1, memory_order_release);
+  return false;
+}
 
-  // go char by char
-  for (char* p = path + 1; *p; p++) {
-    if (*p != LOGGER_PATH_SEP) continue;
-    *p = '\0';
-    LG_DEBUG("Trying to create: %s", path);
-    int status = LOGGER_MKDIR(path);
-    if (status != 0 && errno != EEXIST) {
-      LG_DEBUG_ERR("Failed to create path: %s", path);
-      return false;
-    }
-    *p = LOGGER_PATH_SEP;
+// reservations may be committed by another thread, only the sum is meaningful
+LOGGER_INTERNAL void lgi_exit(Logger* inst)
+{
+  if (lgi_inflight_slot < 0) {
+    unsigned int n = atomic_fetch_add_explicit(&lgi_inflight_next, 1, memory_order_relaxed);
+    lgi_inflight_slot = (int)(n % LOGGER_INFLIGHT_SLOTS);
   }
-  return true;
+  atomic_fetch_sub_explicit(&inst->inflight[lgi_inflight_slot].n, 1, memory_order_release);
 }
 
-LOGGER_INTERNAL int lgi_count_logs_and_get_oldest(const char* path, char* oldest_path, size_t opsz) {
-  int count = 0;
-#ifdef _WIN32
-  char pattern[PATH_MAX];
-  snprintf(pattern, sizeof(pattern), "%s\\*" LOGGER_FILE_EXT, path);
+LOGGER_INTERNAL long lgi_inflight(const Logger* inst)
+{
+  long n = 0;
+  for (int i = 0; i < LOGGER_INFLIGHT_SLOTS; i++)
+    n += atomic_load_explicit(&inst->inflight[i].n, memory_order_seq_cst);
+  return n;
+}
 
-  WIN32_FIND_DATAA fdata;
-  HANDLE h = FindFirstFileA(pattern, &fdata);
-  if (h == INVALID_HANDLE_VALUE) return -1;
+LOGGER_INTERNAL void lgi_inflight_reset(Logger* inst)
+{
+  for (int i = 0; i < LOGGER_INFLIGHT_SLOTS; i++)
+    atomic_store_explicit(&inst->inflight[i].n, 0, memory_order_relaxed);
+}
 
-  FILETIME oldest_ft;
-  oldest_ft.dwLowDateTime = MAXDWORD;
-  oldest_ft.dwHighDateTime = MAXDWORD;
-  do {
-    count++;
+int lg_log_(Logger* inst, const LgLogLevel level, const char* msg, size_t msglen)
+{
+  if (!msg || msglen >= LOGGER_MAX_MSG_SIZE) return false;
+
+  if (!inst || !lgi_enter(inst)) {
+    LG_DEBUG_ERR("Cannot log because the instance is dead!");
+    return false;
+  }
 
-    FILETIME ft = fdata.ftLastWriteTime;
-    if (oldest_path && CompareFileTime(&ft, &oldest_ft) < 0) {
-      oldest_ft = ft;
-      snprintf(oldest_path, opsz, "%s\\%s", path, fdata.cFileName);
+  size_t pos;
+  LogSlot* s = NULL;
+  LogQueue* q = lgi_queue_of(inst, level);
+  if (q != inst->ring || !lgi_spilling(inst))
+    s = lgi_queue_claim(inst, q, level, inst->logPolicy, &pos);
+  if (!s) {
+    LgReservation res;
+    if (inst->logPolicy != LG_SPILL || !lgi_spill_reserve(inst, level, &res)) {
+      lgi_exit(inst);
+      return false;
     }
-  } while (FindNextFileA(h, &fdata));
+    memcpy(res.buf, msg, msglen);
+    return lg_commit(&res, msglen, level); // exits
+  }
 
-  FindClose(h);
-#else
-  DIR* dir = opendir(path);
-  if (!dir) return -1;
-  time_t oldest_mtime = LLONG_MAX;
+  LogPayload *pyld = &s->payload;
+  memcpy(pyld->msg, msg, msglen);
+  pyld->msg[msglen] = '\0';
+  pyld->length = msglen;
+  pyld->level = level;
+  pyld->flags = 0;
 
-  struct dirent* entry;
-  while ((entry = readdir(dir)) != NULL) {
-    const char* name = entry->d_name;
-    size_t len = strlen(name);
-    if (len <= LOGGER_FILE_EXT_SZ ||
-        memcmp(name + len - LOGGER_FILE_EXT_SZ, LOGGER_FILE_EXT, LOGGER_FILE_EXT_SZ) != 0)
+  lgi_queue_publish(s, pos);
+  if (inst->pool) lgi_pool_notify(inst->pool);
+  lgi_exit(inst);
+  return true;
+}
+
+size_t lg_log_batch(Logger* inst, LgCategory* cat, const LgLogLevel* levels,
+                    const char* msgs, const size_t* lens, const double* ts,
+                    size_t n)
+{
+  size_t logged = 0;
+  size_t unnotified = 0;
+  if (cat) inst = cat->inst;
+  if (!levels || !msgs || !lens || n == 0) return 0;
+
+  if (!inst || !lgi_enter(inst)) {
+    LG_DEBUG_ERR("Cannot log because the instance is dead!");
+    return 0;
+  }
+  uint32_t cat_levels = cat ? atomic_load_explicit(&cat->levels, memory_order_relaxed) : ~0u;
+  uint32_t sink_mask = cat ? atomic_load_explicit(&cat->sinks, memory_order_relaxed) : ~0u;
+  // pointers of other processes mean nothing to the writer
+  LgCategory* pcat = LGI_SHM_FOREIGN(inst) ? NULL : cat;
+
+  for (size_t i = 0; i < n; msgs += lens[i++]) {
+    LgLogLevel level = levels[i];
+    size_t len = lens[i] < LOGGER_MAX_MSG_SIZE ? lens[i] : LOGGER_MAX_MSG_SIZE - 1;
+    // levels come from the caller (FFI too), a shift past 31 is UB
+    if ((unsigned)level > LG_CUSTOM || !(cat_levels & LOGGER_LEVEL_BIT(level))) continue;
+
+    size_t pos;
+    LogSlot* s = NULL;
+    LogQueue* q = lgi_queue_of(inst, level);
+    if (q != inst->ring || !lgi_spilling(inst))
+      s = lgi_queue_claim(inst, q, level, inst->logPolicy, &pos);
+    if (!s) {
+      LgReservation res;
+      // lg_commit leaves the instance for it, so it's entered once more
+      if (inst->logPolicy != LG_SPILL || !lgi_enter(inst)) continue;
+      if (!lgi_spill_reserve(inst, level, &res)) {
+        lgi_exit(inst);
+        continue;
+      }
+      memcpy(res.buf, msgs, len);
+      if (ts && ts[i] > 0) lgi_res_payload(&res)->ts = (uint64_t)(ts[i] * 1e9);
+      lgi_res_payload(&res)->cat = pcat;
+      lgi_res_payload(&res)->sink_mask = sink_mask;
+      logged += lg_commit(&res, len, level) ? 1 : 0;
       continue;
+    }
 
-    count += 1;
-    char full_path[PATH_MAX];
-    int n = snprintf(full_path, sizeof(full_path), "%s/%s", path, name);
-    if (n < 0 || (size_t)n >= sizeof(full_path) || (size_t)n >= opsz) continue;
-    struct stat st;
-    if (stat(full_path, &st) == 0 && st.st_mtime < oldest_mtime) {
-      oldest_mtime = st.st_mtime;
-      memcpy(oldest_path, full_path, n + 1);
+    LogPayload *pyld = &s->payload;
+    memcpy(pyld->msg, msgs, len);
+    pyld->msg[len] = '\0';
+    pyld->length = len;
+    pyld->level = level;
+    pyld->flags = 0;
+    pyld->cat = pcat;
+    pyld->sink_mask = sink_mask;
+    if (ts && ts[i] > 0) pyld->ts = (uint64_t)(ts[i] * 1e9);
+    lgi_queue_publish(s, pos);
+    logged++;
+    // not just at the end, a blocked batch would wait for pool's park timeout
+    if (inst->pool && ++unnotified == LOGGER_MIN_BATCH) {
+      lgi_pool_notify(inst->pool);
+      unnotified = 0;
     }
   }
-
-  if (closedir(dir) != 0) return -1;
-#endif
-  return count;
+  if (inst->pool && unnotified > 0) lgi_pool_notify(inst->pool);
+  lgi_exit(inst);
+  return logged;
 }
 
-LOGGER_INTERNAL bool lgi_normalize_path(const char* path, char* out, size_t size)
+int lg_reserve(Logger* inst, const LgLogLevel level, LgReservation* res)
 {
-  if (!path || !*path) return false;
-  char* dst = out;
-  char* end = out + size - 1;
+  if (!res) return false;
+  res->slot = NULL;
 
-  for (const char* src = path; *src && dst < end; src++) {
-    // double slash skip
-    if (*src == LOGGER_PATH_SEP
-        && dst != out
-        && *(dst-1) == LOGGER_PATH_SEP) continue;
-    *dst++ = *src;
+  // reservation stays in until its commit or abort
+  if (!inst || !lgi_enter(inst)) {
+    LG_DEBUG_ERR("Cannot reserve because the instance is dead!");
+    return false;
   }
-  *dst = '\0';
 
-  // add trailing slash
-  if (dst + 1 >= end) return false;
-  size_t len = dst - out;
-  out[len] = LOGGER_PATH_SEP;
-  out[len + 1] = '\0';
+  size_t pos;
+  LogSlot* s = NULL;
+  LogQueue* q = lgi_queue_of(inst, level);
+  if (q != inst->ring || !lgi_spilling(inst))
+    s = lgi_queue_claim(inst, q, level, inst->logPolicy, &pos);
+  if (!s) {
+    if (inst->logPolicy == LG_SPILL && lgi_spill_reserve(inst, level, res)) return true;
+    lgi_exit(inst);
+    return false;
+  }
+
+  res->inst = inst;
+  res->slot = s;
+  res->pos  = pos;
+  res->buf  = s->payload.msg;
+  res->cap  = sizeof(s->payload.msg);
   return true;
 }
 
-void lg_str_format_into(LgString* s, const char* fmt, ...)
+int lg_commit(LgReservation* res, size_t len, const LgLogLevel level)
 {
-  if (!s) return;
-  size_t cap = sizeof(s->data);
+  if (!res || !res->slot) return false;
+  if (len >= res->cap) len = res->cap - 1;
 
-  va_list ap;
-  va_start(ap, fmt);
-  int n = vsnprintf(s->data, cap, fmt, ap);
-  va_end(ap);
+  LogPayload *pyld = lgi_res_payload(res);
+  pyld->msg[len] = '\0';
+  pyld->length = len;
+  pyld->level = level;
+  pyld->flags = 0;
 
-  // guarentees \n at the end
-  if (n < 0) {
-    s->len = 0;
-  } else if ((size_t)n >= cap) {
-    if (cap >= 2) {
-      s->data[cap - 2] = '\n';
-      s->data[cap - 1] = '\0';
-      s->len = cap - 1;
-    } else {
-      s->len = 0;
-    }
+  if (res->pos == LGI_SPILL_POS) {
+    lgi_spill_push(res->inst, (LgSpillNode*)res->slot);
   } else {
-    s->len = (size_t)n;
+    lgi_queue_publish((LogSlot*)res->slot, res->pos);
+    if (res->inst->pool) lgi_pool_notify(res->inst->pool);
   }
+  res->slot = NULL;
+  lgi_exit(res->inst);
+  return true;
 }
 
-void lg_str_write_into(LgString* s, const char* str)
+int lg_abort(LgReservation* res)
 {
-  if (!str || !s) return;
-  size_t len = strlen(str);
-  if (len == 0) return;
-  if (len >= sizeof(s->data)) len = sizeof(s->data) - 2;
-  memcpy(s->data, str, len);
-  s->data[len - 1] = '\n';
-  s->data[len] = '\0';
-  s->len = len;
+  if (!res || !res->slot) return false;
+  if (res->pos == LGI_SPILL_POS) {
+    free(res->slot); // nobody has seen it yet
+    atomic_fetch_sub_explicit(&res->inst->spill_queued, 1, memory_order_relaxed);
+  } else {
+    // slot is already claimed, we can't hand it back to producers
+    // so publish it as an empty one and writer skips it
+    LogSlot* s = (LogSlot*)res->slot;
+    s->payload.length = 0;
+    s->payload.flags = LGI_PAYLOAD_SKIP;
+    lgi_queue_publish(s, res->pos);
+    if (res->inst->pool) lgi_pool_notify(res->inst->pool);
+  }
+  res->slot = NULL;
+  lgi_exit(res->inst);
+  return true;
 }
 
-LOGGER_INTERNAL int lgi_def_format_msg(
-  const char* time_str, LgLogLevel level,
-  const char* msg, uint32_t needed, LgMsgPack pack)
+/*
+  printf subset without locale, malloc or stdio,
+  returns the length (out is always terminated)
+*/
+LOGGER_INTERNAL size_t lgi_sig_format(char* out, size_t cap, const char* fmt, va_list args)
 {
-  const char* level_str = lg_lvl_to_str(level);
+  size_t n = 0;
+  if (cap == 0) return 0;
+  cap--; // for '\0'
 
-  // Colorized TTY formatting (you can disable)
-  if (LOGGER_CONTAINS_FLAG(needed, LG_OUT_TTY)) {
-    LgString* s = &pack[LG_OUT_TTY];
-    char* p = s->data;
-    char* end = p + sizeof(s->data) - 1;
-#ifndef LOGGER_DONT_COLORIZE
-    const char* clr;
-    switch (level) {
-      case LG_ERROR:   clr = LOGGER_CLR_RED;    break;
+  while (*fmt && n < cap) {
+    if (*fmt != '%') {
+      out[n++] = *fmt++;
+      continue;
+    }
+    const char* spec = fmt++;
+    bool zero = false;
+    bool left = false;
+    size_t width = 0;
+    int longs = 0;
+    bool size = false;
+    for (; *fmt == '0' || *fmt == '-'; fmt++) {
+      if (*fmt == '0') zero = true;
+      else left = true;
+    }
+    if (left) zero = false;
+    while (*fmt >= '0' && *fmt <= '9') width = width * 10 + (size_t)(*fmt++ - '0');
+    while (*fmt == 'l') {
+      longs++;
+      fmt++;
+    }
+    if (*fmt == 'z') {
+      size = true;
+      fmt++;
+    }
+
+    char num[24];
+    size_t len = 0;
+    const char* str = num;
+    unsigned long long v = 0;
+    unsigned base = 10;
+    bool neg = false;
+    switch (*fmt) {
+    case 'd':
+    case 'i': {
+      long long sv = size ? (long long)va_arg(args, ptrdiff_t)
+                   : longs >= 2 ? va_arg(args, long long)
+                   : longs == 1 ? (long long)va_arg(args, long)
+                   : (long long)va_arg(args, int);
+      neg = sv < 0;
+      v = neg ? 0ull - (unsigned long long)sv : (unsigned long long)sv;
+      break;
+    }
+    case 'u':
+    case 'x':
+    case 'X':
+      v = size ? (unsigned long long)va_arg(args, size_t)
+        : longs >= 2 ? va_arg(args, unsigned long long)
+        : longs == 1 ? (unsigned long long)va_arg(args, unsigned long)
+        : (unsigned long long)va_arg(args, unsigned int);
+      if (*fmt != 'u') base = 16;
+      break;
+    case 'p':
+      v = (unsigned long long)(uintptr_t)va_arg(args, void*);
+      base = 16;
+      if (n < cap) out[n++] = '0';
+      if (n < cap) out[n++] = 'x';
+      break;
+    case 's':
+      str = va_arg(args, const char*);
+      if (!str) str = "(null)";
+      len = strlen(str);
+      break;
+    case 'c':
+      num[0] = (char)va_arg(args, int);
+      len = 1;
+      break;
+    case '%':
+      num[0] = '%';
+      len = 1;
+      break;
+    default:
+      // not ours, as it is
+      fmt = spec + 1;
+      out[n++] = '%';
+      continue;
+    }
+
+    if (*fmt != 's' && *fmt != 'c' && *fmt != '%') {
+      const char* digits = *fmt == 'X' ? "0123456789ABCDEF" : "0123456789abcdef";
+      char rev[24];
+      size_t r = 0;
+      do {
+        rev[r++] = digits[v % base];
+        v /= base;
+      } while (v);
+      if (neg) num[len++] = '-';
+      while (r > 0) num[len++] = rev[--r];
+    }
+    fmt++;
+
+    size_t total = len;
+    if (zero && neg) {
+      out[n++] = '-'; // zero padding goes after the sign
+      str++;
+      len--;
+    }
+    for (size_t pad = total; !left && pad < width && n < cap; pad++) out[n++] = zero ? '0' : ' ';
+    for (size_t i = 0; i < len && n < cap; i++) out[n++] = str[i];
+    for (size_t pad = total; left && pad < width && n < cap; pad++) out[n++] = ' ';
+  }
+  out[n] = '\0';
+  return n;
+}
+
+int lg_log_signal_safe(Logger* inst, const LgLogLevel level, const char* fmt, ...)
+{
+  if (!fmt) return false;
+  Logger* ins = inst ? inst : lg_get_active_instance();
+  if (!ins || !lgi_enter(ins)) return false;
+
+  // never waits, there's nobody to free a slot if the writer is the one we stopped
+  size_t pos;
+  LogQueue* q = lgi_queue_of(ins, level);
+  LogSlot* s = lgi_queue_claim(ins, q, level, LG_DROP, &pos);
+  if (!s) {
+    lgi_exit(ins);
+    return false;
+  }
+
+  va_list args;
+  va_start(args, fmt);
+  size_t len = lgi_sig_format(s->payload.msg, sizeof(s->payload.msg), fmt, args);
+  va_end(args);
+  s->payload.length = len;
+  s->payload.level = level;
+  s->payload.flags = 0;
+  lgi_queue_publish(s, pos); // pool's wakeup isn't signal safe, it gets it in a park timeout
+  lgi_exit(ins);
+  return true;
+}
+
+/*
+  Writer's side of the drain: up to max published messages of q, then releases them.
+  I/O thread ticks LgFiles out of the rings' lock, so with it a message of an
+  LgFile sink stays on the ring and *blocked is set
+*/
+LOGGER_INTERNAL size_t lgi_sig_drain(Logger* inst, LogQueue* q, LgSinkTable* t, size_t max,
+                                     bool* blocked)
+{
+  char line[LOGGER_TIME_STR_SIZE + LOGGER_MAX_MSG_SIZE + 32];
+  size_t done = 0;
+  while (done < max) {
+    size_t pos = q->tail;
+    LogSlot* s = lgi_slot_get(q, pos);
+    if (atomic_load_explicit(&s->seq, memory_order_acquire) != pos + 1) break;
+    if (inst->shm) lgi_shm_check(inst, s);
+    const LogPayload* pl = &s->payload;
+    uint32_t lvl_bit = LOGGER_LEVEL_BIT(pl->level);
+
+    if (inst->pipelined && !(pl->flags & LGI_PAYLOAD_SKIP)) {
+      for (size_t k = 0; k < t->count && !*blocked; k++)
+        *blocked = t->items[k].handle && (t->levels[k] & lvl_bit) && (pl->sink_mask & t->bits[k]);
+      if (*blocked) break;
+    }
+
+    if (!(pl->flags & LGI_PAYLOAD_SKIP)) {
+      // instance's style unless it's local time, localtime needs libc's tz lock
+      LgTimeStyle style = inst->isLocalTime ? LG_TIME_EPOCH : inst->timeStyle;
+      LgTimeCache tc;
+      tc.valid = false;
+      LgIdxLine ln;
+      size_t n = lgi_time_render(&tc, pl->ts, style, inst->timePrecision, false, line);
+      ln.ts = pl->ts;
+      ln.level = pl->level;
+      ln.skip = (uint32_t)n;
+      const char* name = lg_lvl_to_str((LgLogLevel)pl->level);
+      size_t mlen = pl->length < LOGGER_MAX_MSG_SIZE ? pl->length : LOGGER_MAX_MSG_SIZE - 1;
+      line[n++] = ' ';
+      line[n++] = '[';
+      for (const char* c = name; *c && n < LOGGER_TIME_STR_SIZE + 24; c++) line[n++] = *c;
+      line[n++] = ']';
+      line[n++] = ' ';
+      memcpy(line + n, pl->msg, mlen);
+      n += mlen;
+      line[n++] = '\n';
+
+      for (size_t k = 0; k < t->count; k++) {
+        const LgSink* sk = &t->items[k];
+        if (!(t->levels[k] & lvl_bit) || !(pl->sink_mask & t->bits[k])) continue;
+        if (sk->handle) {
+          // through the stage so its offsets hold, pwrite and fsync only
+          struct iovec iov;
+          iov.iov_base = line;
+          iov.iov_len = n;
+          if (lgi_file_writev(sk->handle, &iov, 1) < 0 || !lgi_file_flush(sk->handle, true))
+            continue;
+        } else if (!sk->file || !lgi_fd_write(sk->file, line, n)) {
+          continue;
+        }
+        if (inst->idx && sk->file == inst->idx->file && sk->handle == inst->idx->handle)
+          lgi_idx_line(inst->idx, &ln, line, n);
+      }
+    }
+    lgi_queue_release(q, pos);
+    q->tail = pos + 1;
+    atomic_store_explicit(&inst->written[q == inst->lane], pos + 1, memory_order_seq_cst);
+    done++;
+  }
+  return done;
+}
+
+int lg_drain_signal_safe(Logger* inst, size_t max)
+{
+  Logger* ins = inst ? inst : lg_get_active_instance();
+  if (!ins || !lg_is_alive(ins) || LGI_SHM_FOREIGN(ins)) return false;
+
+  // rings are writer's, wait (a bit) until it's between batches
+  uint64_t start = lgi_now_ms();
+  while (atomic_exchange_explicit(&ins->consuming, true, memory_order_acquire)) {
+    if (lgi_now_ms() - start >= LOGGER_SIGNAL_WAIT_MS) return false;
+    LOGGER_PAUSE_INS();
+  }
+  // formatted batches are older ones, I/O thread writes them first
+  bool ready = true;
+  for (size_t i = 0; ready && ins->pipelined && i < ins->pipe_depth; i++) {
+    while (atomic_load_explicit(&ins->pipe[i].state, memory_order_acquire) != LGI_BATCH_FREE) {
+      if (lgi_now_ms() - start >= LOGGER_SIGNAL_WAIT_MS) {
+        ready = false;
+        break;
+      }
+      LOGGER_PAUSE_INS();
+    }
+  }
+
+  if (ready) {
+    LgSinkTable* t = atomic_load_explicit(&ins->sinks, memory_order_acquire);
+    bool blocked = false;
+    size_t done = ins->lane ? lgi_sig_drain(ins, ins->lane, t, max, &blocked) : 0;
+    if (!blocked) lgi_sig_drain(ins, ins->ring, t, max - done, &blocked);
+    ready = !blocked;
+  }
+  atomic_store_explicit(&ins->consuming, false, memory_order_release);
+  return ready;
+}
+
+LOGGER_INTERNAL bool lgi_flush_is_done(const Logger* inst, const LgFlushTicket* t)
+{
+  return atomic_load_explicit(&inst->written[0], memory_order_seq_cst) >= t->ring &&
+         atomic_load_explicit(&inst->written[1], memory_order_seq_cst) >= t->lane &&
+         atomic_load_explicit(&inst->spill_written, memory_order_seq_cst) >= t->spill;
+}
+
+// a batch is written, waiters count themselves before they check so one of us sees the other
+LOGGER_INTERNAL void lgi_flush_advance(Logger* inst, const LgBatch* b)
+{
+  if (b->src >= 0) atomic_store_explicit(&inst->written[b->src], b->end, memory_order_seq_cst);
+  if (b->spills > 0)
+    atomic_fetch_add_explicit(&inst->spill_written, b->spills, memory_order_seq_cst);
+  if (atomic_load_explicit(&inst->flush_waiters, memory_order_seq_cst) > 0) lgi_flush_wake(inst);
+}
+
+// wakes the waiters and calls the callbacks that are done (outside of the lock)
+LOGGER_INTERNAL void lgi_flush_wake(Logger* inst)
+{
+  LgFlushCb ready[LOGGER_MAX_FLUSH_CALLBACKS];
+  size_t n = 0;
+  size_t k = 0;
+  lgi_park_lock(&inst->flush_park);
+  lgi_park_wake_all(&inst->flush_park);
+  for (size_t i = 0; i < inst->flush_cb_count; i++) {
+    if (lgi_flush_is_done(inst, &inst->flush_cbs[i].ticket)) ready[n++] = inst->flush_cbs[i];
+    else inst->flush_cbs[k++] = inst->flush_cbs[i];
+  }
+  inst->flush_cb_count = k;
+  lgi_park_unlock(&inst->flush_park);
+
+  for (size_t i = 0; i < n; i++) {
+    ready[i].cb(ready[i].arg);
+    atomic_fetch_sub_explicit(&inst->flush_waiters, 1, memory_order_seq_cst);
+  }
+}
+
+// lg_destroy wrote (or dropped) everything, nobody waits after it
+LOGGER_INTERNAL void lgi_flush_finish(Logger* inst)
+{
+  atomic_store_explicit(&inst->written[0],
+                        atomic_load_explicit(&inst->ring->head, memory_order_relaxed),
+                        memory_order_seq_cst);
+  if (inst->lane)
+    atomic_store_explicit(&inst->written[1],
+                          atomic_load_explicit(&inst->lane->head, memory_order_relaxed),
+                          memory_order_seq_cst);
+  atomic_store_explicit(&inst->spill_written,
+                        atomic_load_explicit(&inst->spill_pushed, memory_order_relaxed),
+                        memory_order_seq_cst);
+  // a callback added after a wake is called by the next one
+  while (atomic_load_explicit(&inst->flush_waiters, memory_order_seq_cst) > 0) {
+    lgi_flush_wake(inst);
+    LOGGER_YIELD();
+  }
+  lgi_park_free(&inst->flush_park);
+}
+
+int lg_flush_ticket(Logger* inst, LgFlushTicket* ticket)
+{
+  if (!ticket) return false;
+  ticket->ring = ticket->lane = ticket->spill = 0;
+  Logger* ins = inst ? inst : lg_get_active_instance();
+  // written positions of a shared ring are in the writer's process
+  if (!ins || !lg_is_alive(ins) || LGI_SHM_FOREIGN(ins)) return false;
+
+  ticket->spill = atomic_load_explicit(&ins->spill_pushed, memory_order_acquire);
+  ticket->ring = atomic_load_explicit(&ins->ring->head, memory_order_acquire);
+  if (ins->lane) ticket->lane = atomic_load_explicit(&ins->lane->head, memory_order_acquire);
+  return true;
+}
+
+int lg_flush_done(const Logger* inst, const LgFlushTicket* ticket)
+{
+  const Logger* ins = inst ? inst : lg_get_active_instance();
+  if (!ins || !ticket) return false;
+  return lgi_flush_is_done(ins, ticket);
+}
+
+int lg_flush_wait(Logger* inst, const LgFlushTicket* ticket, unsigned int timeout_ms)
+{
+  Logger* ins = inst ? inst : lg_get_active_instance();
+  if (!ins || !ticket) return false;
+  if (lgi_flush_is_done(ins, ticket)) return true;
+  if (LGI_SHM_FOREIGN(ins)) return false;
+
+  // counted before the alive check, so lg_destroy keeps the park until we leave it
+  bool done = false;
+  uint64_t start = lgi_now_ms();
+  atomic_fetch_add_explicit(&ins->flush_waiters, 1, memory_order_seq_cst);
+  if (!atomic_load_explicit(&ins->isAlive, memory_order_seq_cst)) {
+    atomic_fetch_sub_explicit(&ins->flush_waiters, 1, memory_order_seq_cst);
+    return lgi_flush_is_done(ins, ticket);
+  }
+  lgi_park_lock(&ins->flush_park);
+  for (;;) {
+    done = lgi_flush_is_done(ins, ticket);
+    uint64_t waited = lgi_now_ms() - start;
+    if (done || waited >= timeout_ms) break;
+    uint64_t left = timeout_ms - waited;
+    lgi_park_wait(&ins->flush_park, (unsigned int)(left < LOGGER_POOL_PARK_MS ? left : LOGGER_POOL_PARK_MS));
+  }
+  lgi_park_unlock(&ins->flush_park);
+  atomic_fetch_sub_explicit(&ins->flush_waiters, 1, memory_order_seq_cst);
+  return done;
+}
+
+int lg_flush(Logger* inst, unsigned int timeout_ms)
+{
+  LgFlushTicket t;
+  if (!lg_flush_ticket(inst, &t)) return false;
+  return lg_flush_wait(inst, &t, timeout_ms);
+}
+
+int lg_flush_async(Logger* inst, const LgFlushTicket* ticket, lg_flush_cb cb, void* arg)
+{
+  Logger* ins = inst ? inst : lg_get_active_instance();
+  if (!ins || !ticket || !cb || LGI_SHM_FOREIGN(ins)) return false;
+
+  // counted before the checks, writer can't miss it and lg_destroy
+  // keeps the park (and calls the callback) until it's 0 again
+  int rc = 1;
+  atomic_fetch_add_explicit(&ins->flush_waiters, 1, memory_order_seq_cst);
+  if (!atomic_load_explicit(&ins->isAlive, memory_order_seq_cst)) {
+    atomic_fetch_sub_explicit(&ins->flush_waiters, 1, memory_order_seq_cst);
+    return false;
+  }
+  lgi_park_lock(&ins->flush_park);
+  if (lgi_flush_is_done(ins, ticket)) {
+    rc = 2;
+  } else if (ins->flush_cb_count >= LOGGER_MAX_FLUSH_CALLBACKS) {
+    rc = 0;
+  } else {
+    LgFlushCb* c = &ins->flush_cbs[ins->flush_cb_count++];
+    c->ticket = *ticket;
+    c->cb = cb;
+    c->arg = arg;
+  }
+  lgi_park_unlock(&ins->flush_park);
+  if (rc != 1) atomic_fetch_sub_explicit(&ins->flush_waiters, 1, memory_order_seq_cst);
+  return rc;
+}
+
+int lg_set_active_instance(Logger* inst)
+{
+  if (!inst) return false;
+  atomic_store_explicit(&active_instance, inst, memory_order_release);
+  return 1;
+}
+
+Logger* lg_get_active_instance()
+{
+  return atomic_load_explicit(&active_instance, memory_order_acquire);
+}
+
+int lg_destroy(Logger* inst)
+{
+  if (!inst) return false;
+  // only one of the racing destroys gets it, new producers fail from now on
+  bool alive = true;
+  if (!atomic_compare_exchange_strong_explicit(&inst->isAlive, &alive, false,
+                                               memory_order_seq_cst, memory_order_relaxed)) {
+    LG_DEBUG_ERR("Logger is already dead!");
+    return false;
+  }
+  // the ones that are in finish their message (writer keeps making room for them)
+  while (lgi_inflight(inst) > 0) LOGGER_YIELD();
+
+  if (LGI_SHM_FOREIGN(inst)) {
+    // producer only, writer (and the files) belong to another process
+    lgi_shm_close(inst);
+    Logger* prev = inst;
+    atomic_compare_exchange_strong_explicit(
+      &active_instance, &prev, NULL,
+      memory_order_release, memory_order_relaxed
+    );
+    return true;
+  }
+  // producers of other processes drop instead of waiting for us
+  if (inst->shm) atomic_store_explicit(&inst->shm->closed, true, memory_order_release);
+  if (inst->pool) {
+    // pool won't touch it anymore, leftovers are written here
+    lgi_pool_detach(inst->pool, inst);
+    while (lgi_consume(inst))
+      ;; // drain loop
+  } else {
+    pthread_join(inst->writer_th, NULL);
+    for (int i = 1; i < inst->fmt_workers; i++) pthread_join(inst->fmt_th[i], NULL);
+    if (inst->pipelined) pthread_join(inst->io_th, NULL);
+  }
+  lgi_pipe_free(inst);
+  lgi_flush_finish(inst);
+  // a dlclose or exit after us mustn't pull the code or the manifest from under it
+  if (inst->retention_on) pthread_join(inst->retention_th, NULL);
+  inst->retention_on = false;
+
+  // writer is gone, retire the leftovers and close the files
+  LgSinkTable* table = atomic_load_explicit(&inst->sinks, memory_order_acquire);
+  bool closed = lgi_sinks_retire(inst, table);
+  if (inst->idx && !lgi_idx_close(inst->idx)) closed = false;
+  inst->idx = NULL;
+  for (size_t i = 0; i < table->count; i++) {
+    if (!lgi_sink_close(&table->items[i])) closed = false;
+    table->items[i].file = NULL;
+    table->items[i].handle = NULL;
+  }
+  atomic_store_explicit(&inst->sinks, (LgSinkTable*)NULL, memory_order_relaxed);
+  inst->sinks_cur = NULL;
+  free(table);
+  if (inst->spill_file) fclose(inst->spill_file);
+  inst->spill_file = NULL;
+  if (inst->shm) lgi_shm_close(inst);
+  else free(inst->lane);
+  inst->lane = NULL;
+  inst->lane_levels = 0;
+  if (!closed) {
+    LG_DEBUG_ERR("Log file cannot be closed!");
+    return false;
+  }
+
+  Logger* expected = inst;
+  atomic_compare_exchange_strong_explicit(
+    &active_instance, &expected, NULL,
+    memory_order_release, memory_order_relaxed
+  );
+  return true;
+}
+
+int lg_is_alive(const Logger* inst)
+{
+  const Logger* ins = inst ? inst : lg_get_active_instance();
+  if (!ins) return false;
+  return atomic_load_explicit(&ins->isAlive, memory_order_acquire);
+}
+
+Logger* lg_alloc()
+{
+  Logger* tmp = (Logger*)calloc(1, sizeof(Logger));
+  if (!tmp) {
+    LG_DEBUG_ERR("Cannot allocate Logger instance!");
+    return NULL;
+  }
+  return tmp;
+}
+
+void lg_free(Logger* inst)
+{
+  free(inst);
+}
+
+// Explicit instances
+int lg_flogi(Logger* inst, const LgLogLevel level, const char* msg)
+{
+  if (!msg) return false;
+  if (!inst) return lg_log_(lg_get_active_instance(), level, msg, strlen(msg));
+  return lg_log_(inst, level, msg, strlen(msg));
+}
+int lg_fclog(LgCategory* cat, const LgLogLevel level, const char* msg)
+{
+  if (!msg) return false;
+  return lg_vlog_cat_(cat, NULL, level, "%s", msg);
+}
+int lg_finfoi(Logger* inst, const char* msg)
+{
+  return lg_flogi(inst, LG_INFO, msg);
+}
+int lg_ferrori(Logger* inst, const char* msg)
+{
+  return lg_flogi(inst, LG_ERROR, msg);
+}
+int lg_fwarni(Logger* inst, const char* msg)
+{
+  return lg_flogi(inst, LG_WARNING, msg);
+}
+
+// Implicit instances
+int lg_flog(const LgLogLevel level, const char* msg)
+{
+  return lg_flogi(NULL, level, msg);
+}
+int lg_finfo(const char* msg)
+{
+  return lg_flogi(NULL, LG_INFO, msg);
+}
+int lg_ferror(const char* msg)
+{
+  return lg_flogi(NULL, LG_ERROR, msg);
+}
+int lg_fwarn(const char* msg)
+{
+  return lg_flogi(NULL, LG_WARNING, msg);
+}
+
+int lg_lvl_severity(const LgLogLevel level)
+{
+  switch (level) {
+  case LG_ERROR:
+    return 2;
+  case LG_WARNING:
+    return 1;
+  case LG_INFO:
+  case LG_CUSTOM:
+  default:
+    return 0;
+  }
+}
+
+const char* lg_lvl_to_str(const LgLogLevel level)
+{
+  switch (level) {
+  case LG_INFO:
+    return "INFO";
+  case LG_ERROR:
+    return "ERROR";
+  case LG_WARNING:
+    return "WARNING";
+  case LG_CUSTOM:
+    return "CUSTOM";
+  default:
+    return "NULL";
+  }
+}
+
+LoggerConfig lg_get_defaults() {
+  LgSinks sinks = { {LG_STRUCT(LgSink, stdout, LG_OUT_TTY, LG_INFO, 0, NULL) }, 1};
+  LoggerConfig cfg;
+  cfg.localTime = true;
+  cfg.maxFiles = 0;
+  cfg.generateDefaultFile = true;
+  cfg.sinks = sinks;
+  cfg.logPolicy = LG_DROP;
+  cfg.logFormatter = NULL;
+  cfg.pipelineWrites = false;
+  memset(&cfg.fileOptions, 0, sizeof(cfg.fileOptions));
+  cfg.timeStyle = LG_TIME_DEFAULT;
+  cfg.timePrecision = LG_TIME_MS;
+  cfg.logCallSite = false;
+  cfg.writerPool = NULL;
+  cfg.priorityLane = false;
+  cfg.priorityLevel = LG_ERROR;
+  memset(&cfg.writerOptions, 0, sizeof(cfg.writerOptions));
+  cfg.indexFile = false;
+  cfg.maxTotalBytes = 0;
+  cfg.maxAgeSecs = 0;
+  cfg.sharedRing = false;
+  cfg.formatWorkers = 0;
+  cfg.spillMaxQueued = 0;
+  return cfg;
+}
+
+int lg_append_sink(LoggerConfig* config, FILE* f, LgOutType type) {
+  return lg_append_sink_filtered(config, f, type, LG_INFO, 0);
+}
+
+int lg_append_sink_filtered(LoggerConfig* config, FILE* f, LgOutType type,
+                            LgLogLevel min_level, uint32_t level_mask) {
+  if (!config) return false;
+  if (config->sinks.count >= LOGGER_MAX_SINKS) return false;
+  config->sinks.items[config->sinks.count++] =
+    LG_STRUCT(LgSink, f, type, min_level, level_mask, NULL);
+  return true;
+}
+
+int lg_append_file_sink(LoggerConfig* config, LgFile* f, LgOutType type) {
+  if (!config || !f) return false;
+  if (config->sinks.count >= LOGGER_MAX_SINKS) return false;
+  config->sinks.items[config->sinks.count++] =
+    LG_STRUCT(LgSink, NULL, type, LG_INFO, 0, f);
+  return true;
+}
+
+int lg_add_sink(Logger* inst, FILE* f, LgOutType type)
+{
+  return lg_add_sink_filtered(inst, f, type, LG_INFO, 0);
+}
+
+int lg_add_sink_filtered(Logger* inst, FILE* f, LgOutType type,
+                         LgLogLevel min_level, uint32_t level_mask)
+{
+  if (!f) return false;
+  return lgi_sinks_add(inst, LG_STRUCT(LgSink, f, type, min_level, level_mask, NULL));
+}
+
+int lg_add_file_sink(Logger* inst, LgFile* f, LgOutType type)
+{
+  if (!f) return false;
+  return lgi_sinks_add(inst, LG_STRUCT(LgSink, NULL, type, LG_INFO, 0, f));
+}
+
+int lg_remove_sink(Logger* inst, FILE* f)
+{
+  if (!f) return false;
+  LgSink key = LG_STRUCT(LgSink, f, LG_OUT_TTY, LG_INFO, 0, NULL);
+  return lgi_sinks_remove(inst, &key);
+}
+
+int lg_remove_file_sink(Logger* inst, LgFile* f)
+{
+  if (!f) return false;
+  LgSink key = LG_STRUCT(LgSink, NULL, LG_OUT_TTY, LG_INFO, 0, f);
+  return lgi_sinks_remove(inst, &key);
+}
+
+// publishes a copy of the current table with the sink added
+LOGGER_INTERNAL int lgi_sinks_add(Logger* inst, LgSink sink)
+{
+  if (!inst) return false;
+  if ((int)sink.type < 0 || sink.type >= LOGGER_MAX_OUT_TYPES) return false;
+  // lg_destroy frees the table, it waits for the ones that are in
+  if (!lgi_enter(inst)) return false;
+
+  lgi_spin_lock(&inst->sinks_lock);
+  LgSinkTable* cur = atomic_load_explicit(&inst->sinks, memory_order_acquire);
+  LgSinkTable* next = NULL;
+  if (cur->count >= LOGGER_MAX_SINKS + 1) {
+    LG_DEBUG_ERR("Sink table is full!");
+  } else if ((next = lgi_sink_table_new(cur, NULL))) {
+    lgi_sink_table_add(next, sink);
+    next->prev = cur;
+    atomic_store_explicit(&inst->sinks, next, memory_order_release);
+  }
+  lgi_spin_unlock(&inst->sinks_lock);
+  lgi_exit(inst);
+  return next != NULL;
+}
+
+// publishes a copy of the current table without the sink
+LOGGER_INTERNAL int lgi_sinks_remove(Logger* inst, const LgSink* sink)
+{
+  if (!inst || !lgi_enter(inst)) return false;
+
+  lgi_spin_lock(&inst->sinks_lock);
+  LgSinkTable* cur = atomic_load_explicit(&inst->sinks, memory_order_acquire);
+  LgSinkTable* next = NULL;
+  uint32_t bit = 0;
+  for (size_t i = 0; i < cur->count; i++) {
+    const LgSink* it = &cur->items[i];
+    if (it->file == sink->file && it->handle == sink->handle) bit = cur->bits[i];
+  }
+  if (!bit) {
+    LG_DEBUG_ERR("There's no such sink to remove!");
+  } else if ((next = lgi_sink_table_new(cur, sink))) {
+    next->prev = cur;
+    atomic_store_explicit(&inst->sinks, next, memory_order_release);
+  }
+  lgi_spin_unlock(&inst->sinks_lock);
+
+  // next sink takes its bit, categories that named this one don't get that one
+  if (next) {
+    lgi_spin_lock(&inst->cat_lock);
+    for (size_t i = 0; i < inst->cat_count; i++) {
+      LgCategory* c = &inst->categories[i];
+      if (c->own_sinks && c->sinks_set != ~0u) c->sinks_set &= ~bit;
+    }
+    lgi_categories_update(inst);
+    lgi_spin_unlock(&inst->cat_lock);
+  }
+  lgi_exit(inst);
+  return next != NULL;
+}
+
+// copy of src (NULL = empty one) without skip, sinks keep their mask bits
+LOGGER_INTERNAL LgSinkTable* lgi_sink_table_new(const LgSinkTable* src, const LgSink* skip)
+{
+  LgSinkTable* t = (LgSinkTable*)calloc(1, sizeof(LgSinkTable));
+  if (!t || !src) return t;
+  for (size_t i = 0; i < src->count; i++) {
+    const LgSink* it = &src->items[i];
+    if (skip && it->file == skip->file && it->handle == skip->handle) continue;
+    lgi_sink_table_put(t, *it, src->bits[i]);
+  }
+  return t;
+}
+
+// appends the sink with the lowest mask bit that's free
+LOGGER_INTERNAL void lgi_sink_table_add(LgSinkTable* t, LgSink sink)
+{
+  uint32_t used = 0;
+  for (size_t i = 0; i < t->count; i++) used |= t->bits[i];
+  uint32_t bit = 1;
+  while (used & bit) bit <<= 1;
+  lgi_sink_table_put(t, sink, bit);
+}
+
+// resolves its filter into a level bitset
+LOGGER_INTERNAL void lgi_sink_table_put(LgSinkTable* t, LgSink sink, uint32_t bit)
+{
+  uint32_t levels = lgi_level_bits(sink.minLevel, sink.levelMask);
+  t->levels[t->count] = levels;
+  t->bits[t->count] = bit;
+  t->items[t->count++] = sink;
+  t->type_levels[sink.type] |= levels;
+  if (levels) t->out_needed |= (1u << sink.type);
+}
+
+LOGGER_INTERNAL bool lgi_sink_table_has(const LgSinkTable* t, const LgSink* s)
+{
+  for (size_t i = 0; i < t->count; i++) {
+    if (t->items[i].file == s->file && t->items[i].handle == s->handle)
+      return true;
+  }
+  return false;
+}
+
+// closes the file unless it's a standard stream, those are just flushed
+LOGGER_INTERNAL bool lgi_sink_close(const LgSink* s)
+{
+  if (s->handle) return lg_file_close(s->handle) != 0;
+  FILE* f = s->file;
+  if (!f) return true;
+  if (f == stderr || f == stdout || f == stdin) {
+    fflush(f);
+    return true;
+  }
+  return fclose(f) == 0;
+}
+
+/*
+  Writer switches to the next table, all of the older tables
+  are unreachable now, files that next doesn't have anymore are closed
+*/
+LOGGER_INTERNAL bool lgi_sinks_retire(Logger* inst, LgSinkTable* next)
+{
+  bool ok = true;
+  LgSinkTable* t = next->prev;
+  while (t) {
+    LgSinkTable* older = t->prev;
+    for (size_t i = 0; i < t->count; i++) {
+      const LgSink* s = &t->items[i];
+      if ((!s->file && !s->handle) || lgi_sink_table_has(next, s)) continue;
+      // newer retired tables already closed it
+      bool seen = false;
+      for (LgSinkTable* n = next->prev; n != t; n = n->prev) {
+        if (lgi_sink_table_has(n, s)) { seen = true; break; }
+      }
+      if (!seen && !lgi_sink_close(s)) ok = false;
+    }
+    t = older;
+  }
+
+  // free them after closing, the seen check walks the chain
+  t = next->prev;
+  while (t) {
+    LgSinkTable* older = t->prev;
+    free(t);
+    t = older;
+  }
+  next->prev = NULL;
+  inst->sinks_cur = next;
+  return ok;
+}
+
+// writer is idle, staged files show their tails and do interval syncs
+LOGGER_INTERNAL void lgi_sinks_tick(LgSinkTable* t)
+{
+  for (size_t i = 0; i < t->count; i++) {
+    if (t->items[i].handle) lgi_file_tick(t->items[i].handle, true);
+  }
+}
+
+LgFile* lg_file_open(const char* path, LgFileOptions opts)
+{
+  if (!path) return NULL;
+  LgFile* f = (LgFile*)calloc(1, sizeof(LgFile));
+  if (!f) return NULL;
+  f->opts = opts;
+  f->dfd = -1;
+
+  // posix_memalign isn't there on every feature level, align it by hand
+  f->raw = (char*)malloc(LOGGER_DIO_STAGE_SIZE + LOGGER_DIO_ALIGN);
+  if (!f->raw) goto fail;
+  f->stage = (char*)(((uintptr_t)f->raw + LOGGER_DIO_ALIGN - 1)
+                     & ~(uintptr_t)(LOGGER_DIO_ALIGN - 1));
+
+  f->fd = LGI_FD_OPEN(path);
+  if (f->fd < 0) {
+    LG_DEBUG_ERR("Cannot open the log file: %s", path);
+    goto fail;
+  }
+
+  if (opts.directIO) {
+    // second fd on the same file, partial blocks can't go through it
+#if defined(O_DIRECT)
+    f->dfd = open(path, O_WRONLY | O_DIRECT);
+#elif defined(F_NOCACHE)
+    f->dfd = open(path, O_WRONLY);
+    if (f->dfd >= 0 && fcntl(f->dfd, F_NOCACHE, 1) != 0) {
+      close(f->dfd);
+      f->dfd = -1;
+    }
+#endif
+    if (f->dfd < 0) {
+      LG_DEBUG("No direct I/O for %s, using normal writes", path);
+    }
+  }
+  return f;
+
+fail:
+  free(f->raw);
+  free(f);
+  return NULL;
+}
+
+int lg_file_close(LgFile* f)
+{
+  if (!f) return false;
+  bool ok = lgi_file_flush(f, true);
+  if (f->opts.sync != LG_SYNC_NONE || f->opts.dropCache)
+    ok = LGI_FD_SYNC(f->fd) == 0 && ok;
+#ifdef POSIX_FADV_DONTNEED
+  // file is done (rotated or removed), none of it is worth caching
+  if (f->opts.dropCache) posix_fadvise(f->fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+  if (f->dfd >= 0) LGI_FD_CLOSE(f->dfd);
+  ok = LGI_FD_CLOSE(f->fd) == 0 && ok;
+  free(f->raw);
+  free(f);
+  return ok;
+}
+
+// writes it all, direct fd falls back to the buffered one if it's refused
+LOGGER_INTERNAL bool lgi_file_pwrite(LgFile* f, const char* p, size_t n,
+                                     uint64_t off, bool direct)
+{
+  int fd = direct && f->dfd >= 0 ? f->dfd : f->fd;
+  while (n > 0) {
+    ssize_t w = lgi_pwrite(fd, p, n, off);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      if (fd == f->dfd && errno == EINVAL) {
+        LG_DEBUG_ERR("Direct write is refused, using normal writes");
+        LGI_FD_CLOSE(f->dfd);
+        f->dfd = -1;
+        fd = f->fd;
+        continue;
+      }
+      return false;
+    }
+    p += w;
+    n -= (size_t)w;
+    off += (uint64_t)w;
+  }
+  return true;
+}
+
+/*
+  Drops the written range from page cache. Dirty pages are only queued
+  for writeback by the advice, so unsynced ranges get advised once more
+*/
+LOGGER_INTERNAL void lgi_file_drop_cache(LgFile* f, bool synced)
+{
+#ifdef POSIX_FADV_DONTNEED
+  uint64_t end = (f->stage_off + f->shown) & ~(uint64_t)(LOGGER_DIO_ALIGN - 1);
+  if (end > f->drop_from)
+    posix_fadvise(f->fd, (off_t)f->drop_from, (off_t)(end - f->drop_from),
+                  POSIX_FADV_DONTNEED);
+  f->drop_from = synced ? end : f->drop_mark;
+  f->drop_mark = end;
+#else
+  LG_UNUSED(f);
+  LG_UNUSED(synced);
+#endif
+}
+
+/*
+  Writes full blocks of the stage (through O_DIRECT fd if there's one)
+  and keeps the partial block staged for the next direct write.
+  tail = write that partial block through the buffered fd too
+*/
+LOGGER_INTERNAL bool lgi_file_flush(LgFile* f, bool tail)
+{
+  bool ok = true;
+  size_t full = f->len;
+  if (f->dfd >= 0) full &= ~(size_t)(LOGGER_DIO_ALIGN - 1);
+
+  if (full > 0) {
+    ok = lgi_file_pwrite(f, f->stage, full, f->stage_off, true);
+    f->len -= full;
+    f->shown = f->shown > full ? f->shown - full : 0;
+    memmove(f->stage, f->stage + full, f->len);
+    f->stage_off += full;
+    if (f->opts.dropCache) lgi_file_drop_cache(f, false);
+  }
+  if (tail && f->len > f->shown) {
+    ok = lgi_file_pwrite(f, f->stage + f->shown, f->len - f->shown,
+                         f->stage_off + f->shown, false) && ok;
+    f->shown = f->len;
+  }
+  return ok;
+}
+
+LOGGER_INTERNAL bool lgi_file_put(LgFile* f, const char* p, size_t n)
+{
+  bool ok = true;
+  while (n > 0) {
+    size_t room = LOGGER_DIO_STAGE_SIZE - f->len;
+    size_t k = n < room ? n : room;
+    memcpy(f->stage + f->len, p, k);
+    f->len += k;
+    p += k;
+    n -= k;
+    if (f->len == LOGGER_DIO_STAGE_SIZE) ok = lgi_file_flush(f, false) && ok;
+  }
+  return ok;
+}
+
+LOGGER_INTERNAL bool lgi_file_sync(LgFile* f)
+{
+  // staged bytes have to be on the file first
+  bool ok = lgi_file_flush(f, true);
+  ok = LGI_FD_SYNC(f->fd) == 0 && ok;
+  f->unsynced = 0;
+  if (f->opts.dropCache) lgi_file_drop_cache(f, true);
+  return ok;
+}
+
+// applies the durability policy, idle = writer has nothing else to do
+LOGGER_INTERNAL bool lgi_file_tick(LgFile* f, bool idle)
+{
+  bool ok = true;
+  if (idle && f->len > f->shown) ok = lgi_file_flush(f, true);
+  if (f->unsynced == 0) return ok;
+
+  switch (f->opts.sync) {
+  case LG_SYNC_BYTES:
+    if (f->unsynced >= f->opts.syncBytes) ok = lgi_file_sync(f) && ok;
+    break;
+  case LG_SYNC_INTERVAL:
+    if (lgi_now_ms() - f->dirty_ms >= f->opts.syncMillis)
+      ok = lgi_file_sync(f) && ok;
+    break;
+  default:
+    break;
+  }
+  return ok;
+}
+
+int lg_get_time_str(Logger* inst, char* buf)
+{
+  if (!inst || !buf) return false;
+  // own cache, writer's one can't be shared with other threads
+  LgTimeCache c;
+  c.valid = false;
+  lgi_time_render(&c, lgi_clock_ns(inst->timePrecision != LG_TIME_MS),
+                  inst->timeStyle, inst->timePrecision, inst->isLocalTime, buf);
+  return true;
+}
+
+// gmtime without libc's tz lock, signal drain renders UTC with it too
+LOGGER_INTERNAL void lgi_utc_tm(int64_t sec, struct tm* tm)
+{
+  int64_t days = sec / 86400, rem = sec % 86400;
+  if (rem < 0) {
+    rem += 86400;
+    days--;
+  }
+  tm->tm_hour = (int)(rem / 3600);
+  tm->tm_min = (int)(rem / 60 % 60);
+  tm->tm_sec = (int)(rem % 60);
+
+  // civil date of days since 1970-01-01, eras of 400 years
+  days += 719468;
+  int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  int64_t doe = days - era * 146097;
+  int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  int64_t mp = (5 * doy + 2) / 153;
+  int64_t m = mp < 10 ? mp + 3 : mp - 9;
+  tm->tm_year = (int)(yoe + era * 400 + (m <= 2) - 1900);
+  tm->tm_mon = (int)(m - 1);
+  tm->tm_mday = (int)(doy - (153 * mp + 2) / 5 + 1);
+}
+
+// renders the part of time_str that only changes once a second
+LOGGER_INTERNAL void lgi_time_prefix(LgTimeCache* c, int64_t sec,
+                                     LgTimeStyle style, bool local)
+{
+  char* p = c->prefix;
+  c->sec = sec;
+  c->valid = true;
+  c->suffix_len = 0;
+
+  if (style == LG_TIME_EPOCH) {
+    char digits[24];
+    int n = 0;
+    uint64_t v = sec < 0 ? 0 : (uint64_t)sec;
+    do {
+      digits[n++] = (char)('0' + v % 10);
+      v /= 10;
+    } while (v);
+    while (n > 0) *p++ = digits[--n];
+    *p++ = '.';
+    c->prefix_len = (size_t)(p - c->prefix);
+    return;
+  }
+
+  time_t t = (time_t)sec;
+  struct tm tm;
+  if (local) LGI_LOCALTIME(&t, &tm);
+  else lgi_utc_tm(sec, &tm);
+
+  bool iso = style == LG_TIME_ISO8601;
+  lgi_time_write4(p, tm.tm_year + 1900);
+  p[4]  = iso ? '-' : '.';
+  lgi_time_write2(p + 5, tm.tm_mon + 1);
+  p[7]  = iso ? '-' : '.';
+  lgi_time_write2(p + 8, tm.tm_mday);
+  p[10] = iso ? 'T' : '-';
+  lgi_time_write2(p + 11, tm.tm_hour);
+  p[13] = iso ? ':' : '.';
+  lgi_time_write2(p + 14, tm.tm_min);
+  p[16] = iso ? ':' : '.';
+  lgi_time_write2(p + 17, tm.tm_sec);
+  p[19] = '.';
+  c->prefix_len = 20;
+  if (!iso) return;
+
+  if (!local) {
+    c->suffix[0] = 'Z';
+    c->suffix_len = 1;
+    return;
+  }
+
+  // offset from the difference of local and UTC wall clocks
+  struct tm utc;
+  LGI_GMTIME(&t, &utc);
+  long days = tm.tm_yday - utc.tm_yday;
+  if (tm.tm_year != utc.tm_year) days = tm.tm_year > utc.tm_year ? 1 : -1;
+  long off = ((days * 24 + tm.tm_hour - utc.tm_hour) * 60 + tm.tm_min - utc.tm_min);
+  c->suffix[0] = off < 0 ? '-' : '+';
+  if (off < 0) off = -off;
+  lgi_time_write2(c->suffix + 1, (int)(off / 60));
+  c->suffix[3] = ':';
+  lgi_time_write2(c->suffix + 4, (int)(off % 60));
+  c->suffix_len = 6;
+}
+
+/*
+  Renders ts into buf, cached prefix is copied and only the
+  sub-second digits (and the offset) are written per call
+*/
+LOGGER_INTERNAL size_t lgi_time_render(LgTimeCache* c, uint64_t ts, LgTimeStyle style,
+                                       LgTimePrecision prec, bool local, char* buf)
+{
+  int64_t sec = (int64_t)(ts / 1000000000u);
+  uint32_t nsec = (uint32_t)(ts % 1000000000u);
+  if (!c->valid || c->sec != sec) lgi_time_prefix(c, sec, style, local);
+
+  char* p = buf;
+  memcpy(p, c->prefix, c->prefix_len);
+  p += c->prefix_len;
+  switch (prec) {
+  case LG_TIME_NS:
+    lgi_time_writen(p, nsec, 9);
+    p += 9;
+    break;
+  case LG_TIME_US:
+    lgi_time_writen(p, nsec / 1000u, 6);
+    p += 6;
+    break;
+  case LG_TIME_MS:
+  default:
+    lgi_time_writen(p, nsec / 1000000u, 3);
+    p += 3;
+    break;
+  }
+  memcpy(p, c->suffix, c->suffix_len);
+  p += c->suffix_len;
+  *p = '\0';
+  return (size_t)(p - buf);
+}
+
+LOGGER_INTERNAL int lgi_check_dir(const char* path)
+{
+#ifdef _WIN32
+  DWORD attr = GetFileAttributesA(path);
+  if (attr == INVALID_FILE_ATTRIBUTES) return 0;
+  if (attr & FILE_ATTRIBUTE_DIRECTORY)
+    return 1;
+  return -1; 
+#else
+  struct stat st;
+  if (stat(path, &st) != 0) return 0;  // not exists
+  if (S_ISDIR(st.st_mode)) return 1;   // exists AND directory (valid)
+  return -1;                           // exists but not a directory
+#endif
+}
+
+LOGGER_INTERNAL bool lgi_mkdir_p(char* path)
+{
+  if (!path || !*path) return false;
+
+  // go char by char
+  for (char* p = path + 1; *p; p++) {
+    if (*p != LOGGER_PATH_SEP) continue;
+    *p = '\0';
+    LG_DEBUG("Trying to create: %s", path);
+    int status = LOGGER_MKDIR(path);
+    if (status != 0 && errno != EEXIST) {
+      LG_DEBUG_ERR("Failed to create path: %s", path);
+      return false;
+    }
+    *p = LOGGER_PATH_SEP;
+  }
+  return true;
+}
+
+LOGGER_INTERNAL bool lgi_logs_push(LgLogList* l, const char* name, int64_t mtime, uint64_t bytes)
+{
+  if (strlen(name) >= LOGGER_LOG_NAME_SIZE) return true; // not one of ours
+  if (l->count == l->cap) {
+    size_t cap = l->cap ? l->cap * 2 : 64;
+    LgLogEntry* items = (LgLogEntry*)realloc(l->items, cap * sizeof(LgLogEntry));
+    if (!items) return false;
+    l->items = items;
+    l->cap = cap;
+  }
+  LgLogEntry* e = &l->items[l->count++];
+  e->mtime = mtime;
+  e->bytes = bytes;
+  strcpy(e->name, name);
+  return true;
+}
+
+LOGGER_INTERNAL int lgi_logs_cmp(const void* a, const void* b)
+{
+  const LgLogEntry* x = (const LgLogEntry*)a;
+  const LgLogEntry* y = (const LgLogEntry*)b;
+  if (x->mtime != y->mtime) return x->mtime < y->mtime ? -1 : 1;
+  return strcmp(x->name, y->name);
+}
+
+// .log files of dir, oldest (mtime) first
+LOGGER_INTERNAL bool lgi_logs_scan(const char* dir, LgLogList* list) {
+  list->count = 0;
+#ifdef _WIN32
+  char pattern[PATH_MAX];
+  snprintf(pattern, sizeof(pattern), "%s*" LOGGER_FILE_EXT, dir);
+
+  WIN32_FIND_DATAA fdata;
+  HANDLE h = FindFirstFileA(pattern, &fdata);
+  if (h == INVALID_HANDLE_VALUE) return GetLastError() == ERROR_FILE_NOT_FOUND;
+
+  bool ok = true;
+  do {
+    // FILETIME is 100ns since 1601
+    uint64_t ft = ((uint64_t)fdata.ftLastWriteTime.dwHighDateTime << 32) |
+                  fdata.ftLastWriteTime.dwLowDateTime;
+    uint64_t bytes = ((uint64_t)fdata.nFileSizeHigh << 32) | fdata.nFileSizeLow;
+    int64_t mtime = (int64_t)((ft - 116444736000000000ULL) / 10000000u);
+    ok = lgi_logs_push(list, fdata.cFileName, mtime > 0 ? mtime : 1, bytes) && ok;
+  } while (ok && FindNextFileA(h, &fdata));
+
+  FindClose(h);
+  if (!ok) return false;
+#else
+  DIR* d = opendir(dir);
+  if (!d) return false;
+
+  bool ok = true;
+  struct dirent* entry;
+  while (ok && (entry = readdir(d)) != NULL) {
+    const char* name = entry->d_name;
+    size_t len = strlen(name);
+    if (len <= LOGGER_FILE_EXT_SZ ||
+        memcmp(name + len - LOGGER_FILE_EXT_SZ, LOGGER_FILE_EXT, LOGGER_FILE_EXT_SZ) != 0)
+      continue;
+
+    char full_path[PATH_MAX];
+    int n = snprintf(full_path, sizeof(full_path), "%s%s", dir, name);
+    if (n < 0 || (size_t)n >= sizeof(full_path)) continue;
+    struct stat st;
+    if (stat(full_path, &st) != 0) continue;
+    // 0 is "not known", a file from 1970 is just old
+    ok = lgi_logs_push(list, name, st.st_mtime > 0 ? (int64_t)st.st_mtime : 1,
+                       (uint64_t)st.st_size);
+  }
+
+  if (closedir(d) != 0 || !ok) return false;
+#endif
+  if (list->count > 1) qsort(list->items, list->count, sizeof(LgLogEntry), lgi_logs_cmp);
+  return true;
+}
+
+/*
+  Manifest is "lgmanifest 1" and then "<mtime> <bytes> <name>" lines,
+  oldest first. False = missing, stale or broken, scan the dir then
+*/
+LOGGER_INTERNAL bool lgi_manifest_load(const LgRetention* r, LgLogList* list)
+{
+#ifdef LGI_HAS_MANIFEST
+  char path[PATH_MAX];
+  char line[LOGGER_LOG_NAME_SIZE + 64];
+  int n = snprintf(path, sizeof(path), "%s" LOGGER_MANIFEST_NAME, r->dir);
+  if (n <= 0 || (size_t)n >= sizeof(path) || !r->dir_known) return false;
+
+  struct stat st;
+  if (stat(path, &st) != 0) return false;
+  if ((int64_t)LGI_ST_MTIM(st).tv_sec != r->dir_sec ||
+      (long)LGI_ST_MTIM(st).tv_nsec != r->dir_nsec)
+    return false;
+
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  bool ok = fgets(line, sizeof(line), f) && strcmp(line, "lgmanifest 1\n") == 0;
+  list->count = 0;
+  while (ok && fgets(line, sizeof(line), f)) {
+    long long mtime;
+    unsigned long long bytes;
+    int off = 0;
+    size_t len = strlen(line);
+    if (len == 0 || line[len - 1] != '\n') {
+      ok = false;
+      break;
+    }
+    line[len - 1] = '\0';
+    if (sscanf(line, "%lld %llu %n", &mtime, &bytes, &off) != 2 || off == 0 ||
+        line[off] == '\0' || strchr(line + off, LOGGER_PATH_SEP)) {
+      ok = false;
+      break;
+    }
+    ok = lgi_logs_push(list, line + off, (int64_t)mtime, (uint64_t)bytes);
+  }
+  fclose(f);
+  return ok;
+#else
+  // no cheap freshness check, scan every time
+  LG_UNUSED(r);
+  LG_UNUSED(list);
+  return false;
+#endif
+}
+
+// temp file and rename, then its mtime is set to the dir's one
+LOGGER_INTERNAL bool lgi_manifest_save(const LgRetention* r, const LgLogList* list)
+{
+#ifdef LGI_HAS_MANIFEST
+  char path[PATH_MAX];
+  char tmp[PATH_MAX];
+  int n = snprintf(path, sizeof(path), "%s" LOGGER_MANIFEST_NAME, r->dir);
+  if (n <= 0 || (size_t)n >= sizeof(path)) return false;
+  n = snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  if (n <= 0 || (size_t)n >= sizeof(tmp)) return false;
+
+  FILE* f = fopen(tmp, "wb");
+  if (!f) return false;
+  bool ok = fputs("lgmanifest 1\n", f) >= 0;
+  for (size_t i = 0; ok && i < list->count; i++) {
+    const LgLogEntry* e = &list->items[i];
+    ok = fprintf(f, "%lld %llu %s\n", (long long)e->mtime,
+                 (unsigned long long)e->bytes, e->name) > 0;
+  }
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp, path) != 0) {
+    remove(tmp);
+    return false;
+  }
+
+  struct stat st;
+  struct timespec ts[2];
+  if (stat(r->dir, &st) != 0) return false;
+  ts[0].tv_sec = 0;
+  ts[0].tv_nsec = UTIME_OMIT;
+  ts[1] = LGI_ST_MTIM(st);
+  return utimensat(AT_FDCWD, path, ts, 0) == 0;
+#else
+  LG_UNUSED(r);
+  LG_UNUSED(list);
+  return true;
+#endif
+}
+
+LOGGER_INTERNAL bool lgi_log_remove(const LgRetention* r, const char* name)
+{
+  char path[PATH_MAX];
+  int n = snprintf(path, sizeof(path), "%s%s", r->dir, name);
+  if (n <= 0 || (size_t)n >= sizeof(path)) return false;
+  if (remove(path) != 0 && errno != ENOENT) return false;
+  // and its index if there's any
+  n = snprintf(path, sizeof(path), "%s%s" LOGGER_IDX_EXT, r->dir, name);
+  if (n > 0 && (size_t)n < sizeof(path)) remove(path);
+  return true;
+}
+
+// size of the log with its index, false = log is gone
+LOGGER_INTERNAL bool lgi_log_stat(const LgRetention* r, LgLogEntry* e)
+{
+  char path[PATH_MAX];
+  struct stat st;
+  int n = snprintf(path, sizeof(path), "%s%s", r->dir, e->name);
+  if (n <= 0 || (size_t)n >= sizeof(path) || stat(path, &st) != 0) return false;
+  e->mtime = st.st_mtime > 0 ? (int64_t)st.st_mtime : 1;
+  e->bytes = (uint64_t)st.st_size;
+  n = snprintf(path, sizeof(path), "%s%s" LOGGER_IDX_EXT, r->dir, e->name);
+  if (n > 0 && (size_t)n < sizeof(path) && stat(path, &st) == 0)
+    e->bytes += (uint64_t)st.st_size;
+  return true;
+}
+
+// one pass over the list, oldest first, then the new manifest
+LOGGER_INTERNAL void lgi_retention_run(LgRetention* r)
+{
+  LgLogList list = { NULL, 0, 0 };
+  size_t kept = 0;
+  size_t files;
+  uint64_t total = 0;
+  int64_t oldest_ok = r->max_age ? (int64_t)time(NULL) - (int64_t)r->max_age : 0;
+  int spins = 0;
+  while (atomic_exchange_explicit(&lgi_retention_lock, true, memory_order_acquire))
+    lgi_adaptive_wait(&spins);
+
+  if (!lgi_manifest_load(r, &list) && !lgi_logs_scan(r->dir, &list)) {
+    LG_DEBUG_ERR("Cannot list the logs dir: %s", r->dir);
+    goto done;
+  }
+
+  // new file goes last and its size is looked at next time, it's open
+  for (size_t i = 0; i < list.count; i++) {
+    LgLogEntry* e = &list.items[i];
+    if (strcmp(e->name, r->name) == 0) continue;
+    // ones that were open last time
+    if (e->mtime == 0 && !lgi_log_stat(r, e)) continue;
+    list.items[kept++] = *e;
+  }
+  list.count = kept;
+  if (!lgi_logs_push(&list, r->name, 0, 0)) goto done;
+
+  files = list.count;
+  for (size_t i = 0; i < list.count; i++) total += list.items[i].bytes;
+
+  kept = 0;
+  for (size_t i = 0; i + 1 < list.count; i++) {
+    LgLogEntry* e = &list.items[i];
+    bool over = (r->max_files > 0 && files > (size_t)r->max_files) ||
+                (r->max_bytes > 0 && total > (uint64_t)r->max_bytes) ||
+                (r->max_age > 0 && e->mtime < oldest_ok);
+    if (over && lgi_log_remove(r, e->name)) {
+      files--;
+      total -= e->bytes;
+      continue;
+    }
+    list.items[kept++] = *e;
+  }
+  list.items[kept++] = list.items[list.count - 1];
+  list.count = kept;
+
+  if (!lgi_manifest_save(r, &list)) {
+    LG_DEBUG_ERR("Cannot write the logs manifest: %s", r->dir);
+  }
+
+done:
+  free(list.items);
+  atomic_store_explicit(&lgi_retention_lock, false, memory_order_release);
+}
+
+LOGGER_INTERNAL void* lgi_retention_worker(void* arg)
+{
+  lgi_retention_run((LgRetention*)arg);
+  free(arg);
+  return NULL;
+}
+
+// takes r, runs it on the caller if there's no thread for it
+LOGGER_INTERNAL void lgi_retention_start(Logger* inst, LgRetention* r)
+{
+  inst->retention_on = pthread_create(&inst->retention_th, NULL, lgi_retention_worker, r) == 0;
+  if (!inst->retention_on) lgi_retention_worker(r);
+}
+
+LOGGER_INTERNAL bool lgi_normalize_path(const char* path, char* out, size_t size)
+{
+  if (!path || !*path) return false;
+  char* dst = out;
+  char* end = out + size - 1;
+
+  for (const char* src = path; *src && dst < end; src++) {
+    // double slash skip
+    if (*src == LOGGER_PATH_SEP
+        && dst != out
+        && *(dst-1) == LOGGER_PATH_SEP) continue;
+    *dst++ = *src;
+  }
+  *dst = '\0';
+
+  // add trailing slash
+  if (dst + 1 >= end) return false;
+  size_t len = dst - out;
+  out[len] = LOGGER_PATH_SEP;
+  out[len + 1] = '\0';
+  return true;
+}
+
+void lg_str_format_into(LgString* s, const char* fmt, ...)
+{
+  if (!s) return;
+  size_t cap = sizeof(s->data);
+
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(s->data, cap, fmt, ap);
+  va_end(ap);
+
+  // guarentees \n at the end
+  if (n < 0) {
+    s->len = 0;
+  } else if ((size_t)n >= cap) {
+    if (cap >= 2) {
+      s->data[cap - 2] = '\n';
+      s->data[cap - 1] = '\0';
+      s->len = cap - 1;
+    } else {
+      s->len = 0;
+    }
+  } else {
+    s->len = (size_t)n;
+  }
+}
+
+void lg_str_write_into(LgString* s, const char* str)
+{
+  if (!str || !s) return;
+  size_t len = strlen(str);
+  if (len == 0) return;
+  if (len >= sizeof(s->data)) len = sizeof(s->data) - 2;
+  memcpy(s->data, str, len);
+  s->data[len - 1] = '\n';
+  s->data[len] = '\0';
+  s->len = len;
+}
+
+LOGGER_INTERNAL int lgi_def_format_msg(
+  const char* time_str, LgLogLevel level,
+  const char* msg, uint32_t needed, LgMsgPack pack)
+{
+  const char* level_str = lg_lvl_to_str(level);
+  const LgCallSite* site = lgi_fmt_ctx.show_site ? lgi_fmt_ctx.site : NULL;
+  const char* cat = lgi_fmt_ctx.cat ? lgi_fmt_ctx.cat->name : NULL;
+
+  // Colorized TTY formatting (you can disable)
+  if (LOGGER_CONTAINS_FLAG(needed, LG_OUT_TTY)) {
+    LgString* s = &pack[LG_OUT_TTY];
+    char* p = s->data;
+    char* end = p + sizeof(s->data) - 1;
+#ifndef LOGGER_DONT_COLORIZE
+    const char* clr;
+    switch (level) {
+      case LG_ERROR:   clr = LOGGER_CLR_RED;    break;
       case LG_INFO:    clr = LOGGER_CLR_GREEN;   break;
       case LG_WARNING: clr = LOGGER_CLR_YELLOW;  break;
       default:         clr = LOGGER_CLR_RST;     break;
@@ -1152,130 +4471,1416 @@ LOGGER_INTERNAL int lgi_def_format_msg(
     lgi_str_append_n(&p, end, " [");
     lgi_str_append_n(&p, end, level_str);
     lgi_str_append_n(&p, end, "] ");
-#endif
+#endif
+    if (cat) {
+      lgi_str_append_n(&p, end, "[");
+      lgi_str_append_n(&p, end, cat);
+      lgi_str_append_n(&p, end, "] ");
+    }
+    if (site) {
+      lgi_str_append_n(&p, end, site->file);
+      lgi_str_append_n(&p, end, ":");
+      lgi_str_append_uint(&p, end, (unsigned long)site->line);
+      lgi_str_append_n(&p, end, ": ");
+    }
+    lgi_str_append_n(&p, end, msg);
+    lgi_str_close(&p, end);
+    s->len = (size_t)(p - s->data);
+  }
+
+  // Raw message and other specifiers, no color or markup language
+  if (LOGGER_CONTAINS_FLAG(needed, LG_OUT_FILE)) {
+    LgString* s = &pack[LG_OUT_FILE];
+    char* p = s->data;
+    char* end = p + sizeof(s->data) - 1;
+    lgi_str_append_n(&p, end, time_str);
+    lgi_str_append_n(&p, end, " [");
+    lgi_str_append_n(&p, end, level_str);
+    lgi_str_append_n(&p, end, "] ");
+    if (cat) {
+      lgi_str_append_n(&p, end, "[");
+      lgi_str_append_n(&p, end, cat);
+      lgi_str_append_n(&p, end, "] ");
+    }
+    if (site) {
+      lgi_str_append_n(&p, end, site->file);
+      lgi_str_append_n(&p, end, ":");
+      lgi_str_append_uint(&p, end, (unsigned long)site->line);
+      lgi_str_append_n(&p, end, ": ");
+    }
+    lgi_str_append_n(&p, end, msg);
+    lgi_str_close(&p, end);
+    s->len = (size_t)(p - s->data);
+  }
+
+  // JSON style formatting
+  if (LOGGER_CONTAINS_FLAG(needed, LG_OUT_NET)) {
+    LgString* s = &pack[LG_OUT_NET];
+    char* p = s->data;
+    char* end = p + sizeof(s->data) - 1;
+    lgi_str_append_n(&p, end, "{\"timestamp\":\"");
+    lgi_str_append_n(&p, end, time_str);
+    lgi_str_append_n(&p, end, "\",\"level\":\"");
+    lgi_str_append_n(&p, end, level_str);
+    if (cat) {
+      lgi_str_append_n(&p, end, "\",\"category\":\"");
+      lgi_str_append_n(&p, end, cat);
+    }
+    if (site) {
+      lgi_str_append_n(&p, end, "\",\"file\":\"");
+      lgi_str_append_n(&p, end, site->file);
+      lgi_str_append_n(&p, end, "\",\"line\":");
+      lgi_str_append_uint(&p, end, (unsigned long)site->line);
+      lgi_str_append_n(&p, end, ",\"func\":\"");
+      lgi_str_append_n(&p, end, site->func);
+    }
+    lgi_str_append_n(&p, end, "\",\"message\":\"");
     lgi_str_append_n(&p, end, msg);
+    lgi_str_append_n(&p, end, "\"}");
     lgi_str_close(&p, end);
     s->len = (size_t)(p - s->data);
   }
+  return true;
+}
+
+LOGGER_INTERNAL void lgi_queue_create(LogQueue* q) {
+  q->tail = 0;
+  atomic_store_explicit(&q->head, 0, memory_order_relaxed);
+
+  for (size_t i = 0; i < LOGGER_RING_SIZE; i++) {
+    LogSlot* s = lgi_slot_get(q, i);
+    atomic_store_explicit(&s->seq, i, memory_order_relaxed);
+    atomic_store_explicit(&s->owner, 0, memory_order_relaxed);
+  }
+
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+// claims a slot for producer, log policy is applied here
+LOGGER_INTERNAL LogSlot* lgi_queue_claim(Logger* inst, LogQueue* q, LgLogLevel level,
+                                         LgLogPolicy policy, size_t* out_pos)
+{
+  size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+  size_t seq;
+  LogSlot* s;
+  int spins = 0;
+  int owns = 0; // tries on the owner of a shared slot
+  bool blocked = false; // for the block probes only
+  for (;;) {
+    s = lgi_slot_get(q, pos);
+    seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t)(seq - pos);
+
+    if (diff == 0) {
+      if (inst->shm && !lgi_shm_own(q, s, pos, &owns)) {
+        pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        continue;
+      }
+      if (atomic_compare_exchange_weak_explicit(
+            &q->head, &pos, pos + 1,
+            memory_order_relaxed, memory_order_relaxed)) {
+        break; // claim success
+      }
+      // another producer claimed, retry
+      if (inst->shm) atomic_store_explicit(&s->owner, 0, memory_order_release);
+    } else if (diff < 0) {
+      // ring is full, nobody is going to empty a shared one after its writer
+      if (inst->shm && atomic_load_explicit(&inst->shm->closed, memory_order_relaxed)) {
+        lgi_count_drop(inst, level);
+        return NULL;
+      }
+      switch(policy) {
+      case LG_BLOCK:
+        if (!blocked) LGI_PROBE2(block_start, inst, level);
+        blocked = true;
+        lgi_adaptive_wait(&spins);
+        pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        break;
+      case LG_PRIORITY_BASED:
+        if (level == LG_ERROR) {
+          if (!blocked) LGI_PROBE2(block_start, inst, level);
+          blocked = true;
+          lgi_adaptive_wait(&spins);
+          pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+          break;
+        }
+        lgi_count_drop(inst, level);
+        return NULL;
+      case LG_SPILL:
+        return NULL; // caller spills it
+      default:
+        lgi_count_drop(inst, level);
+        return NULL;
+      }
+    } else {
+      pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    }
+  }
+
+  if (blocked) LGI_PROBE2(block_end, inst, level);
+  LGI_PROBE3(claim, inst, level, pos);
+
+  // stamped here, log time is when it's logged not when it's written
+  s->payload.ts = lgi_clock_ns(inst->timePrecision != LG_TIME_MS);
+  s->payload.site = NULL;
+  s->payload.cat = NULL;
+  s->payload.sink_mask = ~0u;
+  *out_pos = pos;
+  return s;
+}
+
+// Slot is ready signal to consumer
+LOGGER_INTERNAL void lgi_queue_publish(LogSlot* s, size_t pos)
+{
+  atomic_store_explicit(&s->seq, pos + 1, memory_order_release);
+}
+
+LOGGER_INTERNAL size_t lgi_queue_pop_batch(LogQueue* q, size_t* start_pos, size_t max_batch)
+{
+  size_t pos = q->tail;
+  size_t count = 0;
+
+  while (count < max_batch) {
+    LogSlot* s = lgi_slot_get(q, pos + count);
+    size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+    if (seq != (pos + count + 1)) {
+      break; // not ready yet
+    }
+    count++;
+  }
+
+  if (count > 0) {
+    *start_pos = pos;
+    q->tail = pos + count;
+  }
+  return count;
+}
+
+/*
+  Pop-process-release: formats a batch straight from the ring slots
+  into b and releases all of its slots once it's formatted.
+  Pop half takes the slots (and the sink table) in ring order,
+  format half can run on any thread after it
+*/
+LOGGER_INTERNAL bool lgi_queue_pop_into(Logger* inst, LogQueue* q, LgBatch* b) {
+  size_t start_pos;
+  size_t* cap = &inst->batch_cap[q == inst->lane];
+  size_t max = *cap;
+  // batch stops where a marked drop run starts, its record goes right there
+  LgDrops* d = inst->drops;
+  int spins = 0;
+  int state;
+  while ((state = atomic_load_explicit(&d->state, memory_order_acquire)) == LGI_DROPS_MARKING)
+    lgi_handoff_wait(&spins);
+  if (state == LGI_DROPS_MARKED) {
+    size_t left = atomic_load_explicit(&d->mark[q == inst->lane], memory_order_relaxed) - q->tail;
+    if ((intptr_t)left > 0 && left < max) max = left;
+  }
+  size_t count = lgi_queue_pop_batch(q, &start_pos, max);
+  // bigger batches (fewer writes) while the ring stays backed up,
+  // smaller ones (slots are back sooner) once it's not
+  if (count == *cap && *cap < LOGGER_MAX_BATCH) *cap *= 2;
+  else if (max == *cap && count < *cap / 4 && *cap > LOGGER_MIN_BATCH) *cap /= 2;
+  LGI_PROBE3(batch_pop, inst, q == inst->lane, count);
+  if (count == 0) return false;
+
+  lgi_batch_begin(inst, b);
+  b->count = count;
+  b->src = q == inst->lane ? 1 : 0;
+  b->end = start_pos + count;
+  b->q = q;
+  b->start = start_pos;
+  return true;
+}
+
+LOGGER_INTERNAL void lgi_batch_format(Logger* inst, LgBatch* b) {
+  for (size_t i = 0; i < b->count; i++) {
+    LogSlot* s = lgi_slot_get(b->q, b->start + i);
+    if (inst->shm) lgi_shm_check(inst, s);
+    lgi_batch_add(inst, b, &s->payload);
+  }
+
+  // batch is formatted, give all the slots back at once
+  for (size_t i = 0; i < b->count; i++)
+    lgi_queue_release(b->q, b->start + i);
+  b->q = NULL;
+}
+
+
+// empty batch on the latest sink table
+LOGGER_INTERNAL void lgi_batch_begin(Logger* inst, LgBatch* b)
+{
+  LgSinkTable* sinks = atomic_load_explicit(&inst->sinks, memory_order_acquire);
+  b->count = 0;
+  b->sinks = sinks;
+  b->idx_sink = -1;
+  b->src = -1;
+  b->end = 0;
+  b->spills = 0;
+  b->q = NULL;
+  b->idx_count = 0;
+  for (size_t t = 0; t < LOGGER_MAX_OUT_TYPES; t++) b->out[t].len = 0;
+  for (size_t k = 0; k < sinks->count; k++) {
+    b->run_counts[k] = 0;
+    if (inst->idx && sinks->items[k].file == inst->idx->file &&
+        sinks->items[k].handle == inst->idx->handle)
+      b->idx_sink = (int)k;
+  }
+}
+
+// appends n bytes to o, offsets stay valid when it moves
+LOGGER_INTERNAL bool lgi_out_append(LgOutBuf* o, const char* p, size_t n, uint32_t* off)
+{
+  if (o->len + n > o->cap) {
+    size_t cap = o->cap ? o->cap : LOGGER_OUT_BUF_INIT;
+    while (cap < o->len + n) cap *= 2;
+    char* data = (char*)realloc(o->data, cap);
+    if (!data) {
+      LG_DEBUG_ERR("Cannot grow the output buffer!");
+      return false;
+    }
+    o->data = data;
+    o->cap = cap;
+  }
+  memcpy(o->data + o->len, p, n);
+  *off = (uint32_t)o->len;
+  o->len += n;
+  return true;
+}
+
+/*
+  formats a payload into b's out buffers and queues it for its sinks,
+  a line right after the sink's previous one just extends its run
+*/
+LOGGER_INTERNAL void lgi_batch_add(Logger* inst, LgBatch* b, const LogPayload* payload)
+{
+  char time_str[LOGGER_TIME_STR_SIZE];
+  log_formatter_t fn = inst->customLogFunc ? inst->customLogFunc : lgi_def_format_msg;
+  LgSinkTable* sinks = b->sinks;
+  LgString* pack = b->pack;
+  uint32_t offs[LOGGER_MAX_OUT_TYPES];
+  for (size_t t = 0; t < LOGGER_MAX_OUT_TYPES; t++) pack[t].len = 0;
+  if (payload->flags & LGI_PAYLOAD_SKIP) return;
+
+  // only the out types that some sink accepts this level for
+  uint32_t lvl_bit = LOGGER_LEVEL_BIT(payload->level);
+  uint32_t sink_mask = payload->sink_mask;
+  uint32_t needed = 0;
+  if (sink_mask == ~0u) {
+    for (size_t t = 0; t < LOGGER_MAX_OUT_TYPES; t++) {
+      if (sinks->type_levels[t] & lvl_bit) needed |= (1u << t);
+    }
+  } else {
+    for (size_t k = 0; k < sinks->count; k++) {
+      if ((sink_mask & sinks->bits[k]) && (sinks->levels[k] & lvl_bit))
+        needed |= (1u << sinks->items[k].type);
+    }
+  }
+  if (needed == 0) return;
+
+  lgi_time_render(&b->tc, payload->ts, inst->timeStyle,
+                  inst->timePrecision, inst->isLocalTime, time_str);
+  lgi_fmt_ctx.site = payload->site;
+  lgi_fmt_ctx.show_site = inst->logCallSite;
+  lgi_fmt_ctx.cat = payload->cat;
+  if (!fn(time_str, payload->level, payload->msg, needed, pack))
+    return;
+
+  for (size_t t = 0; t < LOGGER_MAX_OUT_TYPES; t++) {
+    if (!LOGGER_CONTAINS_FLAG(needed, t) || pack[t].len == 0 ||
+        !lgi_out_append(&b->out[t], pack[t].data, pack[t].len, &offs[t]))
+      pack[t].len = 0;
+  }
+
+  for (size_t k = 0; k < sinks->count; k++) {
+    LgString* str = &pack[sinks->items[k].type];
+    if (!(sinks->levels[k] & lvl_bit) || str->len == 0) continue;
+    if (!(sink_mask & sinks->bits[k])) continue;
+    uint32_t off = offs[sinks->items[k].type];
+    uint32_t len = (uint32_t)str->len;
+    if ((int)k == b->idx_sink) {
+      LgIdxLine* ln = &b->idx_lines[b->idx_count++];
+      size_t tlen = strlen(time_str);
+      ln->ts = payload->ts;
+      ln->level = payload->level;
+      ln->skip = (str->len >= tlen && memcmp(str->data, time_str, tlen) == 0)
+                 ? (uint32_t)tlen : 0;
+      ln->off = off;
+      ln->len = len;
+    }
+    int n = b->run_counts[k];
+    if (n > 0 && b->runs[k][n - 1].off + b->runs[k][n - 1].len == off) {
+      b->runs[k][n - 1].len += len;
+    } else {
+      b->runs[k][n].off = off;
+      b->runs[k][n].len = len;
+      b->run_counts[k]++;
+    }
+  }
+}
+
+// out buffers of b, it can be used again after it
+LOGGER_INTERNAL void lgi_batch_free(LgBatch* b)
+{
+  for (size_t t = 0; t < LOGGER_MAX_OUT_TYPES; t++) {
+    free(b->out[t].data);
+    b->out[t].data = NULL;
+    b->out[t].len = b->out[t].cap = 0;
+  }
+}
+
+// batches of the writer side and the reorder buffer, writer is gone
+LOGGER_INTERNAL void lgi_pipe_free(Logger* inst)
+{
+  for (size_t i = 0; i < inst->pipe_depth; i++) lgi_batch_free(&inst->pipe[i]);
+  if (inst->pipe != inst->batches) free(inst->pipe);
+  inst->pipe = inst->batches;
+}
+
+// bytes written, -1 on error
+LOGGER_INTERNAL ssize_t lgi_file_writev(LgFile* f, const struct iovec* iov, int iovcnt)
+{
+  bool ok = true;
+  size_t n = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    ok = lgi_file_put(f, (const char*)iov[i].iov_base, iov[i].iov_len) && ok;
+    n += iov[i].iov_len;
+  }
+  if (n > 0 && f->unsynced == 0) f->dirty_ms = lgi_now_ms();
+  f->unsynced += n;
+  ok = lgi_file_tick(f, false) && ok;
+  return ok ? (ssize_t)n : -1;
+}
+
+LOGGER_INTERNAL void lgi_batch_write(Logger* inst, LgBatch* b) {
+  if (b->sinks != inst->sinks_cur) lgi_sinks_retire(inst, b->sinks);
+  for (size_t i = 0; i < b->sinks->count; i++) {
+    LgSink* sk = &b->sinks->items[i];
+    const char* base = b->out[sk->type].data;
+    int runs = b->run_counts[i];
+    if (runs == 0) continue;
+    ssize_t n = 0;
+    LGI_PROBE3(write_start, inst, i, runs);
+    // a writev takes LGI_IOV_CHUNK of them at most
+    for (int j = 0; j < runs && n >= 0; j += LGI_IOV_CHUNK) {
+      struct iovec iov[LGI_IOV_CHUNK];
+      int cnt = runs - j < LGI_IOV_CHUNK ? runs - j : LGI_IOV_CHUNK;
+      for (int c = 0; c < cnt; c++) {
+        iov[c].iov_base = (void*)(base + b->runs[i][j + c].off);
+        iov[c].iov_len = b->runs[i][j + c].len;
+      }
+      ssize_t w = 0;
+      if (sk->handle) w = lgi_file_writev(sk->handle, iov, cnt);
+      else if (sk->file) w = lgi_writev(sk->file, iov, cnt);
+      n = w < 0 ? -1 : n + w;
+    }
+    LGI_PROBE3(write_end, inst, i, n);
+    if ((int)i == b->idx_sink) lgi_idx_lines(inst->idx, b, (int)i);
+  }
+  lgi_flush_advance(inst, b);
+}
+
+/*
+  Words are [A-Za-z0-9_] runs, lowercased and FNV-1a hashed,
+  4 bits per word from the two halves of the hash
+*/
+LOGGER_INTERNAL inline bool lgi_idx_word_char(char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+LOGGER_INTERNAL bool lgi_idx_bloom_walk(uint64_t* bloom, const char* s, size_t n, bool set)
+{
+  size_t i = 0;
+  while (i < n) {
+    if (!lgi_idx_word_char(s[i])) {
+      i++;
+      continue;
+    }
+    uint64_t h = 14695981039346656037ull;
+    while (i < n && lgi_idx_word_char(s[i])) {
+      char c = s[i++];
+      if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+      h = (h ^ (uint8_t)c) * 1099511628211ull;
+    }
+    uint32_t h1 = (uint32_t)h;
+    uint32_t h2 = (uint32_t)(h >> 32) | 1u;
+    for (uint32_t j = 0; j < 4; j++) {
+      uint32_t bit = (h1 + j * h2) % LOGGER_IDX_BLOOM_BITS;
+      if (set) bloom[bit / 64] |= 1ull << (bit % 64);
+      else if (!(bloom[bit / 64] & (1ull << (bit % 64)))) return false;
+    }
+  }
+  return true;
+}
+
+LOGGER_INTERNAL void lgi_idx_bloom_add(uint64_t* bloom, const char* s, size_t n)
+{
+  lgi_idx_bloom_walk(bloom, s, n, true);
+}
+
+// true = every word of s may be in the block (lgquery's side)
+LOGGER_INTERNAL inline bool lgi_idx_bloom_test(const uint64_t* bloom, const char* s, size_t n)
+{
+  return lgi_idx_bloom_walk((uint64_t*)bloom, s, n, false);
+}
+
+LOGGER_INTERNAL bool lgi_idx_flush(LgIndex* idx)
+{
+  bool ok = true;
+  if (idx->cur.count > 0) {
+    ok = fwrite(&idx->cur, sizeof(idx->cur), 1, idx->out) == 1;
+    ok = fflush(idx->out) == 0 && ok;
+  }
+  memset(&idx->cur, 0, sizeof(idx->cur));
+  idx->cur.offset = idx->offset;
+  return ok;
+}
+
+// a line that's just written to the indexed file goes to the open block
+LOGGER_INTERNAL void lgi_idx_line(LgIndex* idx, const LgIdxLine* ln, const char* line, size_t len)
+{
+  LgIdxBlock* c = &idx->cur;
+  if (c->count == 0 || ln->ts < c->ts_min) c->ts_min = ln->ts;
+  if (c->count == 0 || ln->ts > c->ts_max) c->ts_max = ln->ts;
+  c->levels |= LOGGER_LEVEL_BIT(ln->level);
+  c->count++;
+  c->length += len;
+  lgi_idx_bloom_add(c->bloom, line + ln->skip, len - ln->skip);
+  idx->offset += len;
+}
+
+// k-th sink's lines of b are just written to the indexed file
+LOGGER_INTERNAL void lgi_idx_lines(LgIndex* idx, const LgBatch* b, int k)
+{
+  const char* base = b->out[b->sinks->items[k].type].data;
+  for (int j = 0; j < b->idx_count; j++) {
+    if (idx->cur.length >= LOGGER_IDX_BLOCK_SIZE && !lgi_idx_flush(idx)) {
+      LG_DEBUG_ERR("Cannot write the index block!");
+    }
+    lgi_idx_line(idx, &b->idx_lines[j], base + b->idx_lines[j].off, b->idx_lines[j].len);
+  }
+}
+
+// writes the open block and frees idx
+LOGGER_INTERNAL bool lgi_idx_close(LgIndex* idx)
+{
+  bool ok = lgi_idx_flush(idx);
+  ok = fclose(idx->out) == 0 && ok;
+  free(idx);
+  return ok;
+}
+
+LOGGER_INTERNAL void lgi_queue_release(LogQueue* q, size_t pos) {
+  LogSlot* s = lgi_slot_get(q, pos);
+  atomic_store_explicit(&s->owner, 0, memory_order_relaxed);
+  atomic_store_explicit(&s->seq, pos + LOGGER_RING_SIZE, memory_order_release);
+}
+
+LOGGER_INTERNAL void lgi_adaptive_wait(int* spins) {
+  if (*spins < LOGGER_WAIT_NO_PAUSE_MAGIC) {
+    *spins += 1;
+  } else if (*spins < LOGGER_WAIT_PAUSE_MAGIC) {
+    *spins += 1;
+    LOGGER_PAUSE_INS();
+  } else {
+    // Kernel'll floor this value to ~70-80 us
+    // so this constant doesnt matter if it's in between 50-100 us.
+    LOGGER_SLEEP(60);
+  }
+}
+
+LOGGER_INTERNAL void lgi_spin_lock(ATOMIC(bool)* lock) {
+  int spins = 0;
+  while (atomic_exchange_explicit(lock, true, memory_order_acquire))
+    lgi_handoff_wait(&spins);
+}
+
+LOGGER_INTERNAL void lgi_spin_unlock(ATOMIC(bool)* lock) {
+  atomic_store_explicit(lock, false, memory_order_release);
+}
+
+/*
+  Waiting for the other pipeline stage, it's going to be done soon
+  so never sleep here (sleeping costs a whole batch of latency)
+*/
+LOGGER_INTERNAL void lgi_handoff_wait(int* spins) {
+  if (*spins < LOGGER_WAIT_PAUSE_MAGIC) {
+    *spins += 1;
+    LOGGER_PAUSE_INS();
+  } else {
+    LOGGER_YIELD();
+  }
+}
+
+// payload of a reservation, it's either a ring slot or a spill node
+LOGGER_INTERNAL LogPayload* lgi_res_payload(const LgReservation* res)
+{
+  if (res->pos == LGI_SPILL_POS) return &((LgSpillNode*)res->slot)->payload;
+  return &((LogSlot*)res->slot)->payload;
+}
+
+LOGGER_INTERNAL void lgi_count_drop(Logger* inst, LgLogLevel level)
+{
+  LGI_PROBE2(drop, inst, level);
+  LgDrops* d = inst->drops;
+  atomic_fetch_add_explicit(&d->counts[(unsigned)level % LOGGER_MAX_LEVELS], 1,
+                            memory_order_seq_cst);
+  atomic_fetch_add_explicit(&d->total, 1, memory_order_relaxed);
+
+  // first drop of a run, the record goes where the gap is. Otherwise a record
+  // is on its way and it takes this count too (seq_cst pairs with its reset)
+  int none = LGI_DROPS_NONE;
+  if (atomic_load_explicit(&d->state, memory_order_seq_cst) == LGI_DROPS_NONE &&
+      atomic_compare_exchange_strong_explicit(&d->state, &none, LGI_DROPS_MARKING,
+                                              memory_order_acquire, memory_order_relaxed)) {
+    atomic_store_explicit(&d->mark[0], atomic_load_explicit(&inst->ring->head, memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(&d->mark[1], inst->lane ? atomic_load_explicit(&inst->lane->head,
+                          memory_order_relaxed) : 0, memory_order_relaxed);
+    atomic_store_explicit(&d->mark[2], atomic_load_explicit(&inst->spill_pushed, memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(&d->state, LGI_DROPS_MARKED, memory_order_release);
+  }
+}
+
+LOGGER_INTERNAL void lgi_drops_init(LgDrops* d)
+{
+  atomic_store_explicit(&d->state, LGI_DROPS_NONE, memory_order_relaxed);
+  atomic_store_explicit(&d->mark[0], 0, memory_order_relaxed);
+  atomic_store_explicit(&d->mark[1], 0, memory_order_relaxed);
+  atomic_store_explicit(&d->mark[2], 0, memory_order_relaxed);
+  atomic_store_explicit(&d->total, 0, memory_order_relaxed);
+  for (size_t i = 0; i < LOGGER_MAX_LEVELS; i++)
+    atomic_store_explicit(&d->counts[i], 0, memory_order_relaxed);
+}
+
+#ifdef LGI_HAS_SHM
+LOGGER_INTERNAL ATOMIC(bool) lgi_pid_hooked = false;
+
+LOGGER_INTERNAL void lgi_pid_refresh(void)
+{
+  atomic_store_explicit(&lgi_pid, (long)getpid(), memory_order_relaxed);
+}
+
+/*
+  Shared ring of fd, -1 = a new memfd and we're its writer. Attaching
+  ones take the ring's settings and check its layout is theirs too
+*/
+LOGGER_INTERNAL bool lgi_shm_map(Logger* inst, int fd)
+{
+  bool create = fd < 0;
+  struct stat st;
+  LgShm* shm;
+  void* m;
+
+  if (!atomic_exchange_explicit(&lgi_pid_hooked, true, memory_order_relaxed))
+    pthread_atfork(NULL, NULL, lgi_pid_refresh);
+  lgi_pid_refresh();
+
+  fd = create ? memfd_create("logger-ring", MFD_CLOEXEC) : fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (fd < 0) {
+    LG_DEBUG_ERR("Cannot open the shared ring!");
+    return false;
+  }
+  if (create ? ftruncate(fd, (off_t)sizeof(LgShm)) != 0
+             : fstat(fd, &st) != 0 || (size_t)st.st_size != sizeof(LgShm)) {
+    LG_DEBUG_ERR("Cannot size the shared ring (or it's of another build)!");
+    goto fail;
+  }
+  m = mmap(NULL, sizeof(LgShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (m == MAP_FAILED) {
+    LG_DEBUG_ERR("Cannot map the shared ring!");
+    goto fail;
+  }
+  shm = (LgShm*)m;
+
+  if (create) {
+    memcpy(shm->magic, LGI_SHM_MAGIC, sizeof(shm->magic));
+    shm->ring_size = LOGGER_RING_SIZE;
+    shm->stride = (uint32_t)LOGGER_RING_STRIDE;
+    shm->lane_levels = inst->lane_levels;
+    shm->policy = inst->logPolicy;
+    shm->precision = inst->timePrecision;
+    atomic_store_explicit(&shm->closed, false, memory_order_relaxed);
+    lgi_drops_init(&shm->drops);
+    lgi_queue_create(&shm->ring);
+    if (shm->lane_levels) lgi_queue_create(&shm->lane);
+    inst->shm_pid = atomic_load_explicit(&lgi_pid, memory_order_relaxed);
+  } else {
+    if (memcmp(shm->magic, LGI_SHM_MAGIC, sizeof(shm->magic)) != 0 ||
+        shm->ring_size != LOGGER_RING_SIZE || shm->stride != LOGGER_RING_STRIDE) {
+      LG_DEBUG_ERR("Shared ring is of another build!");
+      munmap(m, sizeof(LgShm));
+      goto fail;
+    }
+    inst->logPolicy = shm->policy;
+    inst->timePrecision = shm->precision;
+    inst->shm_pid = -1; // writer is someone else
+  }
+  inst->shm = shm;
+  inst->shm_fd = fd;
+  inst->ring = &shm->ring;
+  inst->lane = shm->lane_levels ? &shm->lane : NULL;
+  inst->lane_levels = shm->lane_levels;
+  inst->drops = &shm->drops;
+  return true;
 
-  // Raw message and other specifiers, no color or markup language
-  if (LOGGER_CONTAINS_FLAG(needed, LG_OUT_FILE)) {
-    LgString* s = &pack[LG_OUT_FILE];
-    char* p = s->data;
-    char* end = p + sizeof(s->data) - 1;
-    lgi_str_append_n(&p, end, time_str);
-    lgi_str_append_n(&p, end, " [");
-    lgi_str_append_n(&p, end, level_str);
-    lgi_str_append_n(&p, end, "] ");
-    lgi_str_append_n(&p, end, msg);
-    lgi_str_close(&p, end);
-    s->len = (size_t)(p - s->data);
+fail:
+  close(fd);
+  return false;
+}
+
+/*
+  Zombies are dead too, their parent may be the one that's blocked
+  on the ring (so it can't wait for them)
+*/
+LOGGER_INTERNAL bool lgi_pid_dead(int pid)
+{
+  char path[64];
+  char buf[512];
+  if (kill((pid_t)pid, 0) != 0) return errno == ESRCH;
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  FILE* f = fopen(path, "r");
+  if (!f) return false;
+  size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  buf[n] = '\0';
+  const char* p = strrchr(buf, ')'); // name can have anything in it
+  return p && p[1] == ' ' && (p[2] == 'Z' || p[2] == 'X');
+}
+
+// unmaps it, lost count stays readable
+LOGGER_INTERNAL void lgi_shm_close(Logger* inst)
+{
+  atomic_store_explicit(&inst->own_drops.total,
+                        atomic_load_explicit(&inst->shm->drops.total, memory_order_relaxed),
+                        memory_order_relaxed);
+  inst->drops = &inst->own_drops;
+  munmap((void*)inst->shm, sizeof(LgShm));
+  close(inst->shm_fd);
+  inst->shm = NULL;
+  inst->shm_fd = -1;
+  inst->ring = &inst->queue;
+  inst->lane = NULL;
+  inst->lane_levels = 0;
+}
+
+/*
+  Head slot of a shared ring is claimed but not published for a
+  while: if its producer died in between, writer publishes it as
+  a skipped one so the ring goes on
+*/
+LOGGER_INTERNAL void lgi_shm_reap(Logger* inst, LogQueue* q, LgStall* st)
+{
+  size_t pos = q->tail;
+  LogSlot* s = lgi_slot_get(q, pos);
+  if (atomic_load_explicit(&q->head, memory_order_relaxed) == pos ||
+      atomic_load_explicit(&s->seq, memory_order_acquire) != pos) {
+    st->since_ms = 0; // nothing claimed, or it's ready
+    return;
+  }
+  uint64_t now = lgi_now_ms();
+  if (st->since_ms == 0 || st->pos != pos) {
+    st->pos = pos;
+    st->since_ms = st->check_ms = now;
+    return;
   }
+  if (now - st->check_ms < LOGGER_SHM_STALL_MS) return;
+  st->check_ms = now;
+
+  // owner is taken before the head moves, a claimed slot always has it
+  int owner = atomic_load_explicit(&s->owner, memory_order_relaxed);
+  if (owner <= 0 || !lgi_pid_dead(owner)) return;
+
+  // it's ours now, nobody else reads the payload before the release
+  size_t expected = pos;
+  if (atomic_compare_exchange_strong_explicit(&s->seq, &expected, pos + 1,
+                                              memory_order_acquire, memory_order_relaxed)) {
+    s->payload.length = 0;
+    s->payload.flags = LGI_PAYLOAD_SKIP;
+    lgi_count_drop(inst, LG_INFO); // level isn't written before commit
+    LG_DEBUG_ERR("Producer %d died holding a slot, skipped it", owner);
+  }
+  st->since_ms = 0;
+}
 
-  // JSON style formatting
-  if (LOGGER_CONTAINS_FLAG(needed, LG_OUT_NET)) {
-    LgString* s = &pack[LG_OUT_NET];
-    char* p = s->data;
-    char* end = p + sizeof(s->data) - 1;
-    lgi_str_append_n(&p, end, "{\"timestamp\":\"");
-    lgi_str_append_n(&p, end, time_str);
-    lgi_str_append_n(&p, end, "\",\"level\":\"");
-    lgi_str_append_n(&p, end, level_str);
-    lgi_str_append_n(&p, end, "\",\"message\":\"");
-    lgi_str_append_n(&p, end, msg);
-    lgi_str_append_n(&p, end, "\"}");
-    lgi_str_close(&p, end);
-    s->len = (size_t)(p - s->data);
+/*
+  Producer takes the slot's owner before it moves the head, so a claimed
+  slot always tells whose it is. Owner of a head slot that died before
+  moving the head is taken over once waiting for it starts to sleep
+*/
+LOGGER_INTERNAL bool lgi_shm_own(LogQueue* q, LogSlot* s, size_t pos, int* spins)
+{
+  int pid = (int)atomic_load_explicit(&lgi_pid, memory_order_relaxed);
+  int cur = 0;
+  if (!atomic_compare_exchange_strong_explicit(&s->owner, &cur, pid,
+                                               memory_order_acquire, memory_order_relaxed)) {
+    lgi_adaptive_wait(spins);
+    if (*spins < LOGGER_WAIT_PAUSE_MAGIC || cur == pid || !lgi_pid_dead(cur) ||
+        atomic_load_explicit(&q->head, memory_order_relaxed) != pos ||
+        !atomic_compare_exchange_strong_explicit(&s->owner, &cur, pid,
+                                                 memory_order_acquire, memory_order_relaxed))
+      return false;
+    LG_DEBUG_ERR("Producer %d died before its claim, took its slot", cur);
+  }
+  // pos may be old, the slot went around since then
+  if (atomic_load_explicit(&s->seq, memory_order_acquire) == pos) return true;
+  atomic_store_explicit(&s->owner, 0, memory_order_release);
+  return false;
+}
+
+/*
+  Payload of another process is checked before the writer uses it,
+  pointers mean nothing here and a broken one is skipped as a drop
+*/
+LOGGER_INTERNAL void lgi_shm_check(Logger* inst, LogSlot* s)
+{
+  LogPayload* p = &s->payload;
+  if (p->flags & LGI_PAYLOAD_SKIP) return;
+  if (atomic_load_explicit(&s->owner, memory_order_relaxed) !=
+      (int)atomic_load_explicit(&lgi_pid, memory_order_relaxed)) {
+    p->site = NULL;
+    p->cat = NULL;
+  }
+  if (p->length >= LOGGER_MAX_MSG_SIZE || (unsigned)p->level > LG_CUSTOM) {
+    p->length = 0;
+    p->flags = LGI_PAYLOAD_SKIP;
+    lgi_count_drop(inst, LG_INFO); // its level can't be trusted
+    LG_DEBUG_ERR("Bad message on the shared ring, skipped it");
+  }
+}
+#else
+LOGGER_INTERNAL bool lgi_shm_map(Logger* inst, int fd)
+{
+  (void)inst;
+  (void)fd;
+  LG_DEBUG_ERR("Shared ring needs Linux memfd!");
+  return false;
+}
+
+LOGGER_INTERNAL void lgi_shm_close(Logger* inst) { (void)inst; }
+
+LOGGER_INTERNAL void lgi_shm_reap(Logger* inst, LogQueue* q, LgStall* st)
+{
+  (void)inst;
+  (void)q;
+  (void)st;
+}
+
+LOGGER_INTERNAL bool lgi_shm_own(LogQueue* q, LogSlot* s, size_t pos, int* spins)
+{
+  (void)q;
+  (void)s;
+  (void)pos;
+  (void)spins;
+  return true;
+}
+
+LOGGER_INTERNAL void lgi_shm_check(Logger* inst, LogSlot* s)
+{
+  (void)inst;
+  (void)s;
+}
+#endif
+
+/*
+  Overflow side of LG_SPILL: message goes to a malloc'ed node instead
+  of the ring, producers push them lock-free and writer spills them.
+  One shared list instead of per thread buffers: replay needs one order
+  of all threads anyway and a push is a CAS like a ring claim is.
+  Writer moves them to the file every step, at most
+  spill_max wait in memory
+*/
+LOGGER_INTERNAL bool lgi_spill_reserve(Logger* inst, LgLogLevel level, LgReservation* res)
+{
+  LgSpillNode* n = NULL;
+  if (atomic_fetch_add_explicit(&inst->spill_queued, 1, memory_order_seq_cst) < inst->spill_max)
+    n = (LgSpillNode*)malloc(sizeof(LgSpillNode));
+  if (!n) {
+    atomic_fetch_sub_explicit(&inst->spill_queued, 1, memory_order_relaxed);
+    lgi_count_drop(inst, level);
+    return false;
   }
+  // later messages follow it until the writer replays all of them
+  if (!atomic_load_explicit(&inst->spilling, memory_order_relaxed))
+    atomic_store_explicit(&inst->spilling, true, memory_order_relaxed);
+
+  n->payload.ts = lgi_clock_ns(inst->timePrecision != LG_TIME_MS);
+  n->payload.site = NULL;
+  n->payload.cat = NULL;
+  n->payload.sink_mask = ~0u;
+  res->inst = inst;
+  res->slot = n;
+  res->pos  = LGI_SPILL_POS;
+  res->buf  = n->payload.msg;
+  res->cap  = sizeof(n->payload.msg);
   return true;
 }
 
-LOGGER_INTERNAL void lgi_queue_create(LogQueue* q) {
-  q->tail = 0;
-  atomic_store_explicit(&q->head, 0, memory_order_relaxed);
+/*
+  True while messages must go to spill to stay behind the spilled ones.
+  Queued count is read first, a node leaves it only after the writer
+  raised the flag, so one of the two always shows it
+*/
+LOGGER_INTERNAL bool lgi_spilling(Logger* inst)
+{
+  if (inst->logPolicy != LG_SPILL) return false;
+  return atomic_load_explicit(&inst->spill_queued, memory_order_seq_cst) != 0 ||
+         atomic_load_explicit(&inst->spilling, memory_order_seq_cst);
+}
 
-  for (size_t i = 0; i < LOGGER_RING_SIZE; i++) {
-    LogSlot* s = lgi_slot_get(q, i);
-    atomic_store_explicit(&s->seq, i, memory_order_relaxed);
+LOGGER_INTERNAL void lgi_spill_push(Logger* inst, LgSpillNode* n)
+{
+  LgSpillNode* head = atomic_load_explicit(&inst->spill_head, memory_order_relaxed);
+  do {
+    n->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(
+             &inst->spill_head, &head, n,
+             memory_order_release, memory_order_relaxed));
+  atomic_fetch_add_explicit(&inst->spill_pushed, 1, memory_order_release);
+  if (inst->pool) lgi_pool_notify(inst->pool);
+}
+
+// spill file offsets pass 2 GiB, long can't hold them on LLP64 and 32-bit targets
+LOGGER_INTERNAL bool lgi_seek(FILE* f, size_t off)
+{
+#ifdef _WIN32
+  return _fseeki64(f, (__int64)off, SEEK_SET) == 0;
+#else
+  // fseeko isn't declared when the includer pulled stdio.h in before us, step with fseek instead
+  size_t step = off < (size_t)LONG_MAX ? off : (size_t)LONG_MAX;
+  if (fseek(f, (long)step, SEEK_SET) != 0) return false;
+  for (off -= step; off; off -= step) {
+    step = off < (size_t)LONG_MAX ? off : (size_t)LONG_MAX;
+    if (fseek(f, (long)step, SEEK_CUR) != 0) return false;
+  }
+  return true;
+#endif
+}
+
+// moves the pushed nodes to the spill file, oldest first (writer only)
+LOGGER_INTERNAL void lgi_spill_flush(Logger* inst)
+{
+  LgSpillNode* n = atomic_exchange_explicit(&inst->spill_head, (LgSpillNode*)NULL,
+                                            memory_order_acquire);
+  LgSpillNode* fifo = NULL;
+  size_t moved = 0;
+  while (n) {
+    LgSpillNode* next = n->next;
+    n->next = fifo;
+    fifo = n;
+    n = next;
+    moved++;
+  }
+  if (moved > 0) {
+    // they stop counting as queued, producers keep following them by the flag
+    atomic_store_explicit(&inst->spilling, true, memory_order_seq_cst);
+    atomic_fetch_sub_explicit(&inst->spill_queued, moved, memory_order_seq_cst);
   }
 
-  atomic_thread_fence(memory_order_seq_cst);
+  if (fifo && !inst->spill_file) {
+    inst->spill_file = tmpfile();
+    inst->spill_rd = inst->spill_wr = 0;
+    if (!inst->spill_file) {
+      LG_DEBUG_ERR("Cannot create the spill file!");
+    }
+  }
+  bool ok = inst->spill_file && fifo && lgi_seek(inst->spill_file, inst->spill_wr);
+  while (fifo) {
+    LgSpillNode* next = fifo->next;
+    LogPayload* p = &fifo->payload;
+    LgSpillRec rec;
+    rec.ts = p->ts;
+    rec.site = p->site;
+    rec.cat = p->cat;
+    rec.sink_mask = p->sink_mask;
+    rec.level = p->level;
+    rec.length = (uint32_t)p->length;
+    ok = ok && fwrite(&rec, sizeof(rec), 1, inst->spill_file) == 1 &&
+         fwrite(p->msg, 1, p->length, inst->spill_file) == p->length;
+    if (ok) {
+      inst->spill_wr += sizeof(rec) + p->length;
+      inst->spill_recs++;
+    } else {
+      lgi_count_drop(inst, p->level); // honest about it at least
+      inst->spill_lost++;
+    }
+    free(fifo);
+    fifo = next;
+  }
 }
 
-LOGGER_INTERNAL size_t lgi_queue_pop_batch(LogQueue* q, size_t* start_pos, size_t max_batch)
+/*
+  Replays a batch of spilled messages in order, it's called when
+  the ring is empty. Spilling ends once everything is replayed
+*/
+LOGGER_INTERNAL bool lgi_spill_batch(Logger* inst, LgBatch* b)
 {
-  size_t pos = q->tail;
+  if (!atomic_load_explicit(&inst->spilling, memory_order_acquire) &&
+      !atomic_load_explicit(&inst->spill_head, memory_order_acquire))
+    return false;
+
+  lgi_spill_flush(inst);
+  FILE* f = inst->spill_file;
   size_t count = 0;
+  // a marked drop run is written right after the spilled ones before it
+  size_t max = LOGGER_MAX_BATCH;
+  LgDrops* d = inst->drops;
+  if (atomic_load_explicit(&d->state, memory_order_acquire) == LGI_DROPS_MARKED) {
+    size_t left = atomic_load_explicit(&d->mark[2], memory_order_relaxed) - inst->spill_taken;
+    if ((intptr_t)left > 0 && left < max) max = left;
+  }
+  lgi_batch_begin(inst, b);
+  if (f && inst->spill_rd < inst->spill_wr) {
+    fflush(f);
+    if (!lgi_seek(f, inst->spill_rd)) {
+      inst->spill_rd = inst->spill_wr; // lost it, nothing better to do
+    }
+    LogPayload p;
+    while (count < max && inst->spill_rd < inst->spill_wr) {
+      LgSpillRec rec;
+      if (fread(&rec, sizeof(rec), 1, f) != 1 || rec.length >= sizeof(p.msg) ||
+          fread(p.msg, 1, rec.length, f) != rec.length) {
+        LG_DEBUG_ERR("Spill file is corrupted!");
+        inst->spill_rd = inst->spill_wr;
+        break;
+      }
+      p.msg[rec.length] = '\0';
+      p.length = rec.length;
+      p.level = rec.level;
+      p.flags = 0;
+      p.ts = rec.ts;
+      p.site = rec.site;
+      p.cat = rec.cat;
+      p.sink_mask = rec.sink_mask;
+      inst->spill_rd += sizeof(rec) + rec.length;
+      inst->spill_recs--;
+      lgi_batch_add(inst, b, &p);
+      count++;
+    }
+    b->count = count;
+  }
+  if (inst->spill_rd >= inst->spill_wr) {
+    inst->spill_lost += inst->spill_recs; // whatever a corrupted file had
+    inst->spill_recs = 0;
+  }
+  // flush waiters know them as done once this batch is written
+  b->spills = count + inst->spill_lost;
+  inst->spill_taken += b->spills;
+  inst->spill_lost = 0;
+  if (b->spills > 0) return true;
+
+  // caught up, file space is reused from the start
+  inst->spill_rd = inst->spill_wr = 0;
+  // a reserved node that isn't pushed yet keeps it on too
+  if (atomic_load_explicit(&inst->spill_queued, memory_order_seq_cst) == 0)
+    atomic_store_explicit(&inst->spilling, false, memory_order_seq_cst);
+  return false;
+}
 
-  while (count < max_batch) {
-    LogSlot* s = lgi_slot_get(q, pos + count);
-    size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
-    if (seq != (pos + count + 1)) {
-      break; // not ready yet
+/*
+  "dropped N messages (INFO: n, ...)" record as its own batch of one,
+  once the messages that were queued before the run's first drop are taken
+*/
+LOGGER_INTERNAL bool lgi_drop_batch(Logger* inst, LgBatch* b)
+{
+  LgDrops* d = inst->drops;
+  if (atomic_load_explicit(&d->state, memory_order_acquire) != LGI_DROPS_MARKED) return false;
+  if ((intptr_t)(inst->ring->tail - atomic_load_explicit(&d->mark[0], memory_order_relaxed)) < 0)
+    return false;
+  if (inst->lane &&
+      (intptr_t)(inst->lane->tail - atomic_load_explicit(&d->mark[1], memory_order_relaxed)) < 0)
+    return false;
+  // LG_SPILL drops when the spill is full, the spilled ones before it are replayed first
+  if ((intptr_t)(inst->spill_taken - atomic_load_explicit(&d->mark[2], memory_order_relaxed)) < 0)
+    return false;
+  // drops from now on mark the next run, the ones counted before it are taken below
+  atomic_store_explicit(&d->state, LGI_DROPS_NONE, memory_order_seq_cst);
+
+  size_t counts[LOGGER_MAX_LEVELS];
+  size_t total = 0;
+  for (unsigned l = 0; l < LOGGER_MAX_LEVELS; l++) {
+    counts[l] = atomic_exchange_explicit(&d->counts[l], 0, memory_order_seq_cst);
+    total += counts[l];
+  }
+  if (total == 0) return false;
+
+  LogPayload p;
+  char* s = p.msg;
+  char* end = p.msg + sizeof(p.msg) - 1;
+  const char* sep = " messages (";
+  lgi_str_append_n(&s, end, "dropped ");
+  lgi_str_append_uint(&s, end, (unsigned long)total);
+  for (unsigned l = 0; l < LOGGER_MAX_LEVELS; l++) {
+    if (counts[l] == 0) continue;
+    lgi_str_append_n(&s, end, sep);
+    lgi_str_append_n(&s, end, lg_lvl_to_str((LgLogLevel)l));
+    lgi_str_append_n(&s, end, ": ");
+    lgi_str_append_uint(&s, end, (unsigned long)counts[l]);
+    sep = ", ";
+  }
+  lgi_str_append_n(&s, end, ")");
+  *s = '\0';
+
+  p.length = (size_t)(s - p.msg);
+  p.level = LG_WARNING;
+  p.flags = 0;
+  p.ts = lgi_clock_ns(inst->timePrecision != LG_TIME_MS);
+  p.site = NULL;
+  p.cat = NULL;
+  p.sink_mask = ~0u;
+
+  lgi_batch_begin(inst, b);
+  lgi_batch_add(inst, b, &p);
+  b->count = 1;
+  return true;
+}
+
+size_t lg_get_dropped(const Logger* inst)
+{
+  const Logger* ins = inst ? inst : lg_get_active_instance();
+  if (!ins || !ins->drops) return 0;
+  return atomic_load_explicit(&ins->drops->total, memory_order_relaxed);
+}
+
+int lg_shared_fd(const Logger* inst)
+{
+  const Logger* ins = inst ? inst : lg_get_active_instance();
+  if (!ins || !lg_is_alive(ins) || !ins->shm) return -1;
+  return ins->shm_fd;
+}
+
+int lg_attach(Logger* inst, int fd)
+{
+  if (!inst || fd < 0) return false;
+  if (lg_is_alive(inst)) {
+    LG_DEBUG_ERR("Logger is already alive!");
+    return false;
+  }
+  // a producer only, nothing of the writer side is used
+  inst->generateDefaultFile = false;
+  inst->customLogFunc = NULL;
+  inst->logCallSite = false;
+  inst->cat_count = 0;
+  inst->pool = NULL;
+  inst->pipelined = false;
+  inst->pipe = inst->batches;
+  inst->pipe_depth = LOGGER_PIPE_DEPTH;
+  inst->fmt_workers = 1;
+  inst->idx = NULL;
+  inst->spill_file = NULL;
+  inst->spill_max = LOGGER_SPILL_MAX_QUEUED;
+  atomic_store_explicit(&inst->spilling, false, memory_order_relaxed);
+  atomic_store_explicit(&inst->spill_head, (LgSpillNode*)NULL, memory_order_relaxed);
+  atomic_store_explicit(&inst->cat_lock, false, memory_order_relaxed);
+  atomic_store_explicit(&inst->sinks, (LgSinkTable*)NULL, memory_order_relaxed);
+  inst->sinks_cur = NULL;
+  lgi_drops_init(&inst->own_drops);
+  inst->drops = &inst->own_drops;
+  inst->ring = &inst->queue;
+  inst->lane = NULL;
+  inst->lane_levels = 0;
+  inst->shm = NULL;
+  inst->shm_fd = -1;
+  atomic_store_explicit(&inst->consuming, false, memory_order_relaxed);
+  lgi_inflight_reset(inst);
+  if (!lgi_shm_map(inst, fd)) return false;
+
+  atomic_store_explicit(&inst->isAlive, true, memory_order_release);
+  Logger* expected = NULL;
+  atomic_compare_exchange_strong_explicit(
+    &active_instance, &expected, inst,
+    memory_order_release, memory_order_relaxed
+  );
+  return true;
+}
+
+// "2-3,8" into the mask, false on bad list or too big CPU number
+LOGGER_INTERNAL bool lgi_parse_cpus(const char* list, unsigned long* mask)
+{
+  const size_t bits = sizeof(unsigned long) * 8;
+  memset(mask, 0, sizeof(unsigned long) * LOGGER_CPU_WORDS);
+  const char* p = list;
+  bool any = false;
+  while (*p) {
+    char* e;
+    long lo = strtol(p, &e, 10);
+    if (e == p || lo < 0) return false;
+    long hi = lo;
+    p = e;
+    if (*p == '-') {
+      hi = strtol(p + 1, &e, 10);
+      if (e == p + 1 || hi < lo) return false;
+      p = e;
     }
-    count++;
+    if (hi >= LOGGER_MAX_CPUS) return false;
+    for (long c = lo; c <= hi; c++) mask[c / bits] |= 1ul << (c % bits);
+    any = true;
+    if (*p == ',') p++;
+    else if (*p) return false;
   }
+  return any;
+}
 
-  if (count > 0) {
-    *start_pos = pos;
-    q->tail = pos + count;
+#if defined(LGI_HAS_AFFINITY) && defined(SYS_mbind)
+LOGGER_INTERNAL void lgi_queue_place(LogQueue* q, unsigned int node)
+{
+  // whole pages of the slots, queue is not page aligned
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t lo = ((uintptr_t)q->slots + page - 1) & ~(page - 1);
+  uintptr_t hi = ((uintptr_t)q->slots + sizeof(q->slots)) & ~(page - 1);
+  unsigned long nodes = 1ul << node;
+  if (hi > lo &&
+      syscall(SYS_mbind, (void*)lo, (unsigned long)(hi - lo), LGI_MPOL_PREFERRED,
+              &nodes, (unsigned long)(sizeof(nodes) * 8 + 1), LGI_MPOL_MF_MOVE) != 0) {
+    LG_DEBUG_ERR("Cannot move the ring to NUMA node %u!", node);
   }
-  return count;
 }
+#endif
 
-LOGGER_INTERNAL bool lgi_queue_ppr_batch(Logger* inst, size_t* start_pos) {
-  size_t count = lgi_queue_pop_batch(&inst->queue, start_pos, LOGGER_MAX_BATCH);
-  if (count == 0) return false;
-  char time_str[LOGGER_TIME_STR_SIZE];
-  log_formatter_t fn = inst->customLogFunc ? inst->customLogFunc : lgi_def_format_msg;
+/*
+  Applies writer options to the calling thread, it's best effort,
+  failures (like EPERM for real-time ones) only go to debug output.
+  Rings are placed once, by the writer (format workers only get the rest)
+*/
+LOGGER_INTERNAL void lgi_thread_setup(Logger* inst, bool place_ring)
+{
+#ifdef LGI_HAS_AFFINITY
+  const LgThreadOptions* o = &inst->thread_opts;
+  if (inst->has_cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    const size_t bits = sizeof(unsigned long) * 8;
+    for (size_t c = 0; c < LOGGER_MAX_CPUS && c < CPU_SETSIZE; c++) {
+      if (inst->cpu_mask[c / bits] & (1ul << (c % bits))) CPU_SET(c, &set);
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+      LG_DEBUG_ERR("Cannot set writer's CPU affinity!");
+    }
+  }
 
-  LgMsgPack msg_packs[LOGGER_MAX_BATCH];
-  struct iovec vecs[LOGGER_MAX_OUT_TYPES][LOGGER_MAX_BATCH];
-  int vec_counts[LOGGER_MAX_OUT_TYPES] = {0};
+  if (o->sched != LG_SCHED_DEFAULT) {
+    static const int policies[] = {
+      SCHED_OTHER, SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO, SCHED_RR
+    };
+    int policy = policies[o->sched];
+    struct sched_param sp;
+    memset(&sp, 0, sizeof(sp));
+    if (policy == SCHED_FIFO || policy == SCHED_RR) sp.sched_priority = o->schedPriority;
+    if (pthread_setschedparam(pthread_self(), policy, &sp) != 0) {
+      LG_DEBUG_ERR("Cannot set writer's scheduling policy!");
+    }
+  }
 
-  for (size_t i = 0; i < count; i++) {
-    LogPayload payload = {};
-    size_t pos = *start_pos + i;
-    LogSlot* gs = lgi_slot_get(&inst->queue, pos);
-    memcpy(&payload, &gs->payload, sizeof(LogPayload));
-    lgi_queue_release(&inst->queue, pos);
+  // nice is per thread on Linux
+  if (o->nice != 0 &&
+      setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), o->nice) != 0) {
+    LG_DEBUG_ERR("Cannot set writer's nice value!");
+  }
 
-    if (!lg_get_time_str(inst, time_str)) continue;
-    if (!fn(time_str, payload.level, payload.msg, inst->out_needed, msg_packs[i]))
-      continue;
+#if defined(SYS_mbind) && defined(SYS_getcpu)
+  if (place_ring && o->ringPlacement != LG_RING_FIRST_TOUCH) {
+    unsigned int cpu = 0, node = (unsigned int)o->ringNode;
+    if (o->ringPlacement == LG_RING_WRITER_NODE &&
+        syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+      return;
+    if (node >= sizeof(unsigned long) * 8) return;
 
-    for (size_t t = 0; t < LOGGER_MAX_OUT_TYPES; t++) {
-      if (msg_packs[i][t].len == 0) continue;
-      vecs[t][vec_counts[t]].iov_base = msg_packs[i][t].data;
-      vecs[t][vec_counts[t]].iov_len  = msg_packs[i][t].len;
-      vec_counts[t]++;
+    lgi_queue_place(inst->ring, node);
+    if (inst->lane) lgi_queue_place(inst->lane, node);
+  }
+#else
+  LG_UNUSED(place_ring);
+#endif
+#else
+  LG_UNUSED(place_ring);
+  if (inst->has_cpus || inst->thread_opts.sched != LG_SCHED_DEFAULT ||
+      inst->thread_opts.nice != 0 || inst->thread_opts.ringPlacement != LG_RING_FIRST_TOUCH) {
+    LG_DEBUG_ERR("Writer thread options aren't supported here, ignored");
+  }
+#endif
+}
+
+LgWriterPool* lg_pool_create(int threads)
+{
+  if (threads <= 0 || threads > LOGGER_POOL_MAX_THREADS) {
+    LG_DEBUG_ERR("Writer pool can have 1-" LG_STRINGIFY(LOGGER_POOL_MAX_THREADS) " threads");
+    return NULL;
+  }
+  LgWriterPool* pool = (LgWriterPool*)calloc(1, sizeof(LgWriterPool));
+  if (!pool) {
+    LG_DEBUG_ERR("Cannot allocate writer pool!");
+    return NULL;
+  }
+  lgi_park_init(&pool->park);
+  atomic_store_explicit(&pool->lock, false, memory_order_relaxed);
+  atomic_store_explicit(&pool->parked, 0, memory_order_relaxed);
+  pool->wake_gen = 0;
+  atomic_store_explicit(&pool->alive, true, memory_order_release);
+
+  for (int i = 0; i < threads; i++) {
+    pool->workers[i].pool = pool;
+    pool->workers[i].cursor = (size_t)i; // spread the starting points
+    if (pthread_create(&pool->workers[i].th, NULL, lgi_pool_worker,
+                       (void*)&pool->workers[i]) != 0) {
+      LG_DEBUG_ERR("Cannot create pool writer thread!");
+      pool->thread_count = i;
+      lg_pool_destroy(pool);
+      return NULL;
     }
   }
+  pool->thread_count = threads;
+  return pool;
+}
 
-  for (size_t i = 0; i < inst->sinks_count; i++) {
-    LgSink* sk = &inst->sinks[i];
-    if (!sk->file || vec_counts[sk->type] == 0) continue;
-    lgi_writev(sk->file, vecs[sk->type], vec_counts[sk->type]);
+int lg_pool_destroy(LgWriterPool* pool)
+{
+  if (!pool) return false;
+  lgi_spin_lock(&pool->lock);
+  size_t attached = pool->count;
+  lgi_spin_unlock(&pool->lock);
+  if (attached > 0) {
+    LG_DEBUG_ERR("Writer pool still has instances, destroy them first!");
+    return false;
   }
+
+  atomic_store_explicit(&pool->alive, false, memory_order_release);
+  lgi_park_lock(&pool->park);
+  pool->wake_gen++;
+  lgi_park_wake_all(&pool->park);
+  lgi_park_unlock(&pool->park);
+  for (int i = 0; i < pool->thread_count; i++)
+    pthread_join(pool->workers[i].th, NULL);
+  lgi_park_free(&pool->park);
+  free(pool);
   return true;
 }
 
-LOGGER_INTERNAL void lgi_queue_release(LogQueue* q, size_t pos) {
-  LogSlot* s = lgi_slot_get(q, pos);
-  atomic_store_explicit(&s->seq, pos + LOGGER_RING_SIZE, memory_order_release);
+LOGGER_INTERNAL bool lgi_pool_attach(LgWriterPool* pool, Logger* inst)
+{
+  lgi_spin_lock(&pool->lock);
+  for (size_t i = 0; i < LOGGER_POOL_MAX_INSTANCES; i++) {
+    if (pool->insts[i]) continue;
+    atomic_store_explicit(&inst->pool_busy, false, memory_order_relaxed);
+    pool->insts[i] = inst;
+    pool->count++;
+    if (i >= pool->hi) pool->hi = i + 1;
+    lgi_spin_unlock(&pool->lock);
+    lgi_pool_notify(pool); // it may already have messages
+    return true;
+  }
+  lgi_spin_unlock(&pool->lock);
+  LG_DEBUG_ERR("Writer pool is full!");
+  return false;
 }
 
-LOGGER_INTERNAL void lgi_adaptive_wait(int* spins) {
-  if (*spins < LOGGER_WAIT_NO_PAUSE_MAGIC) {
-    *spins += 1;
-  } else if (*spins < LOGGER_WAIT_PAUSE_MAGIC) {
-    *spins += 1;
-    LOGGER_PAUSE_INS();
-  } else {
-    // Kernel'll floor this value to ~70-80 us
-    // so this constant doesnt matter if it's in between 50-100 us.
-    LOGGER_SLEEP(60);
+/*
+  Takes the instance out, after this no worker can pick it and
+  the caller owns its consumer side (it's drained there)
+*/
+LOGGER_INTERNAL void lgi_pool_detach(LgWriterPool* pool, Logger* inst)
+{
+  lgi_spin_lock(&pool->lock);
+  for (size_t i = 0; i < LOGGER_POOL_MAX_INSTANCES; i++) {
+    if (pool->insts[i] != inst) continue;
+    pool->insts[i] = NULL;
+    pool->count--;
+    break;
+  }
+  lgi_spin_unlock(&pool->lock);
+
+  // a worker can be in the middle of a batch of it
+  int spins = 0;
+  while (atomic_exchange_explicit(&inst->pool_busy, true, memory_order_acquire))
+    lgi_handoff_wait(&spins);
+}
+
+/*
+  Producer side, only pooled instances pay for it. Pairs with the
+  fence in lgi_pool_worker: either the worker sees the message on its
+  last scan or we see it parked (Dekker style), so no lost wake up
+*/
+LOGGER_INTERNAL void lgi_pool_notify(LgWriterPool* pool)
+{
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&pool->parked, memory_order_relaxed) == 0) return;
+  lgi_park_lock(&pool->park);
+  pool->wake_gen++;
+  lgi_park_wake_all(&pool->park);
+  lgi_park_unlock(&pool->park);
+}
+
+/*
+  One round over the instances, at most one batch from each of
+  them (fair one), the ones other workers are on are skipped
+*/
+LOGGER_INTERNAL bool lgi_pool_round(LgWorker* w)
+{
+  LgWriterPool* pool = w->pool;
+  bool worked = false;
+  lgi_spin_lock(&pool->lock);
+  size_t hi = pool->hi;
+  lgi_spin_unlock(&pool->lock);
+  for (size_t n = 0; n < hi; n++) {
+    size_t i = w->cursor++ % hi;
+    lgi_spin_lock(&pool->lock);
+    Logger* inst = pool->insts[i];
+    bool mine = inst &&
+      !atomic_exchange_explicit(&inst->pool_busy, true, memory_order_acquire);
+    lgi_spin_unlock(&pool->lock);
+    if (!mine) continue;
+
+    if (lgi_consume(inst)) worked = true;
+    atomic_store_explicit(&inst->pool_busy, false, memory_order_release);
   }
+  return worked;
+}
+
+// shared consumer, services every attached instance round-robin
+LOGGER_INTERNAL void* lgi_pool_worker(void* arg)
+{
+  LgWorker* w = (LgWorker*)arg;
+  LgWriterPool* pool = w->pool;
+  int spins = 0;
+
+  while (atomic_load_explicit(&pool->alive, memory_order_acquire)) {
+    if (lgi_pool_round(w)) {
+      spins = 0;
+      continue;
+    }
+    lgi_sites_poll();
+    if (spins < LOGGER_WAIT_PAUSE_MAGIC) {
+      lgi_adaptive_wait(&spins);
+      continue;
+    }
+
+    // every ring is empty, park until a producer wakes us up
+    lgi_park_lock(&pool->park);
+    unsigned long gen = pool->wake_gen;
+    lgi_park_unlock(&pool->park);
+    atomic_fetch_add_explicit(&pool->parked, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (lgi_pool_round(w)) {
+      atomic_fetch_sub_explicit(&pool->parked, 1, memory_order_relaxed);
+      spins = 0;
+      continue;
+    }
+    LGI_PROBE1(pool_park, pool);
+    lgi_park_lock(&pool->park);
+    // timeout only keeps the idle sink ticks (sync intervals) going
+    while (gen == pool->wake_gen && atomic_load_explicit(&pool->alive, memory_order_acquire)) {
+      if (!lgi_park_wait(&pool->park, LOGGER_POOL_PARK_MS)) break;
+    }
+    bool woken = gen != pool->wake_gen; // or timed out
+    lgi_park_unlock(&pool->park);
+    LGI_PROBE2(pool_wake, pool, woken);
+    atomic_fetch_sub_explicit(&pool->parked, 1, memory_order_relaxed);
+  }
+
+  LG_DEBUG("Pool writer thread is exiting");
+  return NULL;
 }
 
 FILE* lg_get_stdout() { return stdout; }
@@ -69,6 +69,47 @@ private:
   LgLogLevel m_level;
 };
 
+// co_await lg_flushed(inst), resumes (on the writer thread) when everything logged before
+// the co_await is written, result is false if it never will be (dead instance)
+#if defined(__cplusplus) && __cplusplus >= 202002L && defined(__has_include)
+# if __has_include(<coroutine>)
+# include <coroutine>
+class LgFlushAwaiter {
+public:
+  explicit LgFlushAwaiter(Logger* inst)
+    : m_inst(inst), m_valid(lg_flush_ticket(inst, &m_ticket)) {}
+
+  bool await_ready() const noexcept {
+    return !m_valid || lg_flush_done(m_inst, &m_ticket);
+  }
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept {
+    m_handle = h;
+    int rc = lg_flush_async(m_inst, &m_ticket, &LgFlushAwaiter::resume, this);
+    // too many callbacks, blocks this thread instead
+    if (rc == 0) lg_flush_wait(m_inst, &m_ticket, (unsigned int)-1);
+    return rc == 1;
+  }
+
+  bool await_resume() const noexcept {
+    return m_valid && lg_flush_done(m_inst, &m_ticket);
+  }
+
+private:
+  static void resume(void* self) {
+    static_cast<LgFlushAwaiter*>(self)->m_handle.resume();
+  }
+
+  Logger* m_inst;
+  LgFlushTicket m_ticket;
+  bool m_valid;
+  std::coroutine_handle<> m_handle;
+};
+
+inline LgFlushAwaiter lg_flushed(Logger* inst = NULL) { return LgFlushAwaiter(inst); }
+# endif
+#endif
+
 #define sinfo   LoggerStream(LG_INFO)
 #define serr    LoggerStream(LG_ERROR)
 #define swarn   LoggerStream(LG_WARNING)
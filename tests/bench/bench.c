@@ -0,0 +1,206 @@
+/*
+  bench - cost of one call of the producer APIs and of the writer's
+  work per message, everything goes to a /dev/null sink
+
+  Usage:
+    bench [-n CALLS] [-r RUNS] [-c CPU]
+
+    CALLS: calls per run (200000)
+    RUNS:  median of them is printed (7)
+    CPU:   producer is pinned to it (0), -1 = not pinned,
+           writer gets the next one
+
+  Producer calls are timed in pieces of BENCH_CHUNK, writer drains the
+  ring between them (not timed) so nothing is dropped or blocked on
+*/
+#define _GNU_SOURCE
+#define LOGGER_IMPLEMENTATION
+#include "logger.h"
+#include "bench.h"
+#include <unistd.h>
+
+#define MSG "user 42 logged in from 10.0.0.1"
+
+static Logger* lg;
+
+static void drain(void)
+{
+  lg_flush(lg, 10000);
+}
+
+static bool pin(int cpu)
+{
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  (void)cpu;
+  return false;
+#endif
+}
+
+// writer's side: formats and writes payloads itself while the writer is kept out
+static void bench_writer(const BenchOpts* o, BenchStat* fmt, BenchStat* wr)
+{
+  LgBatch* b = (LgBatch*)calloc(1, sizeof(LgBatch)); // time cache starts invalid
+  LogPayload pl;
+  double fns[64], fcyc[64], wns[64], wcyc[64];
+  int runs = o->runs < 64 ? o->runs : 64;
+  if (!b) return;
+
+  memset(&pl, 0, sizeof(pl));
+  pl.length = strlen(MSG);
+  memcpy(pl.msg, MSG, pl.length + 1);
+  pl.level = LG_INFO;
+  pl.sink_mask = ~0u;
+
+  while (atomic_exchange_explicit(&lg->consuming, true, memory_order_acquire)) LOGGER_YIELD();
+  for (int r = -1; r < runs; r++) {
+    uint64_t f_ns = 0, f_cyc = 0, w_ns = 0, w_cyc = 0;
+    for (long done = 0; done < o->iters; done += LOGGER_MAX_BATCH) {
+      pl.ts = lgi_clock_ns(false);
+      uint64_t t0 = bench_ns(), c0 = bench_cycles();
+      lgi_batch_begin(lg, b);
+      for (size_t i = 0; i < LOGGER_MAX_BATCH; i++) lgi_batch_add(lg, b, &pl);
+      b->count = LOGGER_MAX_BATCH;
+      uint64_t t1 = bench_ns(), c1 = bench_cycles();
+      lgi_batch_write(lg, b);
+      w_cyc += bench_cycles() - c1;
+      w_ns += bench_ns() - t1;
+      f_cyc += c1 - c0;
+      f_ns += t1 - t0;
+    }
+    if (r < 0) continue; // warm up
+    long n = (o->iters + LOGGER_MAX_BATCH - 1) / LOGGER_MAX_BATCH * LOGGER_MAX_BATCH;
+    fns[r] = (double)f_ns / (double)n;
+    fcyc[r] = (double)f_cyc / (double)n;
+    wns[r] = (double)w_ns / (double)n;
+    wcyc[r] = (double)w_cyc / (double)n;
+  }
+  atomic_store_explicit(&lg->consuming, false, memory_order_release);
+
+  fmt->ns = bench_median(fns, runs);
+  fmt->cycles = bench_median(fcyc, runs);
+  wr->ns = bench_median(wns, runs);
+  wr->cycles = bench_median(wcyc, runs);
+  lgi_batch_free(b);
+  free(b);
+}
+
+// whole writer path (pop, format, write, release) per message, timed from the producer
+static BenchStat bench_drain(const BenchOpts* o)
+{
+  double ns[64], cyc[64];
+  int runs = o->runs < 64 ? o->runs : 64;
+  BenchStat st = { 0, 0 };
+  for (int r = -1; r < runs; r++) {
+    uint64_t t_ns = 0, t_cyc = 0;
+    for (long base = 0; base < o->iters; base += BENCH_CHUNK) {
+      long n = base + BENCH_CHUNK < o->iters ? BENCH_CHUNK : o->iters - base;
+      // consuming flag keeps the writer out until the piece is in the ring
+      while (atomic_exchange_explicit(&lg->consuming, true, memory_order_acquire)) LOGGER_YIELD();
+      for (long i = 0; i < n; i++) lg_log_(lg, LG_INFO, MSG, sizeof(MSG) - 1);
+      atomic_store_explicit(&lg->consuming, false, memory_order_release);
+      uint64_t t0 = bench_ns(), c0 = bench_cycles();
+      drain();
+      t_cyc += bench_cycles() - c0;
+      t_ns += bench_ns() - t0;
+    }
+    if (r < 0) continue;
+    ns[r] = (double)t_ns / (double)o->iters;
+    cyc[r] = (double)t_cyc / (double)o->iters;
+  }
+  st.ns = bench_median(ns, runs);
+  st.cycles = bench_median(cyc, runs);
+  return st;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: bench [-n CALLS] [-r RUNS] [-c CPU]\n");
+}
+
+int main(int argc, char** argv)
+{
+  BenchOpts o = { BENCH_ITERS, BENCH_RUNS, 0 };
+  BenchStat st;
+  char writer_cpu[16] = "";
+
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0' || i + 1 >= argc) {
+      usage();
+      return 2;
+    }
+    long v = strtol(argv[++i], NULL, 10);
+    switch (argv[i - 1][1]) {
+    case 'n': o.iters = v > 0 ? v : BENCH_ITERS; break;
+    case 'r': o.runs = v > 0 ? (int)v : BENCH_RUNS; break;
+    case 'c': o.cpu = (int)v; break;
+    default:
+      usage();
+      return 2;
+    }
+  }
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  bool pinned = o.cpu >= 0 && pin(o.cpu);
+  if (pinned && cpus > 1) snprintf(writer_cpu, sizeof(writer_cpu), "%ld", (o.cpu + 1) % cpus);
+
+  LoggerConfig cfg = lg_get_defaults();
+  cfg.generateDefaultFile = false;
+  cfg.sinks.count = 0;
+  cfg.logPolicy = LG_BLOCK;
+  cfg.pipelineWrites = false;
+  if (writer_cpu[0]) cfg.writerOptions.cpus = writer_cpu;
+  FILE* null = fopen("/dev/null", "w");
+  if (!null || !lg_append_sink(&cfg, null, LG_OUT_FILE)) {
+    fprintf(stderr, "bench: cannot open /dev/null\n");
+    return 1;
+  }
+  lg = lg_alloc();
+  if (!lg || !lg_init(lg, "logs", cfg)) {
+    fprintf(stderr, "bench: cannot init the logger\n");
+    return 1;
+  }
+
+  char producer_cpu[16] = "any";
+  if (pinned) snprintf(producer_cpu, sizeof(producer_cpu), "%d", o.cpu);
+  printf("bench: %ld calls x %d runs (median), producer cpu %s, writer cpu %s, ring %d\n",
+         o.iters, o.runs, producer_cpu, writer_cpu[0] ? writer_cpu : "any", LOGGER_RING_SIZE);
+
+  // producer side
+  BENCH_LOOP(&o, st, drain, lg_log_(lg, LG_INFO, MSG, sizeof(MSG) - 1));
+  bench_print("lg_log_", st);
+  BENCH_LOOP(&o, st, drain, lg_flogi(lg, LG_INFO, MSG));
+  bench_print("lg_flogi (strlen)", st);
+  BENCH_LOOP(&o, st, drain, lg_vlog_(lg, LG_INFO, "user %ld logged in from %s", i, "10.0.0.1"));
+  bench_print("lg_vlog_", st);
+  BENCH_LOOP(&o, st, drain, lg_infoi(lg, "user %ld logged in from %s", i, "10.0.0.1"));
+  bench_print("lg_infoi (call site)", st);
+  BENCH_LOOP(&o, st, drain, {
+    LgReservation res;
+    if (lg_reserve(lg, LG_INFO, &res)) {
+      memcpy(res.buf, MSG, sizeof(MSG) - 1);
+      lg_commit(&res, sizeof(MSG) - 1, LG_INFO);
+    }
+  });
+  bench_print("lg_reserve + lg_commit", st);
+  st = bench_stream(&o, drain);
+  bench_print("LoggerStream", st);
+  char time_str[LOGGER_TIME_STR_SIZE];
+  BENCH_LOOP(&o, st, NULL, lg_get_time_str(lg, time_str));
+  bench_print("lg_get_time_str", st);
+
+  // writer side, per message
+  BenchStat fmt, wr;
+  bench_writer(&o, &fmt, &wr);
+  bench_print("writer: format", fmt);
+  bench_print("writer: write", wr);
+  bench_print("writer: drain", bench_drain(&o));
+
+  lg_destroy(lg);
+  lg_free(lg);
+  return 0;
+}
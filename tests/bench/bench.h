@@ -0,0 +1,103 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC 1
+#endif
+
+// calls per measured piece, half of the ring so it never fills (writer drains between them)
+#define BENCH_CHUNK 512
+#define BENCH_ITERS 200000
+#define BENCH_RUNS 7
+#define BENCH_WARMUP 20000
+
+typedef struct {
+  long iters;  // calls per run
+  int runs;    // median of them is reported
+  int cpu;     // producer's CPU, -1 = not pinned
+} BenchOpts;
+
+typedef struct {
+  double ns;
+  double cycles; // TSC ticks, 0 = no TSC
+} BenchStat;
+
+static inline uint64_t bench_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t bench_cycles(void)
+{
+#ifdef BENCH_HAS_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static int bench_cmp(const void* a, const void* b)
+{
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static inline double bench_median(double* v, int n)
+{
+  qsort(v, (size_t)n, sizeof(double), bench_cmp);
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// same columns every commit, diff two outputs to see what moved
+static inline void bench_print(const char* name, BenchStat st)
+{
+  if (st.cycles > 0) printf("%-28s %10.1f ns %10.1f cycles\n", name, st.ns, st.cycles);
+  else printf("%-28s %10.1f ns %10s cycles\n", name, st.ns, "-");
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+BenchStat bench_stream(const BenchOpts* o, void (*drain)(void));
+#ifdef __cplusplus
+}
+#endif
+
+/*
+  runs body o->iters times (i is the call number) in BENCH_CHUNK sized pieces, only the
+  calls are timed, drain() between pieces is not (NULL = no drain)
+*/
+#define BENCH_LOOP(o, st, drain, body)                                \
+  do {                                                                \
+    double ns_[64], cyc_[64];                                         \
+    void (*drain_)(void) = (drain);                                   \
+    int runs_ = (o)->runs < 64 ? (o)->runs : 64;                      \
+    for (long i = 0; i < BENCH_WARMUP; i++) {                         \
+      body;                                                           \
+      if (drain_ && i % BENCH_CHUNK == BENCH_CHUNK - 1) drain_();     \
+    }                                                                 \
+    if (drain_) drain_();                                             \
+    for (int r_ = 0; r_ < runs_; r_++) {                              \
+      uint64_t ns_sum = 0, cyc_sum = 0;                               \
+      for (long base_ = 0; base_ < (o)->iters; base_ += BENCH_CHUNK) { \
+        long end_ = base_ + BENCH_CHUNK < (o)->iters ? base_ + BENCH_CHUNK : (o)->iters; \
+        uint64_t t0_ = bench_ns(), c0_ = bench_cycles();              \
+        for (long i = base_; i < end_; i++) {                         \
+          body;                                                       \
+        }                                                             \
+        cyc_sum += bench_cycles() - c0_;                              \
+        ns_sum += bench_ns() - t0_;                                   \
+        if (drain_) drain_();                                         \
+      }                                                               \
+      ns_[r_] = (double)ns_sum / (double)(o)->iters;                  \
+      cyc_[r_] = (double)cyc_sum / (double)(o)->iters;                \
+    }                                                                 \
+    (st).ns = bench_median(ns_, runs_);                               \
+    (st).cycles = bench_median(cyc_, runs_);                          \
+  } while (0)
@@ -0,0 +1,10 @@
+// LoggerStream is C++, its cost is measured here (instance is bench.c's active one)
+#include "loggerstream.hpp"
+#include "bench.h"
+
+extern "C" BenchStat bench_stream(const BenchOpts* o, void (*drain)(void))
+{
+  BenchStat st;
+  BENCH_LOOP(o, st, drain, sinfo << "user" << i << "logged in from" << "10.0.0.1");
+  return st;
+}
@@ -0,0 +1,103 @@
+#define _GNU_SOURCE // usleep, logger.h comes after the libc headers
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <logger.h>
+
+// built with a small LOGGER_IOV_MAX, so a batch takes several writevs
+#define MESSAGES 30000
+#define PAUSE_EVERY 2500
+
+// bare lines, file contents can be compared byte by byte
+static int bare_format(const char* time_str, LgLogLevel level, const char* msg,
+                       uint32_t needed, LgMsgPack pack) {
+  (void)time_str;
+  (void)level;
+  (void)needed;
+  lg_str_format_into(&pack[LG_OUT_FILE], "%s\n", msg);
+  return 1;
+}
+
+// lengths vary, so lines cross block and stage boundaries anywhere
+static size_t pad_len(long i) {
+  return (size_t)(i * 37 % 181);
+}
+
+// odd lines are INFO, even ones ERROR, each sink takes one of them,
+// so every line of a batch is a run of its own
+static void append(LoggerConfig* cfg, const char* path, LgFileOptions* opts,
+                   LgLogLevel level, LgFile** h) {
+  size_t k = cfg->sinks.count;
+  if (opts) {
+    *h = lg_file_open(path, *opts);
+    if (*h) lg_append_file_sink(cfg, *h, LG_OUT_FILE);
+  } else {
+    FILE* f = fopen(path, "w"); // logger closes it
+    if (f) lg_append_sink(cfg, f, LG_OUT_FILE);
+  }
+  if (cfg->sinks.count > k) cfg->sinks.items[k].levelMask = LOGGER_LEVEL_BIT(level);
+}
+
+static int compare(const char* path, int odd) {
+  FILE* f = fopen(path, "r");
+  if (!f) return 1;
+  char pad[256], want[512], line[512];
+  memset(pad, 'x', sizeof(pad));
+  long at = -1, lines = 0;
+  for (long i = odd; i < MESSAGES && at < 0; i += 2) {
+    size_t n = (size_t)snprintf(want, sizeof(want), "%ld %.*s\n", i, (int)pad_len(i), pad);
+    if (!fgets(line, sizeof(line), f) || strlen(line) != n || memcmp(line, want, n) != 0)
+      at = lines;
+    lines++;
+  }
+  if (at < 0 && fgetc(f) != EOF) at = lines; // nothing past the last one
+  fclose(f);
+  if (at >= 0) printf("%s: differs at line %ld\n", path, at);
+  return at >= 0;
+}
+
+static int run(const char* name, LgFileOptions* opts) {
+  char odd_path[64], even_path[64];
+  snprintf(odd_path, sizeof(odd_path), "%s_odd.log", name);
+  snprintf(even_path, sizeof(even_path), "%s_even.log", name);
+  LgFile* h[2] = { NULL, NULL };
+  LoggerConfig cfg = lg_get_defaults();
+  cfg.sinks.count = 0;
+  cfg.generateDefaultFile = 0;
+  cfg.logPolicy = LG_BLOCK;
+  cfg.logFormatter = bare_format;
+  append(&cfg, odd_path, opts, LG_INFO, &h[0]);
+  append(&cfg, even_path, opts, LG_ERROR, &h[1]);
+  if (cfg.sinks.count != 2) return 1;
+  Logger* lg = lg_alloc();
+  if (!lg_init(lg, "logs", cfg)) return 1;
+
+  char pad[256];
+  for (long i = 0; i < MESSAGES; i++) {
+    memset(pad, 'x', pad_len(i));
+    pad[pad_len(i)] = '\0';
+    if (i % 2) lg_infoi(lg, "%ld %s", i, pad);
+    else lg_errori(lg, "%ld %s", i, pad);
+    // writer goes idle, staged partial blocks go out and get rewritten
+    if (i % PAUSE_EVERY == 0) usleep(5000);
+  }
+  lg_destroy(lg);
+  lg_free(lg);
+
+  int rc = compare(odd_path, 1) | compare(even_path, 0);
+  printf("%s: %s\n", name, rc ? "FAILED" : "ok");
+  return rc;
+}
+
+int main() {
+  LgFileOptions staged = { 0, 0, LG_SYNC_NONE, 0, 0 };
+  LgFileOptions direct = { 1, 0, LG_SYNC_NONE, 0, 0 };
+  LgFileOptions bytes = { 1, 0, LG_SYNC_BYTES, 1000, 0 };
+  LgFileOptions interval = { 0, 1, LG_SYNC_INTERVAL, 0, 1 };
+  int rc = run("plain", NULL);
+  rc |= run("staged", &staged);
+  rc |= run("direct", &direct);
+  rc |= run("bytes", &bytes);
+  rc |= run("interval", &interval);
+  return rc;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+#include <logger.h>
+
+/*
+  Per-sink level filters, category level/sink inheritance and the
+  category sink bits when an earlier sink is removed. Every message
+  is tagged and each file has to hold exactly the tags it's listed for
+*/
+typedef struct {
+  const char* tag;
+  const char* files; // of "abcd"
+} Expect;
+
+static const Expect expects[] = {
+  { "i1", "ac" },     // b is WARNING and up, c is INFO only
+  { "w1", "ab" },
+  { "e1", "ab" },
+  { "h_info", "" },   // net.http inherits net's WARNING filter
+  { "h_warn", "ab" },
+  { "h_a", "a" },     // inherits net's sinks
+  { "h_b", "b" },     // its own sinks
+  { "h_inh", "a" },   // back to net's
+  { "d_info", "c" },  // db names b and c, a is removed before
+  { "d_warn", "b" },
+  { "h_new", "" },    // net named only a, its bit went to d
+  { "plain", "cd" },
+  { "d_warn2", "b" },
+};
+
+static int has(const char* path, const char* tag) {
+  FILE* f = fopen(path, "r");
+  if (!f) return -1;
+  char line[512], want[64];
+  snprintf(want, sizeof(want), "t=%s\n", tag);
+  int n = 0;
+  while (fgets(line, sizeof(line), f)) {
+    size_t len = strlen(line), wl = strlen(want);
+    n += len >= wl && strcmp(line + len - wl, want) == 0;
+  }
+  fclose(f);
+  return n;
+}
+
+int main() {
+  FILE* a = fopen("a.log", "w"); // logger closes them
+  FILE* b = fopen("b.log", "w");
+  FILE* c = fopen("c.log", "w");
+  if (!a || !b || !c) return 1;
+  LoggerConfig cfg = lg_get_defaults();
+  cfg.sinks.count = 0;
+  cfg.generateDefaultFile = 0;
+  cfg.logPolicy = LG_BLOCK;
+  lg_append_sink(&cfg, a, LG_OUT_FILE);                                // bit 0
+  lg_append_sink_filtered(&cfg, b, LG_OUT_FILE, LG_WARNING, 0);        // bit 1
+  lg_append_sink_filtered(&cfg, c, LG_OUT_FILE, LG_INFO,
+                          LOGGER_LEVEL_BIT(LG_INFO));                  // bit 2
+  Logger* lg = lg_alloc();
+  if (!lg_init(lg, "logs", cfg)) return 1;
+
+  lg_infoi(lg, "t=i1");
+  lg_warni(lg, "t=w1");
+  lg_errori(lg, "t=e1");
+
+  LgCategory* net = lg_category(lg, "net");
+  LgCategory* http = lg_category(lg, "net.http");
+  LgCategory* db = lg_category(lg, "db");
+  if (!net || !http || !db) return 1;
+  lg_category_set_level(net, LG_WARNING, 0);
+  lg_cinfo(http, "t=h_info");
+  lg_cwarn(http, "t=h_warn");
+  lg_category_set_sinks(net, 1u << 0);
+  lg_cwarn(http, "t=h_a");
+  lg_category_set_sinks(http, 1u << 1);
+  lg_cwarn(http, "t=h_b");
+  lg_category_inherit(http);
+  lg_cwarn(http, "t=h_inh");
+
+  // b and c keep their bits when a goes, d takes a's
+  lg_category_set_sinks(db, (1u << 1) | (1u << 2));
+  if (!lg_flush(lg, 5000) || !lg_remove_sink(lg, a)) return 1;
+  lg_cinfo(db, "t=d_info");
+  lg_cwarn(db, "t=d_warn");
+  if (!lg_flush(lg, 5000)) return 1;
+  FILE* d = fopen("d.log", "w");
+  if (!d || !lg_add_sink(lg, d, LG_OUT_FILE)) return 1;
+  lg_cwarn(http, "t=h_new");
+  lg_infoi(lg, "t=plain");
+  lg_cwarn(db, "t=d_warn2");
+  lg_destroy(lg);
+  lg_free(lg);
+
+  int bad = 0;
+  const char* files = "abcd";
+  for (size_t i = 0; i < sizeof(expects) / sizeof(expects[0]); i++) {
+    for (const char* f = files; *f; f++) {
+      char path[16];
+      snprintf(path, sizeof(path), "%c.log", *f);
+      int want = strchr(expects[i].files, *f) != NULL;
+      int got = has(path, expects[i].tag);
+      if (got != want) {
+        printf("%s: %d in %s, expected %d\n", expects[i].tag, got, path, want);
+        bad++;
+      }
+    }
+  }
+  printf("Filters: %d wrong\n", bad);
+  return bad != 0;
+}
@@ -0,0 +1,125 @@
+#define _GNU_SOURCE // usleep, logger.h comes after the libc headers
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <logger.h>
+
+#define BACKLOG 1000
+#define FLOOD 200000
+#define ROUNDS 20
+
+// slow INFO lines, so a backlog builds up behind the writer
+static int slow_format(const char* time_str, LgLogLevel level, const char* msg,
+                       uint32_t needed, LgMsgPack pack) {
+  (void)needed;
+  if (level == LG_INFO) usleep(50);
+  lg_str_format_into(&pack[LG_OUT_FILE], "%s [%s] %s\n", time_str, lg_lvl_to_str(level), msg);
+  return 1;
+}
+
+static Logger* open_logger(const char* path, LgLogPolicy policy, log_formatter_t fmt) {
+  FILE* out = fopen(path, "w"); // logger closes it
+  if (!out) return NULL;
+  LoggerConfig cfg = lg_get_defaults();
+  cfg.sinks.count = 0;
+  cfg.generateDefaultFile = 0;
+  cfg.logPolicy = policy;
+  cfg.logFormatter = fmt;
+  cfg.priorityLane = 1;
+  lg_append_sink(&cfg, out, LG_OUT_FILE);
+  Logger* l = lg_alloc();
+  if (!lg_init(l, "logs", cfg)) return NULL;
+  return l;
+}
+
+// error comes in the next batches, not after the whole INFO backlog
+static int ahead() {
+  Logger* lg = open_logger("ahead.log", LG_BLOCK, slow_format);
+  if (!lg) return 1;
+  for (long i = 0; i < BACKLOG; i++) lg_infoi(lg, "backlog %ld", i);
+  lg_errori(lg, "urgent");
+  lg_destroy(lg);
+  lg_free(lg);
+
+  FILE* f = fopen("ahead.log", "r");
+  if (!f) return 1;
+  char line[512];
+  long infos = 0, at = -1;
+  while (fgets(line, sizeof(line), f)) {
+    if (strstr(line, "] urgent")) at = infos;
+    else if (strstr(line, "] backlog")) infos++;
+  }
+  fclose(f);
+  printf("Lane: urgent after %ld of %ld backlog lines\n", at, infos);
+  return at < 0 || infos != BACKLOG || at > BACKLOG / 2;
+}
+
+// ring and lane both drop, records add up to the counter and the losses
+static int drops() {
+  Logger* lg = open_logger("drops.log", LG_DROP, NULL);
+  if (!lg) return 1;
+  for (long i = 0; i < FLOOD; i++) {
+    if (i % 4 == 0) lg_errori(lg, "e %ld", i);
+    else lg_infoi(lg, "i %ld", i);
+  }
+  size_t lost = lg_get_dropped(lg);
+  lg_destroy(lg);
+  lg_free(lg);
+
+  FILE* f = fopen("drops.log", "r");
+  if (!f) return 1;
+  char line[512];
+  long seen = 0, dropped = 0, prev[2] = { -1, -1 }, bad = 0;
+  while (fgets(line, sizeof(line), f)) {
+    const char* p;
+    long n;
+    if ((p = strstr(line, "dropped ")) && sscanf(p, "dropped %ld", &n) == 1) {
+      dropped += n;
+    } else if ((p = strstr(line, "] ")) && (p[2] == 'e' || p[2] == 'i') &&
+               sscanf(p + 4, "%ld", &n) == 1) {
+      int q = p[2] == 'e';
+      if (n <= prev[q]) bad++;
+      prev[q] = n;
+      seen++;
+    }
+  }
+  fclose(f);
+  printf("Lane drops: written %ld, dropped %ld (%zu counted), %ld out of order\n",
+         seen, dropped, lost, bad);
+  return bad != 0 || seen + dropped != FLOOD || (size_t)dropped != lost;
+}
+
+static long count(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (!f) return -1;
+  char line[512];
+  long n = 0;
+  while (fgets(line, sizeof(line), f)) n += strstr(line, "] f ") != NULL;
+  fclose(f);
+  return n;
+}
+
+// flush covers both rings, whatever is logged before it is on the file
+static int flush() {
+  Logger* lg = open_logger("flush.log", LG_BLOCK, NULL);
+  if (!lg) return 1;
+  long logged = 0, bad = 0;
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = 0; i < 500; i++, logged++) {
+      if (i % 3 == 0) lg_errori(lg, "f %ld", logged);
+      else lg_infoi(lg, "f %ld", logged);
+    }
+    if (!lg_flush(lg, 5000) || count("flush.log") != logged) bad++;
+  }
+  lg_destroy(lg);
+  lg_free(lg);
+  printf("Lane flush: %ld logged, %ld rounds short\n", logged, bad);
+  return bad != 0;
+}
+
+int main() {
+  int rc = ahead();
+  rc |= drops();
+  rc |= flush();
+  return rc;
+}
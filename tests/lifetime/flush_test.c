@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <logger.h>
+
+#define ROUNDS 200
+#define WAITERS 2
+
+static Logger* lg;
+static atomic_size_t queued;
+static atomic_size_t called;
+
+static void on_flushed(void* arg) {
+  atomic_fetch_add((atomic_size_t*)arg, 1);
+}
+
+void* waiter(void* arg) {
+  (void)arg;
+  LgFlushTicket t;
+  // flush_wait and flush_async keep going while lg_destroy runs,
+  // ticket of a dead instance fails and the waits return
+  while (lg_infoi(lg, "waiting") && lg_flush_ticket(lg, &t))
+    lg_flush_wait(lg, &t, 1000);
+  return NULL;
+}
+
+void* registrar(void* arg) {
+  (void)arg;
+  LgFlushTicket t;
+  while (lg_infoi(lg, "registering") && lg_flush_ticket(lg, &t)) {
+    // every queued callback is called, by the writer or by lg_destroy
+    if (lg_flush_async(lg, &t, on_flushed, &called) == 1)
+      atomic_fetch_add(&queued, 1);
+  }
+  // one more after the instance died, it can't be queued anymore
+  if (lg_flush_async(lg, &t, on_flushed, &called) == 1)
+    atomic_fetch_add(&queued, 1);
+  return NULL;
+}
+
+int main() {
+  pthread_t threads[WAITERS + 1];
+  for (int r = 0; r < ROUNDS; r++) {
+    LoggerConfig cfg = lg_get_defaults();
+    cfg.sinks.count = 0;
+    lg = lg_alloc();
+    if (!lg_init(lg, "logs", cfg)) return 1;
+    for (int i = 0; i < WAITERS; i++)
+      pthread_create(&threads[i], NULL, waiter, NULL);
+    pthread_create(&threads[WAITERS], NULL, registrar, NULL);
+    usleep(1000 * (r % 5));
+
+    lg_destroy(lg);
+    for (int i = 0; i <= WAITERS; i++)
+      pthread_join(threads[i], NULL);
+    lg_free(lg);
+  }
+
+  size_t q = atomic_load(&queued);
+  size_t c = atomic_load(&called);
+  printf("Callbacks queued: %zu, called: %zu\n", q, c);
+  return q == c ? 0 : 1;
+}
@@ -1,9 +1,12 @@
 #include <stdio.h>
 #include <pthread.h>
+#include <unistd.h>
 #define LOGGER_DEBUG
 #include <logger.h>
 
-static pthread_t thread;
+#define THREADS 4
+
+static pthread_t threads[THREADS];
 static Logger lg;
 
 void* producer(void* arg) {
@@ -15,32 +18,29 @@ void* producer(void* arg) {
     if (ok) i++;
     else {
       failed++;
-      if (failed > 1000000) break;
+      // blocking instance fails only after destroy, that's when we quit
+      if (!lg_is_alive(&lg)) break;
     }
   }
-  printf("Iterated: %ld\n", i);
+  printf("Iterated: %zu\n", i);
   return NULL;
 }
 
 int main() {
   LoggerConfig cfg = lg_get_defaults();
 
-  // IF YOU UNCOMMENT THIS: RACE CONDITION WILL BE TRIGGERED (at least in my machine)
-  //cfg.logPolicy = LG_BLOCK;
+  // every message that got in before destroy is written
+  cfg.logPolicy = LG_BLOCK;
   lg_init(&lg, "logs", cfg);
-  pthread_create(&thread, NULL, producer, NULL);
-  sleep(1); // Wait for producer to push some messages
-
-  // Make sure that all of your producer threads
-  // finished (call pthread_join) and then call destroy
-  // otherwise it'll trigger something like Use-After-Destroy
-  // (btw, destroy does not free your instance struct)
+  for (int i = 0; i < THREADS; i++)
+    pthread_create(&threads[i], NULL, producer, NULL);
+  sleep(1); // Wait for producers to push some messages
 
-  // THIS IS WRONG:
+  // destroy doesn't need producers to be joined, ones in the
+  // middle of a log call finish it and the rest fail fast
+  // (btw, destroy does not free your instance struct, so it
+  // has to outlive the threads that can still call into it)
   lg_destroy(&lg);
-  pthread_join(thread, NULL);
-
-  // THIS IS RIGHT:
-  //pthread_join(thread, NULL);
-  //lg_destroy(&lg);
+  for (int i = 0; i < THREADS; i++)
+    pthread_join(threads[i], NULL);
 }
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <logger.h>
+
+#define THREADS 4
+#define MESSAGES 50000
+#define LANE_EVERY 16 // every 16th one is an error
+
+/*
+  Parallel format workers hand batches to the I/O thread through the
+  reorder buffer, pipelined writer through its double buffer. Either
+  way a thread's messages have to come out in its order, lane ones
+  among themselves and ring ones among themselves
+*/
+static Logger* lg;
+
+void* producer(void* arg) {
+  long id = (long)arg;
+  for (long i = 0; i < MESSAGES; i++) {
+    if (i % LANE_EVERY == 0) lg_errori(lg, "p%ld %ld", id, i);
+    else lg_infoi(lg, "p%ld %ld", id, i);
+  }
+  return NULL;
+}
+
+static int run(const char* name, int workers, int pipelined, int lane) {
+  char path[64];
+  snprintf(path, sizeof(path), "%s.log", name);
+  FILE* out = fopen(path, "w"); // logger closes it
+  if (!out) return 1;
+  LoggerConfig cfg = lg_get_defaults();
+  cfg.sinks.count = 0;
+  cfg.generateDefaultFile = 0;
+  cfg.logPolicy = LG_BLOCK;
+  cfg.formatWorkers = workers;
+  cfg.pipelineWrites = pipelined;
+  cfg.priorityLane = lane;
+  lg_append_sink(&cfg, out, LG_OUT_FILE);
+  lg = lg_alloc();
+  if (!lg_init(lg, "logs", cfg)) return 1;
+
+  pthread_t threads[THREADS];
+  for (long i = 0; i < THREADS; i++)
+    pthread_create(&threads[i], NULL, producer, (void*)i);
+  for (int i = 0; i < THREADS; i++)
+    pthread_join(threads[i], NULL);
+  lg_destroy(lg);
+  lg_free(lg);
+
+  FILE* f = fopen(path, "r");
+  if (!f) return 1;
+  char line[512];
+  long last[THREADS][2]; // per thread, [0] ring [1] lane
+  long seen = 0, bad = 0;
+  for (int t = 0; t < THREADS; t++) last[t][0] = last[t][1] = -1;
+  while (fgets(line, sizeof(line), f)) {
+    const char* p = strstr(line, "] p");
+    long who, i;
+    if (!p || sscanf(p + 3, "%ld %ld", &who, &i) != 2 || who < 0 || who >= THREADS) {
+      bad++;
+      continue;
+    }
+    int q = i % LANE_EVERY == 0;
+    if (i <= last[who][q]) bad++;
+    last[who][q] = i;
+    seen++;
+  }
+  fclose(f);
+  printf("%s: %ld of %d, %ld out of order\n", name, seen, THREADS * MESSAGES, bad);
+  return bad != 0 || seen != THREADS * MESSAGES;
+}
+
+int main() {
+  int rc = run("workers", 4, 0, 1);
+  rc |= run("workers_ring", 3, 0, 0);
+  rc |= run("pipelined", 0, 1, 0);
+  rc |= run("pipelined_lane", 0, 1, 1);
+  return rc;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <string.h>
+#include <logger.h>
+
+#define MESSAGES 300000
+
+/*
+  One producer floods a small ring, so numbers have to come out in order,
+  lost ones have to add up to the "dropped N messages" records and each
+  record has to be right where its gap starts
+*/
+static int run(LgLogPolicy policy, size_t spill_max, const char* path) {
+  FILE* out = fopen(path, "w"); // logger closes it
+  if (!out) return 1;
+  LoggerConfig cfg = lg_get_defaults();
+  cfg.sinks.count = 0;
+  cfg.generateDefaultFile = 0;
+  cfg.logPolicy = policy;
+  cfg.spillMaxQueued = spill_max;
+  lg_append_sink(&cfg, out, LG_OUT_FILE);
+  Logger* lg = lg_alloc();
+  if (!lg_init(lg, "logs", cfg)) return 1;
+  for (long i = 0; i < MESSAGES; i++)
+    lg_infoi(lg, "req %ld", i);
+  size_t lost = lg_get_dropped(lg);
+  lg_destroy(lg);
+  lg_free(lg);
+
+  FILE* f = fopen(path, "r");
+  if (!f) return 1;
+  char line[512];
+  long prev = -1, seen = 0, dropped = 0, records = 0, bad = 0;
+  long pending = 0; // record that's waiting for its gap
+  while (fgets(line, sizeof(line), f)) {
+    const char* p;
+    long n;
+    if ((p = strstr(line, "dropped ")) && sscanf(p, "dropped %ld", &n) == 1) {
+      dropped += n;
+      records++;
+      pending = 1;
+    } else if ((p = strstr(line, "] req ")) && sscanf(p, "] req %ld", &n) == 1) {
+      if (n <= prev) bad++; // out of order
+      if (pending && n == prev + 1) bad++; // record isn't at a gap
+      pending = 0;
+      prev = n;
+      seen++;
+    }
+  }
+  fclose(f);
+  printf("%s (spill max %zu): written %ld, dropped %ld in %ld records (%zu counted), %ld misplaced\n",
+         policy == LG_SPILL ? "spill" : "drop", spill_max, seen, dropped, records, lost, bad);
+  if (bad != 0 || seen + dropped != MESSAGES || (size_t)dropped != lost) return 1;
+  // whole burst fits in the ring and the spill bound, so nothing is lost
+  return policy == LG_SPILL && spill_max >= MESSAGES && lost != 0;
+}
+
+int main() {
+  int rc = run(LG_DROP, 0, "drop.log");
+  rc |= run(LG_SPILL, 0, "spill.log"); // default bound, a burst past it drops
+  rc |= run(LG_SPILL, MESSAGES, "lossless.log");
+  return rc;
+}
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <logger.h>
+
+#define INSTANCES 4
+#define MESSAGES 50000
+
+static Logger* lgs[INSTANCES];
+
+void* producer(void* arg) {
+  long id = (long)arg;
+  for (long i = 0; i < MESSAGES; i++)
+    lg_infoi(lgs[id], "i%ld %ld", id, i);
+  return NULL;
+}
+
+// one file per instance, all of its messages and nobody else's
+static int check(long id, const char* path) {
+  FILE* f = fopen(path, "r");
+  if (!f) return 1;
+  char line[512];
+  long next = 0, bad = 0;
+  while (fgets(line, sizeof(line), f)) {
+    const char* p = strstr(line, "] i");
+    long who, i;
+    if (!p || sscanf(p + 3, "%ld %ld", &who, &i) != 2 || who != id || i != next) {
+      bad++;
+      continue;
+    }
+    next = i + 1;
+  }
+  fclose(f);
+  printf("Instance %ld: %ld messages, %ld bad\n", id, next, bad);
+  return bad || next != MESSAGES;
+}
+
+int main() {
+  // two writers service four instances
+  LgWriterPool* pool = lg_pool_create(2);
+  if (!pool) return 1;
+  char path[INSTANCES][32];
+  for (long i = 0; i < INSTANCES; i++) {
+    snprintf(path[i], sizeof(path[i]), "pool%ld.log", i);
+    FILE* out = fopen(path[i], "w"); // logger closes it
+    if (!out) return 1;
+    LoggerConfig cfg = lg_get_defaults();
+    cfg.sinks.count = 0;
+    cfg.generateDefaultFile = 0;
+    cfg.logPolicy = LG_BLOCK;
+    cfg.writerPool = pool;
+    lg_append_sink(&cfg, out, LG_OUT_FILE);
+    lgs[i] = lg_alloc();
+    if (!lg_init(lgs[i], "logs", cfg)) return 1;
+  }
+
+  pthread_t threads[INSTANCES];
+  for (long i = 0; i < INSTANCES; i++)
+    pthread_create(&threads[i], NULL, producer, (void*)i);
+  // first one is destroyed while the others still log through the pool
+  pthread_join(threads[0], NULL);
+  lg_destroy(lgs[0]);
+  for (int i = 1; i < INSTANCES; i++)
+    pthread_join(threads[i], NULL);
+  for (int i = 1; i < INSTANCES; i++)
+    lg_destroy(lgs[i]);
+  if (!lg_pool_destroy(pool)) return 1;
+
+  int rc = 0;
+  for (long i = 0; i < INSTANCES; i++) {
+    rc |= check(i, path[i]);
+    lg_free(lgs[i]);
+  }
+  return rc;
+}
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <logger.h>
+
+#define THREADS 4
+#define MESSAGES 50000
+
+static Logger* lg;
+
+// every 7th reservation is aborted, the rest are written in place
+void* producer(void* arg) {
+  long id = (long)arg;
+  for (long i = 0; i < MESSAGES; i++) {
+    LgReservation res;
+    if (!lg_reserve(lg, LG_INFO, &res)) return (void*)1;
+    if (i % 7 == 0) {
+      snprintf(res.buf, res.cap, "p%ld aborted %ld", id, i);
+      lg_abort(&res);
+      continue;
+    }
+    int n = snprintf(res.buf, res.cap, "p%ld %ld", id, i);
+    if (!lg_commit(&res, (size_t)n, LG_INFO)) return (void*)1;
+  }
+  return NULL;
+}
+
+int main() {
+  FILE* out = fopen("reserve.log", "w"); // logger closes it
+  if (!out) return 1;
+  LoggerConfig cfg = lg_get_defaults();
+  cfg.sinks.count = 0;
+  cfg.generateDefaultFile = 0;
+  cfg.logPolicy = LG_BLOCK;
+  lg_append_sink(&cfg, out, LG_OUT_FILE);
+  lg = lg_alloc();
+  if (!lg_init(lg, "logs", cfg)) return 1;
+
+  // a slow reservation holds the ring back, nothing after it comes out first
+  LgReservation first;
+  if (!lg_reserve(lg, LG_INFO, &first)) return 1;
+  int rc = 0;
+  pthread_t threads[THREADS];
+  for (long i = 0; i < THREADS; i++)
+    pthread_create(&threads[i], NULL, producer, (void*)i);
+  int n = snprintf(first.buf, first.cap, "first");
+  lg_commit(&first, (size_t)n, LG_INFO);
+  for (int i = 0; i < THREADS; i++) {
+    void* ret;
+    pthread_join(threads[i], &ret);
+    if (ret) rc = 1;
+  }
+  lg_destroy(lg);
+  lg_free(lg);
+
+  FILE* f = fopen("reserve.log", "r");
+  if (!f) return 1;
+  char line[512];
+  long next[THREADS] = {0};
+  long lines = 0, bad = 0;
+  while (fgets(line, sizeof(line), f)) {
+    const char* p = strstr(line, "] ");
+    long id, i;
+    if (!p) { bad++; continue; }
+    if (lines++ == 0) {
+      if (strcmp(p + 2, "first\n") != 0) bad++;
+      continue;
+    }
+    if (strstr(p, "aborted") || sscanf(p + 2, "p%ld %ld", &id, &i) != 2 ||
+        id < 0 || id >= THREADS || i < next[id] || i % 7 == 0) {
+      bad++;
+      continue;
+    }
+    next[id] = i + 1;
+  }
+  fclose(f);
+  long want = 1 + THREADS * (MESSAGES - (MESSAGES + 6) / 7);
+  printf("Lines: %ld of %ld, bad: %ld\n", lines, want, bad);
+  return rc || bad || lines != want;
+}
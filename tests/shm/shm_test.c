@@ -0,0 +1,86 @@
+#define _GNU_SOURCE // memfd_create, logger.h comes after the libc headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <logger.h>
+
+#define CHILDREN 2
+#define MESSAGES 20000
+
+// logs "p<id> <i>" lines, every producer's have to come out whole and in order
+static void produce(Logger* lg, int id) {
+  for (int i = 0; i < MESSAGES; i++)
+    lg_infoi(lg, "p%d %d", id, i);
+}
+
+static int check(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (!f) return 1;
+  int next[CHILDREN + 1] = {0};
+  char line[512];
+  int bad = 0;
+  while (fgets(line, sizeof(line), f)) {
+    const char* p = strstr(line, "] p");
+    int id, i;
+    if (!p || sscanf(p + 3, "%d %d", &id, &i) != 2 || id < 0 || id > CHILDREN) continue;
+    if (i != next[id]) bad++;
+    next[id] = i + 1;
+  }
+  fclose(f);
+  for (int id = 0; id <= CHILDREN; id++) {
+    printf("Producer %d: %d messages\n", id, next[id]);
+    if (next[id] != MESSAGES) bad++;
+  }
+  return bad != 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc == 4 && strcmp(argv[1], "child") == 0) {
+    // exec'ed one, attaches to the fd it got
+    Logger* lg = lg_alloc();
+    if (!lg_attach(lg, atoi(argv[2]))) return 1;
+    produce(lg, atoi(argv[3]));
+    lg_destroy(lg);
+    lg_free(lg);
+    return 0;
+  }
+
+  FILE* out = fopen("shm_test.log", "w"); // logger closes it
+  if (!out) return 1;
+  LoggerConfig cfg = lg_get_defaults();
+  cfg.sinks.count = 0;
+  cfg.generateDefaultFile = 0;
+  cfg.sharedRing = 1;
+  cfg.logPolicy = LG_BLOCK;
+  lg_append_sink(&cfg, out, LG_OUT_FILE);
+  Logger* lg = lg_alloc();
+  if (!lg_init(lg, "logs", cfg)) return 1;
+
+  int fd = dup(lg_shared_fd(lg)); // its own one is close-on-exec
+  char fds[16];
+  snprintf(fds, sizeof(fds), "%d", fd);
+  pid_t kids[CHILDREN];
+  for (int c = 0; c < CHILDREN; c++) {
+    char ids[16];
+    snprintf(ids, sizeof(ids), "%d", c + 1);
+    kids[c] = fork();
+    if (kids[c] == 0) {
+      execl(argv[0], argv[0], "child", fds, ids, (char*)NULL);
+      _exit(1);
+    }
+  }
+  produce(lg, 0);
+
+  int rc = 0;
+  for (int c = 0; c < CHILDREN; c++) {
+    int st;
+    if (waitpid(kids[c], &st, 0) < 0 || !WIFEXITED(st) || WEXITSTATUS(st) != 0) rc = 1;
+  }
+  lg_destroy(lg); // writes everything that's on the ring
+  lg_free(lg);
+  close(fd);
+  if (rc) return rc;
+  return check("shm_test.log");
+}
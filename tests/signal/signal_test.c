@@ -0,0 +1,148 @@
+#define _GNU_SOURCE // sigaction and friends, logger.h comes after the libc headers
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <logger.h>
+
+#define SIGNALS 500
+
+static Logger* lg;
+static volatile sig_atomic_t logged = 0;
+static volatile sig_atomic_t stop = 0;
+static pthread_t main_th;
+
+// real handler interrupting lg_infoi calls of the same thread
+static void on_usr1(int sig) {
+  if (lg_log_signal_safe(lg, LG_WARNING, "signal %d seen %d %s", sig, (int)logged, "here"))
+    logged++;
+}
+
+static void on_segv(int sig) {
+  lg_log_signal_safe(lg, LG_ERROR, "crashed with %d at %p", sig, (void*)&sig);
+  lg_drain_signal_safe(lg, 4096);
+  _exit(3);
+}
+
+void* sender(void* arg) {
+  (void)arg;
+  for (int i = 0; i < SIGNALS; i++) {
+    pthread_kill(main_th, SIGUSR1);
+    usleep(100);
+  }
+  stop = 1;
+  return NULL;
+}
+
+static Logger* open_logger(const char* path) {
+  FILE* out = fopen(path, "w"); // logger closes it
+  if (!out) return NULL;
+  LoggerConfig cfg = lg_get_defaults();
+  cfg.sinks.count = 0;
+  cfg.generateDefaultFile = 0;
+  lg_append_sink(&cfg, out, LG_OUT_FILE);
+  Logger* l = lg_alloc();
+  if (!lg_init(l, "logs", cfg)) return NULL;
+  return l;
+}
+
+// LgFile sink, the fork's child has rings and file but no writer thread
+static Logger* open_handle_logger(const char* path, int pipelined) {
+  LgFileOptions opts;
+  memset(&opts, 0, sizeof(opts));
+  opts.sync = LG_SYNC_BYTES;
+  LgFile* f = lg_file_open(path, opts);
+  if (!f) return NULL;
+  LoggerConfig cfg = lg_get_defaults();
+  cfg.sinks.count = 0;
+  cfg.generateDefaultFile = 0;
+  cfg.pipelineWrites = pipelined;
+  cfg.localTime = 0; // drained lines have the style of the others then
+  cfg.timeStyle = LG_TIME_ISO8601;
+  lg_append_file_sink(&cfg, f, LG_OUT_FILE);
+  Logger* l = lg_alloc();
+  if (!lg_init(l, "logs", cfg)) return NULL;
+  return l;
+}
+
+static int drain_in_child(Logger* l) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    for (int i = 0; i < 5; i++) lg_log_signal_safe(l, LG_INFO, "drained %d", i);
+    _exit(lg_drain_signal_safe(l, 4096) ? 0 : 4);
+  }
+  int st;
+  if (waitpid(pid, &st, 0) < 0 || !WIFEXITED(st)) return -1;
+  return WEXITSTATUS(st);
+}
+
+static int count(const char* path, const char* text) {
+  FILE* f = fopen(path, "r");
+  if (!f) return -1;
+  char line[512];
+  int n = 0;
+  while (fgets(line, sizeof(line), f)) n += strstr(line, text) != NULL;
+  fclose(f);
+  return n;
+}
+
+int main() {
+  // signals while the thread is in the middle of its own log calls
+  lg = open_logger("signal.log");
+  if (!lg) return 1;
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_usr1;
+  sigaction(SIGUSR1, &sa, NULL);
+  main_th = pthread_self();
+  pthread_t th;
+  pthread_create(&th, NULL, sender, NULL);
+  long i = 0;
+  while (!stop) lg_infoi(lg, "request %ld", i++);
+  pthread_join(th, NULL);
+  lg_destroy(lg);
+  lg_free(lg);
+  int seen = count("signal.log", "seen");
+  int whole = count("signal.log", "here");
+  printf("Signal messages: %d logged, %d written\n", (int)logged, seen);
+  if (seen != logged || whole != seen) return 1;
+
+  // crash handler of a process that never gets back to its writer
+  pid_t pid = fork();
+  if (pid == 0) {
+    lg = open_logger("crash.log");
+    if (!lg) _exit(1);
+    sa.sa_handler = on_segv;
+    sigaction(SIGSEGV, &sa, NULL);
+    lg_infoi(lg, "about to crash");
+    raise(SIGSEGV);
+    _exit(1);
+  }
+  int st;
+  if (waitpid(pid, &st, 0) < 0 || !WIFEXITED(st) || WEXITSTATUS(st) != 3) return 1;
+  int crashed = count("crash.log", "crashed with");
+  printf("Crash message: %d written\n", crashed);
+  if (crashed != 1) return 1;
+
+  // LgFile sinks are drained too
+  lg = open_handle_logger("handle.log", 0);
+  if (!lg) return 1;
+  int rc = drain_in_child(lg);
+  lg_destroy(lg);
+  lg_free(lg);
+  int drained = count("handle.log", "Z [INFO] drained");
+  printf("LgFile drain: rc %d, %d written\n", rc, drained);
+  if (rc != 0 || drained != 5) return 1;
+
+  // I/O thread may be on the file, drain leaves them and says so
+  lg = open_handle_logger("piped.log", 1);
+  if (!lg) return 1;
+  rc = drain_in_child(lg);
+  lg_destroy(lg);
+  lg_free(lg);
+  drained = count("piped.log", "drained");
+  printf("Pipelined LgFile drain: rc %d, %d written\n", rc, drained);
+  return rc != 4 || drained != 0;
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <logger.h>
+
+#define THREADS 3
+#define MESSAGES 50000
+#define SWAPS 200
+
+static Logger* lg;
+
+void* producer(void* arg) {
+  long id = (long)arg;
+  for (long i = 0; i < MESSAGES; i++)
+    lg_infoi(lg, "p%ld %ld", id, i);
+  return NULL;
+}
+
+// whole lines only, a sink that's swapped out never gets half of one
+static long count_lines(const char* path, int* torn) {
+  FILE* f = fopen(path, "r");
+  if (!f) return -1;
+  char line[512];
+  long n = 0;
+  while (fgets(line, sizeof(line), f)) {
+    size_t len = strlen(line);
+    if (len == 0 || line[len - 1] != '\n' || !strstr(line, "] p")) (*torn)++;
+    n++;
+  }
+  fclose(f);
+  return n;
+}
+
+int main() {
+  FILE* all = fopen("all.log", "w"); // logger closes it
+  if (!all) return 1;
+  LoggerConfig cfg = lg_get_defaults();
+  cfg.sinks.count = 0;
+  cfg.generateDefaultFile = 0;
+  cfg.logPolicy = LG_BLOCK;
+  lg_append_sink(&cfg, all, LG_OUT_FILE);
+  lg = lg_alloc();
+  if (!lg_init(lg, "logs", cfg)) return 1;
+
+  pthread_t threads[THREADS];
+  for (long i = 0; i < THREADS; i++)
+    pthread_create(&threads[i], NULL, producer, (void*)i);
+
+  // sinks come and go while they log, the one from lg_init sees everything
+  int rc = 0;
+  char path[64];
+  for (int s = 0; s < SWAPS; s++) {
+    snprintf(path, sizeof(path), "swap%d.log", s);
+    FILE* f = fopen(path, "w");
+    if (!f || !lg_add_sink(lg, f, LG_OUT_FILE)) rc = 1;
+    lg_infoi(lg, "p%d added", THREADS);
+    if (!lg_remove_sink(lg, f)) rc = 1; // writer closes it
+  }
+  for (int i = 0; i < THREADS; i++)
+    pthread_join(threads[i], NULL);
+  lg_destroy(lg);
+  lg_free(lg);
+
+  int torn = 0;
+  long n = count_lines("all.log", &torn);
+  for (int s = 0; s < SWAPS; s++) {
+    snprintf(path, sizeof(path), "swap%d.log", s);
+    if (count_lines(path, &torn) < 0) rc = 1;
+  }
+  printf("Lines: %ld of %d, torn: %d\n", n, THREADS * MESSAGES + SWAPS, torn);
+  return rc || torn || n != THREADS * MESSAGES + SWAPS;
+}
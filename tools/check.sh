@@ -0,0 +1,49 @@
+#!/bin/bash
+# lgsearch and lgquery on a generated log, their output has to be what grep finds
+
+clr_green="\e[1;32m"
+clr_red="\e[1;31m"
+clr_rst="\e[0m"
+dir=check_logs
+failed=0
+
+rm -rf $dir
+./check_gen $dir || exit 1
+log=$(ls $dir/*.log)
+
+# same lines in the same order, args: name, tool output, grep output
+expect() {
+  if [ "$2" == "$3" ] && [ -n "$3" ]; then
+    printf "${clr_green}ok${clr_rst}     %s\n" "$1"
+  else
+    printf "${clr_red}FAILED${clr_rst} %s\n" "$1"
+    failed=1
+  fi
+}
+
+expect "lgsearch -w timeout" \
+  "$(./lgsearch -w timeout $dir)" "$(grep -F timeout $log)"
+expect "lgsearch -l ERROR" \
+  "$(./lgsearch -l ERROR $dir)" "$(grep -F '[ERROR]' $log)"
+expect "lgsearch -l ERROR,WARNING -w Timeout" \
+  "$(./lgsearch -l ERROR,WARNING -w Timeout $dir)" \
+  "$(grep -E '\[(ERROR|WARNING)\]' $log | grep -F Timeout)"
+expect "lgsearch -c -w db_" \
+  "$(./lgsearch -c -w db_ $dir)" "$(grep -cF db_ $log)"
+expect "lgquery -w timeout" \
+  "$(./lgquery -w timeout $log)" "$(grep -iw timeout $log)"
+expect "lgquery -l INFO" \
+  "$(./lgquery -l INFO $log)" "$(grep -F '[INFO]' $log)"
+expect "lgquery -l WARNING -w connect" \
+  "$(./lgquery -l WARNING -w connect $log)" \
+  "$(grep -F '[WARNING]' $log | grep -iw connect)"
+expect "lgquery -w needle" \
+  "$(./lgquery -w needle $log)" "$(grep -iw needle $log)"
+
+# needle is in a few blocks, the index has to skip the others
+read blocks total <<< $(./lgquery -s -w needle $log 2>&1 >/dev/null | awk '{print $3, $5}')
+expect "lgquery -w needle skips blocks" \
+  "$([ "$blocks" -lt "$total" ] && echo skipped)" "skipped"
+
+rm -rf $dir
+exit $failed
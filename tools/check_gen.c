@@ -0,0 +1,43 @@
+/*
+  check_gen - writes an indexed log for check.sh, lines mix levels
+  and near misses of the searched words (case, suffix, "_" joined),
+  "needle" is in a few blocks only so the index has some to skip
+
+  Usage:
+    check_gen dir
+*/
+#define LOGGER_IMPLEMENTATION
+#include "logger.h"
+
+#define LINES 120000
+
+static const char* words[] = {
+  "timeout", "Timeout", "timeouts", "db_timeout", "TIMEOUT", "connect", "retry", "ok",
+};
+
+int main(int argc, char** argv)
+{
+  if (argc != 2) {
+    fprintf(stderr, "usage: check_gen dir\n");
+    return 2;
+  }
+  LoggerConfig cfg = lg_get_defaults();
+  cfg.sinks.count = 0;
+  cfg.logPolicy = LG_BLOCK;
+  cfg.indexFile = 1;
+  Logger* lg = lg_alloc();
+  if (!lg_init(lg, argv[1], cfg)) return 1;
+
+  const size_t n = sizeof(words) / sizeof(words[0]);
+  for (long i = 0; i < LINES; i++) {
+    const char* w = i % 20000 == 3 ? "needle" : words[i * 7 % n];
+    switch (i % 5) {
+    case 0: lg_errori(lg, "request %ld failed: %s", i, w); break;
+    case 1: lg_warni(lg, "request %ld slow (%s)", i, w); break;
+    default: lg_infoi(lg, "request %ld %s.done", i, w); break;
+    }
+  }
+  lg_destroy(lg);
+  lg_free(lg);
+  return 0;
+}
@@ -0,0 +1,293 @@
+/*
+  lgquery - reads lines of log files through their .idx sidecars
+  (LoggerConfig.indexFile), only the blocks whose time range, level
+  set and word bloom can match are read from the log file itself
+
+  Usage:
+    lgquery [-f FROM] [-t TO] [-l LEVELS] [-w WORDS] [-s] file.log...
+
+    FROM, TO: epoch seconds (1767225600.5) or wall clock of the file's
+              zone (2026.01.31-12.00.00 or 2026-01-31T12:00:00)
+    LEVELS:   comma separated names, like ERROR,WARNING
+    WORDS:    lines have to contain it as whole words (case insensitive)
+    -s:       blocks read / total to stderr
+
+  Lines after the last indexed block (instance is still running or
+  crashed) are scanned without the index. Lines of lg_drain_signal_safe
+  have epoch time_str if the file has local time, their clock is misread
+*/
+#define LOGGER_IMPLEMENTATION
+#include "logger.h"
+
+#include <ctype.h>
+#include <time.h>
+
+typedef struct {
+  double from; // epoch seconds, negative = open
+  double to;
+  uint32_t levels; // 0 = all
+  const char* word; // NULL = any
+} Query;
+
+// lines show ts truncated to ms at worst, blocks have the exact ones
+#define SLACK_NS 1e6
+
+typedef struct {
+  size_t read;
+  size_t total;
+} Stats;
+
+static int parse_time(const char* s, bool local, double* out)
+{
+  int y, mo, d, h, mi, sec, used = 0;
+  if (strlen(s) >= 19 && !isdigit((unsigned char)s[4]) &&
+      sscanf(s, "%4d%*c%2d%*c%2d%*c%2d%*c%2d%*c%2d%n", &y, &mo, &d, &h, &mi, &sec, &used) == 6 &&
+      used == 19) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = y - 1900;
+    tm.tm_mon = mo - 1;
+    tm.tm_mday = d;
+    tm.tm_hour = h;
+    tm.tm_min = mi;
+    tm.tm_sec = sec;
+    tm.tm_isdst = -1;
+    time_t t = local ? mktime(&tm) : timegm(&tm);
+    if (t == (time_t)-1) return false;
+    *out = (double)t;
+    if (s[used] == '.') *out += strtod(s + used, NULL);
+    return true;
+  }
+
+  char* end;
+  *out = strtod(s, &end);
+  return end != s && (*end == '\0' || *end == ' ');
+}
+
+static bool parse_levels(const char* s, uint32_t* out)
+{
+  *out = 0;
+  while (*s) {
+    size_t n = strcspn(s, ",");
+    bool found = false;
+    for (uint32_t l = 0; l <= LG_CUSTOM; l++) {
+      const char* name = lg_lvl_to_str((LgLogLevel)l);
+      if (strlen(name) == n && strncasecmp(s, name, n) == 0) {
+        *out |= LOGGER_LEVEL_BIT(l);
+        found = true;
+      }
+    }
+    if (!found) return false;
+    s += n;
+    if (*s == ',') s++;
+  }
+  return true;
+}
+
+// whole word match, bloom of the blocks only knows the whole ones
+static bool contains_words(const char* line, size_t n, const char* word)
+{
+  size_t wn = strlen(word);
+  for (size_t i = 0; i + wn <= n; i++) {
+    size_t j = 0;
+    while (j < wn && tolower((unsigned char)line[i + j]) == tolower((unsigned char)word[j])) j++;
+    if (j < wn) continue;
+    if (i > 0 && lgi_idx_word_char(line[i - 1]) && lgi_idx_word_char(word[0])) continue;
+    if (i + wn < n && lgi_idx_word_char(line[i + wn]) && lgi_idx_word_char(word[wn - 1])) continue;
+    return true;
+  }
+  return false;
+}
+
+// time and level of a default layout line: "<time_str> [LEVEL] ..."
+static bool line_info(const LgIdxHeader* hdr, const char* line, size_t n,
+                      double* ts, uint32_t* level)
+{
+  char buf[LOGGER_TIME_STR_SIZE + 32];
+  if (n >= sizeof(buf)) n = sizeof(buf) - 1;
+  memcpy(buf, line, n);
+  buf[n] = '\0';
+
+  char* sp = strchr(buf, ' ');
+  if (!sp || sp[1] != '[') return false;
+  *sp = '\0';
+  // ISO ones carry their offset, the rest are in the file's zone
+  bool iso = hdr->time_style == LG_TIME_ISO8601;
+  if (!parse_time(buf, hdr->local_time && !iso, ts)) return false;
+  const char* z = iso && strlen(buf) > 19 ? strpbrk(buf + 19, "+-") : NULL;
+  if (z) {
+    int oh = 0, om = 0;
+    sscanf(z + 1, "%d:%d", &oh, &om);
+    *ts -= (z[0] == '-' ? -1 : 1) * (oh * 3600 + om * 60);
+  }
+
+  char* name = sp + 2;
+  char* close = strchr(name, ']');
+  if (!close) return false;
+  *close = '\0';
+  *level = 0;
+  for (uint32_t l = 0; l <= LG_CUSTOM; l++) {
+    if (strcmp(name, lg_lvl_to_str((LgLogLevel)l)) == 0) *level = LOGGER_LEVEL_BIT(l);
+  }
+  return *level != 0;
+}
+
+static void scan(const LgIdxHeader* hdr, const Query* q, const char* p, size_t n, bool exact_time)
+{
+  const char* end = p + n;
+  while (p < end) {
+    const char* nl = memchr(p, '\n', (size_t)(end - p));
+    size_t len = nl ? (size_t)(nl - p) + 1 : (size_t)(end - p);
+    bool keep = true;
+    double ts;
+    uint32_t level;
+
+    if (hdr->def_format && (q->levels || !exact_time) && line_info(hdr, p, len, &ts, &level)) {
+      if (q->levels && !(q->levels & level)) keep = false;
+      if (!exact_time && ((q->from >= 0 && ts < q->from) || (q->to >= 0 && ts > q->to)))
+        keep = false;
+    }
+    if (keep && q->word && !contains_words(p, len, q->word)) keep = false;
+    if (keep) fwrite(p, 1, len, stdout);
+    p += len;
+  }
+}
+
+static bool read_range(FILE* f, uint64_t off, uint64_t len, char** buf, size_t* cap)
+{
+  if (len > *cap) {
+    char* nb = (char*)realloc(*buf, (size_t)len);
+    if (!nb) return false;
+    *buf = nb;
+    *cap = (size_t)len;
+  }
+  if (fseeko(f, (off_t)off, SEEK_SET) != 0) return false;
+  return fread(*buf, 1, (size_t)len, f) == len;
+}
+
+static bool query_file(const char* path, const Query* q, Stats* st)
+{
+  char idx_path[PATH_MAX];
+  snprintf(idx_path, sizeof(idx_path), "%s" LOGGER_IDX_EXT, path);
+  FILE* log = fopen(path, "rb");
+  FILE* idx = fopen(idx_path, "rb");
+  LgIdxHeader hdr;
+  LgIdxBlock blk;
+  char* buf = NULL;
+  size_t cap = 0;
+  uint64_t indexed = 0;
+  bool ok = false;
+  double from_ns = q->from * 1e9 - SLACK_NS;
+  double to_ns = q->to * 1e9 + SLACK_NS;
+
+  if (!log || !idx) {
+    fprintf(stderr, "lgquery: cannot open %s\n", log ? idx_path : path);
+    goto done;
+  }
+  if (fread(&hdr, sizeof(hdr), 1, idx) != 1 ||
+      memcmp(hdr.magic, LGI_IDX_MAGIC, sizeof(hdr.magic)) != 0 ||
+      hdr.bloom_bits != LOGGER_IDX_BLOOM_BITS) {
+    fprintf(stderr, "lgquery: %s is not an index of this version\n", idx_path);
+    goto done;
+  }
+
+  while (fread(&blk, sizeof(blk), 1, idx) == 1) {
+    st->total++;
+    indexed = blk.offset + blk.length;
+    if (q->from >= 0 && (double)blk.ts_max < from_ns) continue;
+    if (q->to >= 0 && (double)blk.ts_min > to_ns) continue;
+    if (q->levels && !(blk.levels & q->levels)) continue;
+    if (q->word && !lgi_idx_bloom_test(blk.bloom, q->word, strlen(q->word))) continue;
+
+    st->read++;
+    if (!read_range(log, blk.offset, blk.length, &buf, &cap)) {
+      fprintf(stderr, "lgquery: %s is shorter than its index\n", path);
+      goto done;
+    }
+    bool inside = (q->from < 0 || (double)blk.ts_min >= from_ns + 2 * SLACK_NS) &&
+                  (q->to < 0 || (double)blk.ts_max <= to_ns - 2 * SLACK_NS);
+    scan(&hdr, q, buf, (size_t)blk.length, inside);
+  }
+
+  // not indexed tail
+  if (fseeko(log, 0, SEEK_END) != 0) goto done;
+  off_t size = ftello(log);
+  if (size > (off_t)indexed) {
+    if (!read_range(log, indexed, (uint64_t)size - indexed, &buf, &cap)) goto done;
+    scan(&hdr, q, buf, (size_t)((uint64_t)size - indexed), q->from < 0 && q->to < 0);
+  }
+  ok = true;
+
+done:
+  free(buf);
+  if (log) fclose(log);
+  if (idx) fclose(idx);
+  return ok;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: lgquery [-f FROM] [-t TO] [-l LEVELS] [-w WORDS] [-s] file.log...\n");
+}
+
+int main(int argc, char** argv)
+{
+  Query q = { -1, -1, 0, NULL };
+  const char* from = NULL;
+  const char* to = NULL;
+  bool stats = false;
+  int i = 1;
+
+  for (; i < argc && argv[i][0] == '-'; i++) {
+    const char* opt = argv[i];
+    if (strcmp(opt, "-s") == 0) {
+      stats = true;
+      continue;
+    }
+    if (opt[1] == '\0' || opt[2] != '\0' || i + 1 >= argc) {
+      usage();
+      return 2;
+    }
+    const char* val = argv[++i];
+    switch (opt[1]) {
+    case 'f': from = val; break;
+    case 't': to = val; break;
+    case 'w': q.word = val; break;
+    case 'l':
+      if (!parse_levels(val, &q.levels)) {
+        fprintf(stderr, "lgquery: unknown level in %s\n", val);
+        return 2;
+      }
+      break;
+    default:
+      usage();
+      return 2;
+    }
+  }
+  if (i >= argc) {
+    usage();
+    return 2;
+  }
+
+  int rc = 0;
+  Stats st = { 0, 0 };
+  for (; i < argc; i++) {
+    // wall clock times are in the zone of the file they're compared with
+    FILE* idx;
+    char idx_path[PATH_MAX];
+    LgIdxHeader hdr;
+    bool local = true;
+    snprintf(idx_path, sizeof(idx_path), "%s" LOGGER_IDX_EXT, argv[i]);
+    if ((idx = fopen(idx_path, "rb"))) {
+      if (fread(&hdr, sizeof(hdr), 1, idx) == 1) local = hdr.local_time != 0;
+      fclose(idx);
+    }
+    if ((from && !parse_time(from, local, &q.from)) || (to && !parse_time(to, local, &q.to))) {
+      fprintf(stderr, "lgquery: bad time, use epoch seconds or YYYY.MM.DD-HH.MM.SS\n");
+      return 2;
+    }
+    if (!query_file(argv[i], &q, &st)) rc = 1;
+  }
+  if (stats) fprintf(stderr, "lgquery: read %zu of %zu blocks\n", st.read, st.total);
+  return rc;
+}
@@ -0,0 +1,564 @@
+/*
+  lgsearch - searches logger's .log files on all cores, output is
+  merged in time order across files
+
+  Usage:
+    lgsearch [-f FROM] [-t TO] [-l LEVELS] [-w TEXT] [-j THREADS] [-H] [-c] dir|file...
+
+    FROM, TO: time_str of any style (2026.01.31-12.00.00, 2026-01-31T12:00:00.5
+              or epoch seconds), compared with lines' clock as it's written,
+              TO without sub-second digits takes its whole second
+    LEVELS:   comma separated names, like ERROR,WARNING
+    TEXT:     lines have to contain it (case sensitive, no regex)
+    -H:       file name before every line
+    -c:       only the count of matching lines
+
+  Files are mmap'd and cut into chunks at line starts, workers scan
+  them with memchr and a SIMD substring search (SSE2 where there is,
+  memmem elsewhere), parse only the default line layout
+  ("<time_str> [LEVEL] ...") and sort their matches, main thread merges
+  the sorted chunks. Lines without that layout take the clock and level
+  of the line before them (multi-line messages stay together).
+  lg_drain_signal_safe writes epoch time_str when instance has local
+  time, those lines' clock is UTC, not the wall clock of the others
+*/
+#define LOGGER_IMPLEMENTATION
+#include "logger.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define CHUNK_SIZE (4u << 20)
+#define MAX_THREADS 256
+
+typedef struct {
+  uint64_t from; // wall clock ns, see line_clock
+  uint64_t to;
+  uint32_t levels; // 0 = all
+  const char* text; // NULL = any
+  size_t text_len;
+  bool timed;
+} Query;
+
+typedef struct {
+  uint64_t key;
+  const char* p;
+  uint32_t len;
+  uint32_t file;
+} Match;
+
+typedef struct {
+  uint32_t file;
+  const char* start; // first line start
+  const char* end; // past the last line
+  Match* m;
+  size_t count;
+  size_t cap;
+} Chunk;
+
+typedef struct {
+  const char* path;
+  const char* base;
+  size_t size;
+} File;
+
+typedef struct {
+  const Query* q;
+  Chunk* chunks;
+  size_t chunk_count;
+  ATOMIC(size_t) next;
+  bool oom;
+} Work;
+
+static int64_t days_from_civil(int y, int m, int d)
+{
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int64_t yoe = y - era * 400;
+  int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static bool digits(const char* p, int n, int* out)
+{
+  int v = 0;
+  for (int i = 0; i < n; i++) {
+    if (p[i] < '0' || p[i] > '9') return false;
+    v = v * 10 + (p[i] - '0');
+  }
+  *out = v;
+  return true;
+}
+
+/*
+  Clock of a time_str as ns, civil ones as if they were UTC (zone
+  offsets are ignored) so the order of one zone's lines is kept.
+  *n = its length, *frac = it had sub-second digits
+*/
+static bool line_clock(const char* p, const char* e, uint64_t* key, size_t* n, bool* frac)
+{
+  const char* s = p;
+  uint64_t sec;
+  int y, mo, d, h, mi, se;
+  if (e - p >= 19 && (p[4] == '.' || p[4] == '-') && (p[10] == '-' || p[10] == 'T')) {
+    if (!digits(p, 4, &y) || !digits(p + 5, 2, &mo) || !digits(p + 8, 2, &d) ||
+        !digits(p + 11, 2, &h) || !digits(p + 14, 2, &mi) || !digits(p + 17, 2, &se))
+      return false;
+    if (mo < 1 || mo > 12) return false;
+    sec = (uint64_t)(days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60 + se);
+    p += 19;
+  } else {
+    if (p == e || *p < '0' || *p > '9') return false;
+    sec = 0;
+    while (p < e && *p >= '0' && *p <= '9') sec = sec * 10 + (uint64_t)(*p++ - '0');
+  }
+
+  uint64_t ns = 0, scale = 1000000000u;
+  *frac = p < e && *p == '.';
+  if (*frac) {
+    p++;
+    while (p < e && *p >= '0' && *p <= '9') {
+      scale /= 10;
+      ns += (uint64_t)(*p++ - '0') * scale;
+    }
+  }
+  // ISO offset or Z
+  if (p < e && *p == 'Z') p++;
+  else if (e - p >= 6 && (*p == '+' || *p == '-') && p[3] == ':') p += 6;
+
+  *key = sec * 1000000000u + ns;
+  *n = (size_t)(p - s);
+  return true;
+}
+
+// "<time_str> [LEVEL] " at p
+static bool line_head(const char* p, const char* e, uint64_t* key, uint32_t* level)
+{
+  size_t n;
+  bool frac;
+  if (!line_clock(p, e, key, &n, &frac)) return false;
+  p += n;
+  if (e - p < 3 || p[0] != ' ' || p[1] != '[') return false;
+  p += 2;
+  for (uint32_t l = 0; l <= LG_CUSTOM; l++) {
+    const char* name = lg_lvl_to_str((LgLogLevel)l);
+    size_t ln = strlen(name);
+    if ((size_t)(e - p) > ln && memcmp(p, name, ln) == 0 && p[ln] == ']') {
+      *level = LOGGER_LEVEL_BIT(l);
+      return true;
+    }
+  }
+  return false;
+}
+
+// first text in [p, e), first and last bytes are checked 16 at a time
+static const char* find_text(const char* p, const char* e, const char* w, size_t wn)
+{
+  if (wn == 1) return (const char*)memchr(p, w[0], (size_t)(e - p));
+#ifdef __SSE2__
+  const __m128i first = _mm_set1_epi8(w[0]);
+  const __m128i last = _mm_set1_epi8(w[wn - 1]);
+  while (e - p >= (ptrdiff_t)(wn - 1 + 16)) {
+    __m128i a = _mm_loadu_si128((const __m128i*)p);
+    __m128i b = _mm_loadu_si128((const __m128i*)(p + wn - 1));
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+      _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+    while (mask) {
+      int bit = __builtin_ctz(mask);
+      if (memcmp(p + bit + 1, w + 1, wn - 2) == 0) return p + bit;
+      mask &= mask - 1;
+    }
+    p += 16;
+  }
+#endif
+  return (const char*)memmem(p, (size_t)(e - p), w, wn);
+}
+
+static bool push(Chunk* c, uint64_t key, const char* p, size_t len)
+{
+  if (c->count == c->cap) {
+    size_t cap = c->cap ? c->cap * 2 : 256;
+    Match* m = (Match*)realloc(c->m, cap * sizeof(Match));
+    if (!m) return false;
+    c->m = m;
+    c->cap = cap;
+  }
+  Match* m = &c->m[c->count++];
+  m->key = key;
+  m->p = p;
+  m->len = (uint32_t)len;
+  m->file = c->file;
+  return true;
+}
+
+static int match_cmp(const void* a, const void* b)
+{
+  const Match* x = (const Match*)a;
+  const Match* y = (const Match*)b;
+  if (x->key != y->key) return x->key < y->key ? -1 : 1;
+  return x->p < y->p ? -1 : x->p > y->p;
+}
+
+// clock and level of the line at p, false = headless, it keeps the previous ones
+static bool line_state(const char* p, const char* e, uint64_t* key, uint32_t* level)
+{
+  uint64_t k;
+  uint32_t l;
+  if (!line_head(p, e, &k, &l)) return false;
+  *key = k;
+  *level = l;
+  return true;
+}
+
+static bool line_keep(const Query* q, uint64_t key, uint32_t level)
+{
+  if (q->levels && !(q->levels & level)) return false;
+  if (q->timed && (key < q->from || key > q->to)) return false;
+  return true;
+}
+
+static bool scan_chunk(const Query* q, Chunk* c)
+{
+  const char* p = c->start;
+  const char* e = c->end;
+  uint64_t key = 0;
+  uint32_t level = 0;
+
+  if (!q->text) {
+    while (p < e) {
+      const char* nl = (const char*)memchr(p, '\n', (size_t)(e - p));
+      const char* le = nl ? nl + 1 : e;
+      line_state(p, le, &key, &level);
+      if (line_keep(q, key, level) && !push(c, key, p, (size_t)(le - p))) return false;
+      p = le;
+    }
+    return true;
+  }
+
+  // text first, only the lines it's in are looked at
+  const char* line = p; // start of the line whose state we have
+  while (p < e) {
+    const char* hit = find_text(p, e, q->text, q->text_len);
+    if (!hit) break;
+    const char* ls = hit;
+    while (ls > c->start && ls[-1] != '\n') ls--;
+    // headless lines take the state of the closest headed one before them,
+    // the key is needed even without filters since the output is merged by it
+    const char* s = ls;
+    while (!line_state(s, e, &key, &level) && s > line) {
+      s--;
+      while (s > c->start && s[-1] != '\n') s--;
+    }
+    line = ls;
+    const char* nl = (const char*)memchr(hit, '\n', (size_t)(e - hit));
+    const char* le = nl ? nl + 1 : e;
+    if (line_keep(q, key, level) && !push(c, key, ls, (size_t)(le - ls))) return false;
+    p = le;
+  }
+  return true;
+}
+
+static void* worker(void* arg)
+{
+  Work* w = (Work*)arg;
+  for (;;) {
+    size_t i = atomic_fetch_add_explicit(&w->next, 1, memory_order_relaxed);
+    if (i >= w->chunk_count) break;
+    Chunk* c = &w->chunks[i];
+    if (!scan_chunk(w->q, c)) {
+      w->oom = true;
+      break;
+    }
+    if (c->count > 1) qsort(c->m, c->count, sizeof(Match), match_cmp);
+  }
+  return NULL;
+}
+
+static bool parse_levels(const char* s, uint32_t* out)
+{
+  *out = 0;
+  while (*s) {
+    size_t n = strcspn(s, ",");
+    bool found = false;
+    for (uint32_t l = 0; l <= LG_CUSTOM; l++) {
+      const char* name = lg_lvl_to_str((LgLogLevel)l);
+      if (strlen(name) == n && strncasecmp(s, name, n) == 0) {
+        *out |= LOGGER_LEVEL_BIT(l);
+        found = true;
+      }
+    }
+    if (!found) return false;
+    s += n;
+    if (*s == ',') s++;
+  }
+  return true;
+}
+
+static bool parse_bound(const char* s, bool upper, uint64_t* out)
+{
+  size_t n;
+  bool frac;
+  const char* e = s + strlen(s);
+  if (!line_clock(s, e, out, &n, &frac) || n != (size_t)(e - s)) return false;
+  if (upper && !frac) *out += 999999999u;
+  return true;
+}
+
+static bool add_path(File** files, size_t* count, size_t* cap, const char* path)
+{
+  if (*count == *cap) {
+    size_t n = *cap ? *cap * 2 : 16;
+    File* grown = (File*)realloc(*files, n * sizeof(File));
+    if (!grown) return false;
+    *files = grown;
+    *cap = n;
+  }
+  char* copy = strdup(path);
+  if (!copy) return false;
+  (*files)[(*count)++].path = copy;
+  return true;
+}
+
+static int path_cmp(const void* a, const void* b)
+{
+  return strcmp(((const File*)a)->path, ((const File*)b)->path);
+}
+
+// .log files of a directory in name (creation) order, or the file itself
+static bool collect(File** files, size_t* count, size_t* cap, const char* path)
+{
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    fprintf(stderr, "lgsearch: cannot stat %s\n", path);
+    return false;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    if (add_path(files, count, cap, path)) return true;
+    fprintf(stderr, "lgsearch: out of memory\n");
+    return false;
+  }
+
+  DIR* dir = opendir(path);
+  if (!dir) {
+    fprintf(stderr, "lgsearch: cannot open %s\n", path);
+    return false;
+  }
+  size_t first = *count;
+  struct dirent* ent;
+  bool ok = true;
+  while (ok && (ent = readdir(dir))) {
+    size_t n = strlen(ent->d_name);
+    if (n <= LOGGER_FILE_EXT_SZ ||
+        strcmp(ent->d_name + n - LOGGER_FILE_EXT_SZ, LOGGER_FILE_EXT) != 0)
+      continue;
+    char full[PATH_MAX];
+    snprintf(full, sizeof(full), "%s/%s", path, ent->d_name);
+    ok = add_path(files, count, cap, full);
+  }
+  closedir(dir);
+  if (!ok) fprintf(stderr, "lgsearch: out of memory\n");
+  if (*count > first) qsort(*files + first, *count - first, sizeof(File), path_cmp);
+  return ok;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: lgsearch [-f FROM] [-t TO] [-l LEVELS] [-w TEXT] "
+                  "[-j THREADS] [-H] [-c] dir|file...\n");
+}
+
+int main(int argc, char** argv)
+{
+  Query q;
+  memset(&q, 0, sizeof(q));
+  q.to = UINT64_MAX;
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  bool names = false, count_only = false;
+  int i = 1;
+
+  for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+    const char* opt = argv[i];
+    if (strcmp(opt, "-H") == 0) { names = true; continue; }
+    if (strcmp(opt, "-c") == 0) { count_only = true; continue; }
+    if (opt[2] != '\0' || i + 1 >= argc) {
+      usage();
+      return 2;
+    }
+    const char* val = argv[++i];
+    bool ok = true;
+    switch (opt[1]) {
+    case 'f': ok = parse_bound(val, false, &q.from); q.timed = true; break;
+    case 't': ok = parse_bound(val, true, &q.to); q.timed = true; break;
+    case 'l': ok = parse_levels(val, &q.levels); break;
+    case 'j': threads = strtol(val, NULL, 10); break;
+    case 'w':
+      q.text = val;
+      q.text_len = strlen(val);
+      ok = q.text_len > 0;
+      break;
+    default:
+      usage();
+      return 2;
+    }
+    if (!ok) {
+      fprintf(stderr, "lgsearch: bad value of %s: %s\n", opt, val);
+      return 2;
+    }
+  }
+  if (i >= argc) {
+    usage();
+    return 2;
+  }
+  if (threads < 1) threads = 1;
+  if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+  int rc = 0;
+  File* files = NULL;
+  size_t file_count = 0, file_cap = 0;
+  for (; i < argc; i++) {
+    if (!collect(&files, &file_count, &file_cap, argv[i])) rc = 1;
+  }
+
+  // map them and cut into chunks at line starts
+  Chunk* chunks = NULL;
+  size_t chunk_count = 0, chunk_cap = 0;
+  for (size_t f = 0; f < file_count; f++) {
+    File* fl = &files[f];
+    fl->base = NULL;
+    fl->size = 0;
+    int fd = open(fl->path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      fprintf(stderr, "lgsearch: cannot open %s\n", fl->path);
+      if (fd >= 0) close(fd);
+      rc = 1;
+      continue;
+    }
+    if (st.st_size > 0) {
+      void* m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (m != MAP_FAILED) {
+        fl->base = (const char*)m;
+        fl->size = (size_t)st.st_size;
+        madvise(m, fl->size, MADV_SEQUENTIAL);
+      } else {
+        fprintf(stderr, "lgsearch: cannot map %s\n", fl->path);
+        rc = 1;
+      }
+    }
+    close(fd);
+
+    const char* p = fl->base;
+    const char* e = fl->base + fl->size;
+    while (p < e) {
+      const char* ce = (size_t)(e - p) > CHUNK_SIZE ? p + CHUNK_SIZE : e;
+      if (ce < e) {
+        const char* nl = (const char*)memchr(ce, '\n', (size_t)(e - ce));
+        ce = nl ? nl + 1 : e;
+      }
+      if (chunk_count == chunk_cap) {
+        size_t n = chunk_cap ? chunk_cap * 2 : 64;
+        Chunk* grown = (Chunk*)realloc(chunks, n * sizeof(Chunk));
+        if (!grown) {
+          fprintf(stderr, "lgsearch: out of memory\n");
+          free(chunks);
+          return 1;
+        }
+        chunks = grown;
+        chunk_cap = n;
+      }
+      Chunk* c = &chunks[chunk_count++];
+      memset(c, 0, sizeof(*c));
+      c->file = (uint32_t)f;
+      c->start = p;
+      c->end = ce;
+      p = ce;
+    }
+  }
+
+  Work w;
+  w.q = &q;
+  w.chunks = chunks;
+  w.chunk_count = chunk_count;
+  w.oom = false;
+  atomic_store_explicit(&w.next, 0, memory_order_relaxed);
+  if ((size_t)threads > chunk_count) threads = chunk_count ? (long)chunk_count : 1;
+
+  pthread_t th[MAX_THREADS];
+  long started = 0;
+  for (; started < threads - 1; started++) {
+    if (pthread_create(&th[started], NULL, worker, &w) != 0) break;
+  }
+  worker(&w);
+  for (long t = 0; t < started; t++) pthread_join(th[t], NULL);
+  if (w.oom) {
+    fprintf(stderr, "lgsearch: out of memory\n");
+    return 1;
+  }
+
+  size_t total = 0;
+  for (size_t c = 0; c < chunk_count; c++) total += chunks[c].count;
+  if (count_only) {
+    printf("%zu\n", total);
+  } else {
+    // k-way merge of the sorted chunks, heap of chunk indexes
+    static char out[1 << 20];
+    setvbuf(stdout, out, _IOFBF, sizeof(out));
+    size_t* heap = (size_t*)malloc((chunk_count + 1) * sizeof(size_t));
+    size_t* pos = (size_t*)calloc(chunk_count + 1, sizeof(size_t));
+    size_t hn = 0;
+    if (!heap || !pos) {
+      fprintf(stderr, "lgsearch: out of memory\n");
+      return 1;
+    }
+#define HEAD(c) (&chunks[c].m[pos[c]])
+#define LESS(a, b) (match_cmp(HEAD(a), HEAD(b)) < 0)
+    for (size_t c = 0; c < chunk_count; c++) {
+      if (chunks[c].count == 0) continue;
+      size_t k = hn++;
+      heap[k] = c;
+      while (k > 0 && LESS(heap[k], heap[(k - 1) / 2])) {
+        size_t t = heap[k]; heap[k] = heap[(k - 1) / 2]; heap[(k - 1) / 2] = t;
+        k = (k - 1) / 2;
+      }
+    }
+    while (hn > 0) {
+      size_t c = heap[0];
+      const Match* m = HEAD(c);
+      if (names) printf("%s:", files[m->file].path);
+      fwrite(m->p, 1, m->len, stdout);
+      if (m->len == 0 || m->p[m->len - 1] != '\n') fputc('\n', stdout);
+      if (++pos[c] == chunks[c].count) heap[0] = heap[--hn];
+      size_t k = 0;
+      for (;;) {
+        size_t l = 2 * k + 1, r = l + 1, s = k;
+        if (l < hn && LESS(heap[l], heap[s])) s = l;
+        if (r < hn && LESS(heap[r], heap[s])) s = r;
+        if (s == k) break;
+        size_t t = heap[k]; heap[k] = heap[s]; heap[s] = t;
+        k = s;
+      }
+    }
+#undef LESS
+#undef HEAD
+    fflush(stdout);
+    free(heap);
+    free(pos);
+  }
+
+  for (size_t c = 0; c < chunk_count; c++) free(chunks[c].m);
+  free(chunks);
+  for (size_t f = 0; f < file_count; f++) {
+    if (files[f].base) munmap((void*)files[f].base, files[f].size);
+    free((void*)files[f].path);
+  }
+  free(files);
+  return rc;
+}
@@ -28,6 +28,7 @@ const (
   PolicyDrop          LogPolicy = LogPolicy(C.LG_DROP)
   PolicyBlock         LogPolicy = LogPolicy(C.LG_BLOCK)
   PolicyPriorityBased LogPolicy = LogPolicy(C.LG_PRIORITY_BASED)
+  PolicySpill         LogPolicy = LogPolicy(C.LG_SPILL)
 )
 
 // OutType maps to LgOutType
@@ -121,6 +122,11 @@ func (l *Logger) IsAlive() bool {
   return C.lg_is_alive(l.ptr) != 0
 }
 
+// Dropped returns the messages lost since Init
+func (l *Logger) Dropped() uint64 {
+  return uint64(C.lg_get_dropped(l.ptr))
+}
+
 // SetActive sets this logger as the active global instance
 func (l *Logger) SetActive() error {
   if C.lg_set_active_instance(l.ptr) == 0 {
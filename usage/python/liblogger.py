@@ -27,7 +27,7 @@
   Import this in your python project
 """
 
-__all__ = ["Logger", "LogOutType", "LogPolicy", "LogLevel"]
+__all__ = ["Logger", "LogOutType", "LogPolicy", "LogLevel", "LoggerHandler"]
 
 from cffi import FFI
 from enum import IntEnum
@@ -36,16 +36,17 @@ ffi = FFI()
 
 ffi.cdef("""
 typedef enum {
-  LG_INFO = 1 << 0,
-  LG_ERROR = 1 << 1,
-  LG_WARNING = 1 << 2,
-  LG_CUSTOM = 1 << 3,
+  LG_INFO = 0,
+  LG_ERROR = 1,
+  LG_WARNING = 2,
+  LG_CUSTOM = 3,
 } LgLogLevel;
 
 typedef enum {
-  LG_DROP = 1 << 0,
-  LG_BLOCK = 1 << 1,
-  LG_PRIORITY_BASED = 1 << 2,
+  LG_DROP = 0,
+  LG_BLOCK = 1,
+  LG_PRIORITY_BASED = 2,
+  LG_SPILL = 3,
 } LgLogPolicy;
 
 typedef enum {
@@ -61,6 +62,9 @@ typedef enum {
 #define LOGGER_MAX_SINKS 8
 
 typedef struct Logger Logger;
+typedef struct LgCategory LgCategory;
+typedef struct LgFile LgFile;
+typedef struct LgWriterPool LgWriterPool;
 
 typedef struct LgString {
   char data[LOGGER_MAX_MSG_SIZE];
@@ -72,6 +76,9 @@ typedef LgString LgMsgPack[LOGGER_MAX_OUT_TYPES];
 typedef struct {
   FILE* file;
   LgOutType type;
+  LgLogLevel minLevel;
+  uint32_t levelMask;
+  LgFile* handle;
 } LgSink;
 
 typedef struct {
@@ -79,6 +86,56 @@ typedef struct {
   size_t count;
 } LgSinks;
 
+typedef enum {
+  LG_TIME_DEFAULT = 0,
+  LG_TIME_ISO8601 = 1,
+  LG_TIME_EPOCH = 2,
+} LgTimeStyle;
+
+typedef enum {
+  LG_TIME_MS = 0,
+  LG_TIME_US = 1,
+  LG_TIME_NS = 2,
+} LgTimePrecision;
+
+typedef enum {
+  LG_SYNC_NONE = 0,
+  LG_SYNC_BYTES = 1,
+  LG_SYNC_INTERVAL = 2,
+} LgSyncPolicy;
+
+typedef struct {
+  int directIO;
+  int dropCache;
+  LgSyncPolicy sync;
+  size_t syncBytes;
+  unsigned int syncMillis;
+} LgFileOptions;
+
+typedef enum {
+  LG_SCHED_DEFAULT = 0,
+  LG_SCHED_OTHER = 1,
+  LG_SCHED_BATCH = 2,
+  LG_SCHED_IDLE = 3,
+  LG_SCHED_FIFO = 4,
+  LG_SCHED_RR = 5,
+} LgSchedPolicy;
+
+typedef enum {
+  LG_RING_FIRST_TOUCH = 0,
+  LG_RING_WRITER_NODE = 1,
+  LG_RING_NODE = 2,
+} LgRingPlacement;
+
+typedef struct {
+  const char* cpus;
+  int nice;
+  LgSchedPolicy sched;
+  int schedPriority;
+  LgRingPlacement ringPlacement;
+  int ringNode;
+} LgThreadOptions;
+
 typedef int (*log_formatter_t)(
   const char* time_str,
   LgLogLevel level,
@@ -94,6 +151,21 @@ typedef struct {
   LgSinks sinks;
   LgLogPolicy logPolicy;
   log_formatter_t logFormatter;
+  int pipelineWrites;
+  LgFileOptions fileOptions;
+  LgTimeStyle timeStyle;
+  LgTimePrecision timePrecision;
+  int logCallSite;
+  LgWriterPool* writerPool;
+  int priorityLane;
+  LgLogLevel priorityLevel;
+  LgThreadOptions writerOptions;
+  int indexFile;
+  size_t maxTotalBytes;
+  unsigned int maxAgeSecs;
+  int sharedRing;
+  int formatWorkers;
+  size_t spillMaxQueued;
 } LoggerConfig;
 
 Logger* lg_get_active_instance();
@@ -102,22 +174,52 @@ int lg_set_active_instance(Logger* inst);
 int lg_init(Logger* instance, const char* logs_dir, LoggerConfig config);
 int lg_destroy(Logger* instance);
 int lg_is_alive(const Logger* instance);
+size_t lg_get_dropped(const Logger* instance);
+int lg_shared_fd(const Logger* instance);
+int lg_attach(Logger* instance, int fd);
+int lg_flush(Logger* inst, unsigned int timeout_ms);
+
+LgWriterPool* lg_pool_create(int threads);
+int lg_pool_destroy(LgWriterPool* pool);
 
 int lg_finfo(const char* msg);
 int lg_ferror(const char* msg);
 int lg_fwarn(const char* msg);
 int lg_flog(LgLogLevel level, const char* msg);
 
+size_t lg_log_batch(Logger* inst, LgCategory* cat, const LgLogLevel* levels,
+                    const char* msgs, const size_t* lens, const double* ts,
+                    size_t n);
+
 int lg_flogi(Logger* lg, LgLogLevel level, const char* msg);
 int lg_finfoi(Logger* lg, const char* msg);
 int lg_ferrori(Logger* lg, const char* msg);
 int lg_fwarni(Logger* lg, const char* msg);
 
+LgCategory* lg_category(Logger* inst, const char* name);
+const char* lg_category_name(const LgCategory* cat);
+int lg_category_set_level(LgCategory* cat, LgLogLevel min_level, uint32_t level_mask);
+int lg_category_set_sinks(LgCategory* cat, uint32_t sink_mask);
+int lg_category_inherit(LgCategory* cat);
+int lg_fclog(LgCategory* cat, LgLogLevel level, const char* msg);
+
 void lg_str_write_into(LgString* s, const char* str);
 const char* lg_lvl_to_str(const LgLogLevel level);
-int lg_get_time_str(char* buf, int isLocalTime);
+int lg_get_time_str(Logger* inst, char* buf);
 LoggerConfig lg_get_defaults();
 int lg_append_sink(LoggerConfig* config, FILE* f, LgOutType type);
+int lg_append_sink_filtered(LoggerConfig* config, FILE* f, LgOutType type,
+                            LgLogLevel min_level, uint32_t level_mask);
+int lg_add_sink(Logger* inst, FILE* f, LgOutType type);
+int lg_add_sink_filtered(Logger* inst, FILE* f, LgOutType type,
+                         LgLogLevel min_level, uint32_t level_mask);
+int lg_remove_sink(Logger* inst, FILE* f);
+
+LgFile* lg_file_open(const char* path, LgFileOptions opts);
+int lg_file_close(LgFile* f);
+int lg_append_file_sink(LoggerConfig* config, LgFile* f, LgOutType type);
+int lg_add_file_sink(Logger* inst, LgFile* f, LgOutType type);
+int lg_remove_file_sink(Logger* inst, LgFile* f);
 
 FILE* lg_get_stdout();
 FILE* lg_get_stderr();
@@ -129,6 +231,8 @@ void    lg_free(Logger* inst);
 
 import os
 import sys
+import logging
+import threading
 
 if sys.platform == "win32":
   lib_name = "logger.dll"
@@ -146,25 +250,63 @@ def _contains_flag(needed, flag) -> bool:
 def _decode_cstr(cstr) -> str:
   return ffi.string(cstr).decode("utf-8")
 
+def _file_options(direct_io, drop_cache, sync, sync_bytes, sync_millis):
+  opts = ffi.new("LgFileOptions*")
+  opts.directIO   = 1 if direct_io else 0
+  opts.dropCache  = 1 if drop_cache else 0
+  opts.sync       = int(sync)
+  opts.syncBytes  = int(sync_bytes)
+  opts.syncMillis = int(sync_millis)
+  return opts
+
 class LogLevel(IntEnum):
-  INFO    = 1 << 0
-  ERROR   = 1 << 1
-  WARNING = 1 << 2
-  CUSTOM  = 1 << 3
+  INFO    = 0
+  ERROR   = 1
+  WARNING = 2
+  CUSTOM  = 3
 
   def __str__(self):
     return self.name
 
 class LogPolicy(IntEnum):
-  DROP           = 1 << 0
-  BLOCK          = 1 << 1
-  PRIORITY_BASED = 1 << 2
+  DROP           = 0
+  BLOCK          = 1
+  PRIORITY_BASED = 2
+  SPILL          = 3
 
 class LogOutType(IntEnum):
   TTY  = 0
   FILE = 1
   NET  = 2
 
+class LogTimeStyle(IntEnum):
+  DEFAULT = 0
+  ISO8601 = 1
+  EPOCH   = 2
+
+class LogTimePrecision(IntEnum):
+  MS = 0
+  US = 1
+  NS = 2
+
+class LogSyncPolicy(IntEnum):
+  NONE     = 0
+  BYTES    = 1
+  INTERVAL = 2
+
+class LogSchedPolicy(IntEnum):
+  DEFAULT = 0
+  OTHER   = 1
+  BATCH   = 2
+  IDLE    = 3
+  FIFO    = 4
+  RR      = 5
+
+class LogRingPlacement(IntEnum):
+  FIRST_TOUCH = 0
+  WRITER_NODE = 1
+  NODE        = 2
+
 class LoggerConfig:
   _FIELDS = {
     "localTime":           lambda v: 1 if v else 0,
@@ -172,6 +314,19 @@ class LoggerConfig:
     "maxFiles":            lambda v: int(v),
     "logPolicy":           lambda v: int(v),
     "logFormatter":        lambda v: ffi.NULL if v is None else v,
+    "pipelineWrites":      lambda v: 1 if v else 0,
+    "timeStyle":           lambda v: int(v),
+    "timePrecision":       lambda v: int(v),
+    "logCallSite":         lambda v: 1 if v else 0,
+    "writerPool":          lambda v: ffi.NULL if v is None else v,
+    "priorityLane":        lambda v: 1 if v else 0,
+    "priorityLevel":       lambda v: int(v),
+    "indexFile":           lambda v: 1 if v else 0,
+    "maxTotalBytes":       lambda v: int(v),
+    "maxAgeSecs":          lambda v: int(v),
+    "sharedRing":          lambda v: 1 if v else 0,
+    "formatWorkers":       lambda v: int(v),
+    "spillMaxQueued":      lambda v: int(v),
   }
 
   def __init__(self, **kwargs):
@@ -193,6 +348,37 @@ class LoggerConfig:
   def append_sink(self, file_ptr, out_type: LogOutType) -> bool:
     return bool(_logger.lg_append_sink(self._c, file_ptr, out_type))
 
+  def append_sink_filtered(self, file_ptr, out_type: LogOutType,
+                           min_level: "LogLevel", level_mask: int = 0) -> bool:
+    return bool(_logger.lg_append_sink_filtered(self._c, file_ptr, out_type,
+                                                min_level, level_mask))
+
+  def append_file_sink(self, file_handle, out_type: LogOutType) -> bool:
+    return bool(_logger.lg_append_file_sink(self._c, file_handle, out_type))
+
+  # Options of the default file (see LoggerUtils.file_open)
+  def set_file_options(self, direct_io: bool = False, drop_cache: bool = False,
+                       sync: LogSyncPolicy = LogSyncPolicy.NONE,
+                       sync_bytes: int = 0, sync_millis: int = 0) -> None:
+    self._c.fileOptions = _file_options(direct_io, drop_cache, sync,
+                                        sync_bytes, sync_millis)[0]
+
+  # Writer thread placement (Linux only), cpus is a list like "2-3,8"
+  def set_writer_options(self, cpus: str = None, nice: int = 0,
+                         sched: LogSchedPolicy = LogSchedPolicy.DEFAULT,
+                         sched_priority: int = 0,
+                         ring_placement: LogRingPlacement = LogRingPlacement.FIRST_TOUCH,
+                         ring_node: int = 0) -> None:
+    # C side only reads it at init but it must outlive that call
+    object.__setattr__(self, "_cpus", ffi.NULL if cpus is None else ffi.new("char[]", cpus.encode()))
+    opts = self._c.writerOptions
+    opts.cpus          = self._cpus
+    opts.nice          = int(nice)
+    opts.sched         = int(sched)
+    opts.schedPriority = int(sched_priority)
+    opts.ringPlacement = int(ring_placement)
+    opts.ringNode      = int(ring_node)
+
   def get_c_struct(self):
     return self._c[0]
 
@@ -213,12 +399,49 @@ class Logger:
   def destroy(self) -> bool:
     return bool(_logger.lg_destroy(self._ptr))
 
+  # producer of another process' sharedRing instance
+  def attach(self, fd: int) -> bool:
+    return bool(_logger.lg_attach(self._ptr, int(fd)))
+
+  def shared_fd(self) -> int:
+    return int(_logger.lg_shared_fd(self._ptr))
+
   def is_alive(self) -> bool:
     return bool(_logger.lg_is_alive(self._ptr))
 
+  def dropped(self) -> int:
+    return int(_logger.lg_get_dropped(self._ptr))
+
+  # waits until everything logged before is written
+  def flush(self, timeout_ms: int = 1000) -> bool:
+    return bool(_logger.lg_flush(self._ptr, int(timeout_ms)))
+
   def free(self) -> None:
     _logger.lg_free(self._ptr)
 
+  # Runtime sinks
+  def add_sink(self, file_ptr, out_type: LogOutType) -> bool:
+    return bool(_logger.lg_add_sink(self._ptr, file_ptr, out_type))
+
+  def add_sink_filtered(self, file_ptr, out_type: LogOutType,
+                        min_level: "LogLevel", level_mask: int = 0) -> bool:
+    return bool(_logger.lg_add_sink_filtered(self._ptr, file_ptr, out_type,
+                                             min_level, level_mask))
+
+  def remove_sink(self, file_ptr) -> bool:
+    return bool(_logger.lg_remove_sink(self._ptr, file_ptr))
+
+  def add_file_sink(self, file_handle, out_type: LogOutType) -> bool:
+    return bool(_logger.lg_add_file_sink(self._ptr, file_handle, out_type))
+
+  def remove_file_sink(self, file_handle) -> bool:
+    return bool(_logger.lg_remove_file_sink(self._ptr, file_handle))
+
+  # Named category, keep the returned object (lookup compares names)
+  def category(self, name: str) -> "Category | None":
+    cat = _logger.lg_category(self._ptr, name.encode())
+    return None if cat == ffi.NULL else Category(cat)
+
   def __enter__(self):
     return self
 
@@ -259,6 +482,13 @@ class Logger:
   def logi(self, level: LogLevel, msg: str) -> bool:
     return bool(_logger.lg_flogi(self._ptr, level, msg.encode()))
 
+  # One C call for all of them, returns how many are logged
+  def log_batch(self, levels, msgs) -> int:
+    data = [m.encode() for m in msgs]
+    return int(_logger.lg_log_batch(self._ptr, ffi.NULL, ffi.new("LgLogLevel[]", list(levels)),
+                                    b"".join(data), ffi.new("size_t[]", [len(d) for d in data]),
+                                    ffi.NULL, len(data)))
+
   # Decorator for custom formatter
   # Func is full python function (parameters etc.) go to main.py
   # Func signature: func(str, str, str, LogOutType): str
@@ -291,6 +521,181 @@ class Logger:
       return 1
     return wrapper
 
+class Category:
+  def __init__(self, _ptr) -> None:
+    self._ptr = _ptr
+
+  @property
+  def name(self) -> str:
+    return _decode_cstr(_logger.lg_category_name(self._ptr))
+
+  def set_level(self, min_level: "LogLevel", level_mask: int = 0) -> bool:
+    return bool(_logger.lg_category_set_level(self._ptr, min_level, level_mask))
+
+  def set_sinks(self, sink_mask: int) -> bool:
+    return bool(_logger.lg_category_set_sinks(self._ptr, sink_mask))
+
+  def inherit(self) -> bool:
+    return bool(_logger.lg_category_inherit(self._ptr))
+
+  def log(self, level: "LogLevel", msg: str) -> bool:
+    return bool(_logger.lg_fclog(self._ptr, level, msg.encode()))
+
+  def info(self, msg: str) -> bool:
+    return self.log(LogLevel.INFO, msg)
+
+  def error(self, msg: str) -> bool:
+    return self.log(LogLevel.ERROR, msg)
+
+  def warn(self, msg: str) -> bool:
+    return self.log(LogLevel.WARNING, msg)
+
+def _lg_level(levelno: int) -> "LogLevel":
+  if levelno >= logging.ERROR:
+    return LogLevel.ERROR
+  if levelno >= logging.WARNING:
+    return LogLevel.WARNING
+  return LogLevel.INFO
+
+class _Pending:
+  __slots__ = ("lock", "owner", "levels", "chunks", "lens", "ts", "since")
+
+  def __init__(self) -> None:
+    self.lock   = threading.Lock()
+    self.owner  = threading.current_thread()
+    self.levels = []
+    self.chunks = []
+    self.lens   = []
+    self.ts     = [] # record.created of them, C side stamps them with it
+    self.since  = 0.0 # created of the oldest one
+
+class LoggerHandler(logging.Handler):
+  """
+    logging.Handler on top of lg_log_batch. Records are formatted and kept
+    per thread (no handler-wide lock), then handed to C capacity of them at
+    a time, in one call with explicit lengths and the GIL released during it.
+    Records at or above flush_level go out right away with the ones before them.
+    None waits more than about max_age_ms: any thread's emit submits the older
+    ones of quiet threads. Lines have record.created as their time
+    Layout (time, level) is C formatter's, the default Formatter gives the message only.
+    With category, setLevel is applied by the C side too (lg_category_set_level)
+  """
+  def __init__(self, lg: "Logger" = None, level: int = logging.NOTSET,
+               capacity: int = 64, flush_level: int = logging.ERROR,
+               category: str = None, flush_timeout_ms: int = 1000,
+               max_age_ms: int = 1000) -> None:
+    super().__init__(level)
+    self._lg = lg # keeps the instance from Logger.__del__ while handler is there
+    self._ptr = lg._ptr if lg is not None else _logger.lg_get_active_instance()
+    self._closed = False
+    self._cat = ffi.NULL
+    if category is not None:
+      self._cat = _logger.lg_category(self._ptr, category.encode())
+      if self._cat == ffi.NULL:
+        raise ValueError(f"Cannot create category: {category}")
+    self.capacity = max(1, int(capacity))
+    self.flush_level = flush_level
+    self.flush_timeout_ms = flush_timeout_ms
+    self.max_age = max_age_ms / 1000
+    self._swept = 0.0 # created of the record that swept the last time
+    self._local = threading.local()
+    self._pending = [] # of every thread, flush() submits them all
+    self._pending_lock = threading.Lock()
+    self.setLevel(level)
+
+  def setLevel(self, level) -> None:
+    super().setLevel(level)
+    if self._cat != ffi.NULL and self.level != logging.NOTSET:
+      _logger.lg_category_set_level(self._cat, _lg_level(self.level), 0)
+
+  def _mine(self) -> "_Pending":
+    p = getattr(self._local, "pending", None)
+    if p is None:
+      p = _Pending()
+      self._local.pending = p
+      with self._pending_lock:
+        self._pending.append(p)
+    return p
+
+  # logging.shutdown flushes handlers again after close() and main's destroy
+  def _usable(self) -> bool:
+    return not self._closed and bool(_logger.lg_is_alive(self._ptr))
+
+  # caller holds p.lock
+  def _submit(self, p: "_Pending") -> None:
+    n = len(p.lens)
+    if n == 0:
+      return
+    # nowhere to go once it's closed or the instance is destroyed
+    if self._usable():
+      _logger.lg_log_batch(self._ptr, self._cat, ffi.new("LgLogLevel[]", p.levels),
+                           b"".join(p.chunks), ffi.new("size_t[]", p.lens),
+                           ffi.new("double[]", p.ts), n)
+    p.levels.clear()
+    p.chunks.clear()
+    p.lens.clear()
+    p.ts.clear()
+
+  # other threads' records older than max_age, busy ones are skipped
+  def _sweep(self, now: float) -> None:
+    self._swept = now
+    with self._pending_lock:
+      pending = list(self._pending)
+    for p in pending:
+      if not p.lens or now - p.since < self.max_age or not p.lock.acquire(blocking=False):
+        continue
+      try:
+        if p.lens and now - p.since >= self.max_age:
+          self._submit(p)
+      finally:
+        p.lock.release()
+
+  # filter and emit only, pending lists have their own locks
+  def handle(self, record) -> bool:
+    rv = self.filter(record)
+    if rv:
+      self.emit(record)
+    return rv
+
+  def emit(self, record) -> None:
+    try:
+      data = self.format(record).encode("utf-8", "replace")
+      p = self._mine()
+      now = record.created
+      with p.lock:
+        if not p.lens:
+          p.since = now
+        p.levels.append(_lg_level(record.levelno))
+        p.chunks.append(data)
+        p.lens.append(len(data))
+        p.ts.append(now)
+        if (len(p.lens) >= self.capacity or record.levelno >= self.flush_level or
+            now - p.since >= self.max_age):
+          self._submit(p)
+      if now - self._swept >= self.max_age:
+        self._sweep(now)
+    except Exception:
+      self.handleError(record)
+
+  # submits every thread's records and waits until C side has written them
+  def flush(self) -> None:
+    if not self._usable():
+      return
+    with self._pending_lock:
+      pending = list(self._pending)
+    for p in pending:
+      with p.lock:
+        self._submit(p)
+    with self._pending_lock:
+      self._pending = [p for p in self._pending if p.owner.is_alive() or p.lens]
+    if self.flush_timeout_ms:
+      _logger.lg_flush(self._ptr, int(self.flush_timeout_ms))
+
+  def close(self) -> None:
+    self.flush()
+    self._closed = True
+    super().close()
+
 class LoggerUtils:
   @staticmethod
   def get_instance() -> "Logger | None":
@@ -301,10 +706,30 @@ class LoggerUtils:
   def set_instance(lg: "Logger") -> bool:
     return bool(_logger.lg_set_active_instance(lg._ptr))
 
+  # Shared writer threads, set it as config's writerPool
+  @staticmethod
+  def pool_create(threads: int):
+    pool = _logger.lg_pool_create(threads)
+    return None if pool == ffi.NULL else pool
+
+  @staticmethod
+  def pool_destroy(pool) -> bool:
+    return bool(_logger.lg_pool_destroy(pool))
+
+  # Staged file for file sinks, logger owns it once it's a sink
+  @staticmethod
+  def file_open(path: str, direct_io: bool = False, drop_cache: bool = False,
+                sync: "LogSyncPolicy" = None, sync_bytes: int = 0,
+                sync_millis: int = 0):
+    policy = LogSyncPolicy.NONE if sync is None else sync
+    opts = _file_options(direct_io, drop_cache, policy, sync_bytes, sync_millis)
+    handle = _logger.lg_file_open(path.encode(), opts[0])
+    return None if handle == ffi.NULL else handle
+
   @staticmethod
-  def get_time_str(local_time: bool) -> str:
-    buf = ffi.new("char[24]")
-    if not _logger.lg_get_time_str(buf, local_time):
+  def get_time_str(lg: "Logger") -> str:
+    buf = ffi.new("char[40]")
+    if not _logger.lg_get_time_str(lg._ptr, buf):
       return ""
     return _decode_cstr(buf)
 
@@ -1,5 +1,5 @@
-from liblogger import ffi, Logger, LogOutType, LoggerConfig, LoggerUtils
-import time, ctypes
+from liblogger import ffi, Logger, LogOutType, LoggerConfig, LoggerUtils, LoggerHandler
+import time, ctypes, logging
 
 bash_aqua = "\x1b[36m"
 bash_reset = "\x1b[0m"
@@ -35,6 +35,15 @@ def main():
   lg.error("Error from Python!")
   lg.warn("Warning %10 from Python!")
 
+  # logging module, records go to C in batches
+  handler = LoggerHandler(lg, capacity=64)
+  log = logging.getLogger("app")
+  log.addHandler(handler)
+  log.setLevel(logging.INFO)
+  log.info("Hello from logging!")
+  log.warning("Warning from logging!")
+  handler.close()
+
   if not lg.destroy():
     print("[PYTHON] Logger destroy failed!")
     return
@@ -4,7 +4,7 @@ use libc::FILE;
 use std::ffi::CString;
 
 pub const LOGGER_MAX_MSG_SIZE: usize = 1024;
-pub const LOGGER_TIME_STR_SIZE: usize = 24;
+pub const LOGGER_TIME_STR_SIZE: usize = 40;
 pub const LOGGER_MAX_SINKS: usize = 8;
 
 // Log Levels
@@ -21,9 +21,10 @@ pub enum LgLogLevel {
 #[repr(C)]
 #[derive(Copy, Clone)]
 pub enum LgLogPolicy {
-  Drop          = 1 << 0,
-  Block         = 1 << 1,
-  PriorityBased = 1 << 2,
+  Drop          = 0,
+  Block         = 1,
+  PriorityBased = 2,
+  Spill         = 3,
 }
 
 // Message Out Types
@@ -40,6 +41,9 @@ pub enum LgOutType {
 pub struct LgSink {
   pub file: *mut FILE,
   pub out_type: LgOutType,
+  pub min_level: LgLogLevel,
+  pub level_mask: u32,
+  pub handle: *mut LgFile,
 }
 
 #[repr(C)]
@@ -55,6 +59,108 @@ impl Default for LgSinks {
   }
 }
 
+// time_str layouts
+#[repr(C)]
+#[derive(Copy, Clone)]
+pub enum LgTimeStyle {
+  Default = 0,
+  Iso8601 = 1,
+  Epoch   = 2,
+}
+
+// Sub-second digits of time_str
+#[repr(C)]
+#[derive(Copy, Clone)]
+pub enum LgTimePrecision {
+  Ms = 0,
+  Us = 1,
+  Ns = 2,
+}
+
+// Durability policies of LgFile
+#[repr(C)]
+#[derive(Copy, Clone)]
+pub enum LgSyncPolicy {
+  None     = 0,
+  Bytes    = 1,
+  Interval = 2,
+}
+
+#[repr(C)]
+#[derive(Copy, Clone)]
+pub struct LgFileOptions {
+  pub direct_io:   c_int,
+  pub drop_cache:  c_int,
+  pub sync:        LgSyncPolicy,
+  pub sync_bytes:  usize,
+  pub sync_millis: u32,
+}
+
+impl Default for LgFileOptions {
+  fn default() -> Self {
+    LgFileOptions { direct_io: 0, drop_cache: 0, sync: LgSyncPolicy::None,
+                    sync_bytes: 0, sync_millis: 0 }
+  }
+}
+
+// Scheduling policy of writer threads
+#[repr(C)]
+#[derive(Copy, Clone)]
+pub enum LgSchedPolicy {
+  Default = 0,
+  Other   = 1,
+  Batch   = 2,
+  Idle    = 3,
+  Fifo    = 4,
+  Rr      = 5,
+}
+
+// Where ring's memory lives on NUMA machines
+#[repr(C)]
+#[derive(Copy, Clone)]
+pub enum LgRingPlacement {
+  FirstTouch = 0,
+  WriterNode = 1,
+  Node       = 2,
+}
+
+#[repr(C)]
+#[derive(Copy, Clone)]
+pub struct LgThreadOptions {
+  pub cpus:           *const c_char,
+  pub nice:           c_int,
+  pub sched:          LgSchedPolicy,
+  pub sched_priority: c_int,
+  pub ring_placement: LgRingPlacement,
+  pub ring_node:      c_int,
+}
+
+impl Default for LgThreadOptions {
+  fn default() -> Self {
+    LgThreadOptions { cpus: std::ptr::null(), nice: 0, sched: LgSchedPolicy::Default,
+                      sched_priority: 0, ring_placement: LgRingPlacement::FirstTouch,
+                      ring_node: 0 }
+  }
+}
+
+// Shared writer threads (opaque struct)
+#[repr(C)]
+pub struct LgWriterPool {
+  _private: [u8; 0],
+}
+
+// Named category of an instance (opaque struct)
+#[repr(C)]
+pub struct LgCategory {
+  _private: [u8; 0],
+}
+
+// Staged file handle (opaque struct)
+#[repr(C)]
+pub struct LgFile {
+  _private: [u8; 0],
+}
+
 pub type LogFormatterT = unsafe extern "C" fn(
     *const c_char, LgLogLevel, *const c_char, u32, *mut LgString) -> c_int;
 
@@ -67,6 +173,21 @@ pub struct LoggerConfig {
   pub sinks:                 LgSinks,
   pub log_policy:            LgLogPolicy,
   pub log_formatter:         Option<LogFormatterT>,
+  pub pipeline_writes:       c_int,
+  pub file_options:          LgFileOptions,
+  pub time_style:            LgTimeStyle,
+  pub time_precision:        LgTimePrecision,
+  pub log_call_site:         c_int,
+  pub writer_pool:           *mut LgWriterPool,
+  pub priority_lane:         c_int,
+  pub priority_level:        LgLogLevel,
+  pub writer_options:        LgThreadOptions,
+  pub index_file:            c_int,
+  pub max_total_bytes:       usize,
+  pub max_age_secs:          u32,
+  pub shared_ring:           c_int,
+  pub format_workers:        c_int,
+  pub spill_max_queued:      usize,
 }
 
 // This is forward-declared in header
@@ -147,13 +268,30 @@ unsafe extern "C" {
   pub fn lg_init(inst: *mut Logger, logs_dir: *const c_char, config: LoggerConfig) -> c_int;
   pub fn lg_init_defaults(instance: *mut Logger, logs_dir: *const c_char) -> c_int;
   pub fn lg_destroy(inst: *mut Logger) -> c_int;
+  pub fn lg_get_dropped(inst: *const Logger) -> usize;
+  pub fn lg_shared_fd(inst: *const Logger) -> c_int;
+  pub fn lg_attach(inst: *mut Logger, fd: c_int) -> c_int;
+  pub fn lg_flush(inst: *mut Logger, timeout_ms: u32) -> c_int;
+  pub fn lg_pool_create(threads: c_int) -> *mut LgWriterPool;
+  pub fn lg_pool_destroy(pool: *mut LgWriterPool) -> c_int;
 
   // Custom formatter functions
   pub fn lg_lvl_to_str(level: LgLogLevel) -> *const c_char;
   pub fn lg_str_write_into(s: *mut LgString, str: *const c_char) -> c_void;
-  pub fn lg_get_time_str(buf: *mut c_char, isLocalTime: c_int) -> c_int;
+  pub fn lg_get_time_str(inst: *mut Logger, buf: *mut c_char) -> c_int;
   pub fn lg_get_defaults() -> LoggerConfig;
   pub fn lg_append_sink(config: *mut LoggerConfig, f: *mut FILE, out_type: LgOutType) -> c_int;
+  pub fn lg_append_sink_filtered(config: *mut LoggerConfig, f: *mut FILE, out_type: LgOutType,
+                                 min_level: LgLogLevel, level_mask: u32) -> c_int;
+  pub fn lg_add_sink(inst: *mut Logger, f: *mut FILE, out_type: LgOutType) -> c_int;
+  pub fn lg_add_sink_filtered(inst: *mut Logger, f: *mut FILE, out_type: LgOutType,
+                              min_level: LgLogLevel, level_mask: u32) -> c_int;
+  pub fn lg_remove_sink(inst: *mut Logger, f: *mut FILE) -> c_int;
+  pub fn lg_file_open(path: *const c_char, opts: LgFileOptions) -> *mut LgFile;
+  pub fn lg_file_close(f: *mut LgFile) -> c_int;
+  pub fn lg_append_file_sink(config: *mut LoggerConfig, f: *mut LgFile, out_type: LgOutType) -> c_int;
+  pub fn lg_add_file_sink(inst: *mut Logger, f: *mut LgFile, out_type: LgOutType) -> c_int;
+  pub fn lg_remove_file_sink(inst: *mut Logger, f: *mut LgFile) -> c_int;
 
   // Log functions
   // Implicit instances
@@ -168,6 +306,14 @@ unsafe extern "C" {
   pub fn lg_ferrori(inst: *mut Logger, msg: *const c_char) -> c_int;
   pub fn lg_fwarni(inst: *mut Logger, msg: *const c_char) -> c_int;
 
+  // Categories
+  pub fn lg_category(inst: *mut Logger, name: *const c_char) -> *mut LgCategory;
+  pub fn lg_category_name(cat: *const LgCategory) -> *const c_char;
+  pub fn lg_category_set_level(cat: *mut LgCategory, min_level: LgLogLevel, level_mask: u32) -> c_int;
+  pub fn lg_category_set_sinks(cat: *mut LgCategory, sink_mask: u32) -> c_int;
+  pub fn lg_category_inherit(cat: *mut LgCategory) -> c_int;
+  pub fn lg_fclog(cat: *mut LgCategory, level: LgLogLevel, msg: *const c_char) -> c_int;
+
   // File helpers
   pub fn lg_get_stdout() -> *mut FILE;
   pub fn lg_get_stderr() -> *mut FILE;
@@ -45,6 +45,21 @@ fn main() {
       log_policy: LgLogPolicy::Drop,
       sinks: LgSinks::default(),
       log_formatter: None, //Some(formatter), // FUCK ALL RUST DEVELOPERS AND GOONERS
+      pipeline_writes: 0,
+      file_options: LgFileOptions::default(),
+      time_style: LgTimeStyle::Default,
+      time_precision: LgTimePrecision::Ms,
+      log_call_site: 0,
+      writer_pool: null_mut(),
+      priority_lane: 0,
+      priority_level: LgLogLevel::Error,
+      writer_options: LgThreadOptions::default(),
+      index_file: 0,
+      max_total_bytes: 0,
+      max_age_secs: 0,
+      shared_ring: 0,
+      format_workers: 0,
+      spill_max_queued: 0,
     };
     lg_append_sink(&mut config, lg_get_stdout(), LgOutType::TTY);
     lg_append_sink(&mut config, lg_fopen(cstr!("some.log")), LgOutType::Net);